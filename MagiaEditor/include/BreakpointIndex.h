@@ -0,0 +1,85 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef MAGIA_BREAKPOINTINDEX_H
+#define MAGIA_BREAKPOINTINDEX_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mg {
+
+    // Breakpoints per chunk name (the Lua "source"), each chunk backed by a bitset of lines.
+    // The hook first tests the union of every chunk with a single load and bit test, the
+    // chunk, condition and hit count are only looked at when that bit is set.
+    class BreakpointIndex {
+    public:
+        struct Breakpoint {
+            int line{0};            // 1 based, as Lua reports it
+            std::string condition;  // Lua expression, empty for an unconditional breakpoint
+            int hitTarget{0};       // pauses from this hit on, 0 pauses on every hit
+            int hits{0};
+        };
+
+        BreakpointIndex() = default;
+        BreakpointIndex(const BreakpointIndex&) = delete;
+        BreakpointIndex& operator=(const BreakpointIndex&) = delete;
+
+        void set(const std::string& source, int line, const std::string& condition = {}, int hitTarget = 0);
+        void remove(const std::string& source, int line);
+        void clear();
+
+        bool empty() const { return _count.load(std::memory_order_relaxed) == 0; }
+
+        // Hot path, called for every line executed while debugging
+        bool mayBreak(int line) const {
+            const auto* lines = _anyLine.load(std::memory_order_acquire);
+            const auto word = static_cast<std::size_t>(line) >> 6;
+            return lines && line >= 0 && word < lines->size() && (((*lines)[word] >> (line & 63)) & 1u);
+        }
+
+        // Slow path, confirms the breakpoint belongs to this chunk and copies it
+        bool find(const std::string& source, int line, Breakpoint& breakpoint) const;
+
+        // Counts a hit whose condition passed, returns true when it should pause
+        bool hit(const std::string& source, int line);
+
+        // Resets the hit counts before a debug run, the snapshots replaced during the run stay
+        // alive until finishRun
+        void prepareRun();
+
+        // No hook reads the snapshots anymore, the replaced ones are freed
+        void finishRun();
+
+    private:
+        using Bitmap = std::vector<std::uint64_t>;
+
+        struct Source {
+            Bitmap lines;
+            std::map<int, Breakpoint> breakpoints;
+        };
+
+        static void setBit(Bitmap& bitmap, int line, bool value);
+        void publish();
+        void releaseSnapshots();
+
+        mutable std::mutex _mutex;
+        std::unordered_map<std::string, Source> _sources;
+        std::atomic<const Bitmap*> _anyLine{nullptr};
+        std::atomic<std::size_t> _count{0};
+
+        // the hook may still read a replaced snapshot while a debug run is active, they are
+        // freed once none is
+        std::vector<std::unique_ptr<const Bitmap>> _snapshots;
+        bool _running{false};
+    };
+}
+
+#endif //MAGIA_BREAKPOINTINDEX_H
@@ -0,0 +1,76 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef MAGIA_BYTECODECACHE_H
+#define MAGIA_BYTECODECACHE_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct lua_State;
+
+namespace mg {
+
+    // Compiled chunks (lua_dump output) keyed by a hash of the chunk name and source. The
+    // dump keeps the debug info, the debugger needs the line numbers. Bytecode is portable
+    // between states of the same Lua build, so the validation worker can fill the cache for
+    // the states running scripts. Entries are evicted LRU over a byte budget, and written
+    // to a directory too when one is set. A file on disk starts with a header (Lua version,
+    // length and checksum of the bytecode), a file that does not match it is never loaded.
+    class BytecodeCache {
+    public:
+        explicit BytecodeCache(std::size_t capacity = 64 * 1024 * 1024);
+
+        BytecodeCache(const BytecodeCache&) = delete;
+        BytecodeCache& operator=(const BytecodeCache&) = delete;
+
+        // Cache shared by every editor of the process
+        static BytecodeCache& instance();
+
+        // Empty keeps the cache in memory only
+        void setDirectory(const std::string& directory);
+
+        // Same contract as luaL_loadbuffer: pushes the chunk and returns LUA_OK, or pushes
+        // the error message. Only sources that compile are stored.
+        int load(lua_State* L, std::string_view source, const std::string& chunkName);
+
+        // Compiles and stores the source ahead of a run, leaves the stack untouched
+        bool prime(lua_State* L, std::string_view source, const std::string& chunkName);
+
+        void clear();
+
+    private:
+        struct Entry {
+            std::string bytecode;
+            std::list<std::uint64_t>::iterator use;
+        };
+
+        struct FileHeader {
+            char magic[4];
+            std::uint32_t luaVersion;
+            std::uint64_t length;
+            std::uint64_t checksum;
+        };
+
+        static std::uint64_t key(std::string_view source, const std::string& chunkName);
+        static std::uint64_t fnv(std::string_view bytes, std::uint64_t hash = 14695981039346656037ull);
+
+        bool find(std::uint64_t key, std::string& bytecode);
+        void store(std::uint64_t key, std::string bytecode);
+        std::string filePath(std::uint64_t key) const;
+
+        std::mutex _mutex;
+        std::size_t _capacity{0};
+        std::size_t _size{0};
+        std::list<std::uint64_t> _uses;
+        std::unordered_map<std::uint64_t, Entry> _entries;
+        std::string _directory;
+    };
+}
+
+#endif //MAGIA_BYTECODECACHE_H
@@ -0,0 +1,62 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef MAGIA_CONSOLEBUFFER_H
+#define MAGIA_CONSOLEBUFFER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mg {
+
+    // Scrollback of the console: a ring of lines bounded in lines and bytes, the oldest lines
+    // are dropped first. Lines are addressed from 0 (oldest kept) to lineCount() - 1.
+    class ConsoleBuffer {
+    public:
+        struct Match {
+            std::size_t line{0};
+            std::size_t column{0};  // byte offset in the line
+        };
+
+        explicit ConsoleBuffer(std::size_t maxLines = 100000, std::size_t maxBytes = 32 * 1024 * 1024);
+
+        void setLimits(std::size_t maxLines, std::size_t maxBytes);
+
+        // Text after the last '\n' starts a line that the next append continues
+        void append(std::string_view text);
+        void clear();
+
+        std::size_t lineCount() const { return _count; }
+        std::size_t byteCount() const { return _bytes; }
+        const std::string& line(std::size_t index) const { return _lines[(_first + index) % _lines.size()]; }
+
+        // Lines dropped since the buffer was created, lets a view keep its position stable
+        std::uint64_t droppedLines() const { return _dropped; }
+
+        // Longest line kept so far, for the horizontal scroll range
+        std::size_t widestLine() const { return _widest; }
+
+        // Searches from the given position, wrapping around. The query is ASCII case folded
+        // unless caseSensitive is set.
+        bool find(std::string_view query, Match from, bool backward, bool caseSensitive, Match& found) const;
+
+    private:
+        void pushLine(std::string_view text);
+        void trim();
+
+        std::vector<std::string> _lines;
+        std::size_t _first{0};
+        std::size_t _count{0};
+        std::size_t _bytes{0};
+        std::size_t _maxLines{0};
+        std::size_t _maxBytes{0};
+        std::size_t _widest{0};
+        std::uint64_t _dropped{0};
+        bool _openLine{false};
+    };
+}
+
+#endif //MAGIA_CONSOLEBUFFER_H
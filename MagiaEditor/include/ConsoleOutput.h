@@ -5,16 +5,63 @@
 #ifndef TESTSCINTILLACMAKE_CONSOLEOUTPUT_H
 #define TESTSCINTILLACMAKE_CONSOLEOUTPUT_H
 
-#include <QPlainTextEdit>
+#include <QAbstractScrollArea>
 #include <QMenu>
+#include "ConsoleBuffer.h"
 
 namespace mg {
-    class ConsoleOutput : public QPlainTextEdit {
+
+    // Read only console over a bounded ConsoleBuffer. Only the lines in the viewport are
+    // laid out and painted, so appending costs the same with 10 or 100k lines of history.
+    class ConsoleOutput : public QAbstractScrollArea {
     Q_OBJECT
     public:
         ConsoleOutput(QWidget *parent = nullptr);
+
+        void setLimits(std::size_t maxLines, std::size_t maxBytes);
+
+        // Text ending without '\n' is continued by the next append
+        void append(std::string_view text);
+
+        // Same as QPlainTextEdit, the text becomes a new line
+        void appendPlainText(const QString& text);
+
+        bool findNext(const QString& text, bool backward = false, bool caseSensitive = false);
+
+    public slots:
+        void clear();
+        void copy();
+        void selectAll();
+
     protected:
+        void paintEvent(QPaintEvent *event) override;
+        void resizeEvent(QResizeEvent *event) override;
         void contextMenuEvent(QContextMenuEvent *event) override;
+        void mousePressEvent(QMouseEvent *event) override;
+        void mouseMoveEvent(QMouseEvent *event) override;
+        void keyPressEvent(QKeyEvent *event) override;
+
+    private:
+        void updateScrollBars();
+        void scrollToLine(std::size_t line);
+        void askForQuery();
+
+        int lineHeight() const;
+        int visibleLines() const;
+        std::uint64_t lineIdAt(int y) const;
+        bool hasSelection() const;
+
+        ConsoleBuffer _buffer;
+
+        // lines are identified by droppedLines() + index, so they survive trimming
+        std::uint64_t _selectionAnchor{0};
+        std::uint64_t _selectionEnd{0};
+        bool _selecting{false};
+
+        QString _query;
+        std::uint64_t _matchLine{0};
+        std::size_t _matchColumn{0};
+        std::size_t _matchLength{0};
     };
 
 }
@@ -0,0 +1,78 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef MAGIA_IDENTIFIERINDEX_H
+#define MAGIA_IDENTIFIERINDEX_H
+
+#include <bitset>
+#include <climits>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mg {
+
+    // Identifiers of one document with their number of occurrences, kept in a sorted map so
+    // the completions of a prefix are one lower_bound away. Lines are rescanned only after
+    // they were edited or restyled, words inside comments, strings and numbers (the ignored
+    // styles of the lexer) are left out.
+    class IdentifierIndex {
+    public:
+        using LineReader = std::function<std::string_view(int line)>;
+
+        // Style of the character at column of line, the line must be styled already
+        using StyleReader = std::function<int(int line, int column)>;
+
+        static constexpr std::size_t DefaultLimit = 50;
+
+        void reset(int lineCount);
+        void linesInserted(int line, int count);
+        void linesRemoved(int line, int count);
+        void linesRestyled(int firstLine, int lastLine);
+
+        // Rescans every line when the set changes
+        void setIgnoredStyles(const std::bitset<256>& styles);
+
+        // First and last lines waiting for a rescan, -1 when the index is up to date
+        int firstDirtyLine() const { return _dirtyFrom; }
+        int lastDirtyLine() const { return _dirtyTo; }
+
+        // Rescans the dirty lines among the maxLines lines from firstDirtyLine(), returns true
+        // once none is left
+        bool refresh(const LineReader& readLine, const StyleReader& styleAt, int maxLines = INT_MAX);
+
+        // Words starting with prefix, most used first. extra holds words known from elsewhere
+        // (keywords, globals of the Lua state), sorted, they rank as if used once more.
+        // The prefix itself only shows up when it is used elsewhere in the document.
+        std::vector<std::string> complete(std::string_view prefix,
+                                          const std::vector<std::string>& extra = {},
+                                          std::size_t limit = DefaultLimit) const;
+
+        std::size_t size() const { return _words.size(); }
+
+        int lineCount() const { return static_cast<int>(_lines.size()); }
+
+    private:
+        using Words = std::map<std::string, int, std::less<>>;
+
+        struct LineInfo {
+            std::vector<Words::iterator> words;
+            bool dirty{true};
+        };
+
+        void markDirty(int from, int to);
+        void clearLine(LineInfo& info);
+        void scanLine(int line, std::string_view text, const StyleReader& styleAt);
+
+        Words _words;
+        std::vector<LineInfo> _lines;
+        std::bitset<256> _ignoredStyles;
+        int _dirtyFrom{-1};
+        int _dirtyTo{-1};
+    };
+}
+
+#endif //MAGIA_IDENTIFIERINDEX_H
@@ -0,0 +1,96 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef MAGIA_LUASYNTAXVALIDATOR_H
+#define MAGIA_LUASYNTAXVALIDATOR_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct lua_State;
+
+namespace mg {
+
+    // Splits a Lua document in top-level chunks (a new chunk starts on a column 0
+    // statement keyword outside of any block) and caches the compile result of each
+    // chunk by content hash, so an edit only recompiles the chunks it touched.
+    //
+    // Chunks compiled apart miss the rules that span them: a top-level return followed by
+    // more statements, a goto to a label of another chunk, an assignment to a <const> or
+    // <close> local declared in an earlier chunk. A clean result is therefore only a first
+    // answer, the editor confirms it with one parse of the whole document once it is idle.
+    class LuaSyntaxValidator {
+    public:
+        struct Job {
+            std::size_t hash{0};
+            std::string text;
+        };
+
+        // errorLine is relative to the chunk (1 based), -1 when the chunk compiles
+        struct ChunkResult {
+            std::size_t hash{0};
+            int errorLine{-1};
+            std::string message;
+        };
+
+        using LineReader = std::function<std::string_view(int line)>;
+        using RangeReader = std::function<std::string_view(int firstLine, int lastLine)>;
+
+        void reset(int lineCount);
+        void linesInserted(int line, int count);
+        void linesRemoved(int line, int count);
+
+        // Rescans the edited lines and returns the chunks whose result is not cached yet
+        std::vector<Job> collectJobs(const LineReader& readLine, const RangeReader& readRange);
+        void storeResults(const std::vector<ChunkResult>& results);
+
+        // Fills errorMessage with the first error of the document ("[string "name"]:line: msg"
+        // or empty when valid). Returns false while some chunk still has no cached result.
+        bool resolve(const std::string& chunkName, std::string& errorMessage);
+
+        static ChunkResult compile(lua_State* L, const Job& job, const std::string& chunkName);
+
+    private:
+        struct ScanState {
+            int blocks{0};
+            int brackets{0};
+            int longLevel{-1};
+
+            bool isTopLevel() const { return blocks == 0 && brackets == 0 && longLevel < 0; }
+            bool operator==(const ScanState& other) const {
+                return blocks == other.blocks && brackets == other.brackets && longLevel == other.longLevel;
+            }
+            bool operator!=(const ScanState& other) const { return !(*this == other); }
+        };
+
+        struct LineInfo {
+            ScanState state;          // lexical state at the end of the line
+            bool dirty{true};
+            bool startsChunk{false};
+            bool glued{false};        // chunk boundary suppressed after an "<eof>" error
+            std::size_t chunkHash{0}; // only meaningful on the first line of a chunk
+            int chunkLines{0};
+        };
+
+        struct Chunk {
+            int firstLine;
+            int lastLine;
+        };
+
+        static ScanState scanLine(std::string_view text, ScanState state);
+        static bool startsStatement(std::string_view text);
+        void markDirty(int from, int to);
+
+        std::vector<LineInfo> _lines;
+        std::vector<Chunk> _chunks;
+        std::unordered_map<std::size_t, ChunkResult> _cache;
+        int _dirtyFrom{-1};
+        int _dirtyTo{-1};
+    };
+}
+
+#endif //MAGIA_LUASYNTAXVALIDATOR_H
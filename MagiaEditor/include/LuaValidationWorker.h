@@ -0,0 +1,79 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef MAGIA_LUAVALIDATIONWORKER_H
+#define MAGIA_LUAVALIDATIONWORKER_H
+
+#include "LuaSyntaxValidator.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+struct lua_State;
+
+namespace mg {
+
+    // Compiles validation jobs on a dedicated thread with its own lua_State, so it never
+    // touches the state used to run scripts. Only the newest request matters: a request
+    // still waiting is replaced and a running one is abandoned between chunks.
+    class LuaValidationWorker {
+    public:
+        // Called on the worker thread. A superseded request still reports the chunks it
+        // finished, the results are keyed by content so they stay valid for the cache.
+        using ResultCallback = std::function<void(std::uint64_t generation,
+                                                  const std::vector<LuaSyntaxValidator::ChunkResult>& results)>;
+
+        // Called on the worker thread with the parse of a whole document, errorLine is
+        // relative to its first line
+        using ConfirmCallback = std::function<void(std::uint64_t version,
+                                                   const LuaSyntaxValidator::ChunkResult& result)>;
+
+        explicit LuaValidationWorker(const ResultCallback& cb);
+        ~LuaValidationWorker();
+
+        void submit(std::uint64_t generation,
+                    std::vector<LuaSyntaxValidator::Job> jobs,
+                    const std::string& chunkName);
+
+        // Parses the whole script once nothing else is pending, for what the chunks cannot
+        // see on their own. A newer confirmation replaces one still waiting. The compiled
+        // script goes to the BytecodeCache, so the next run skips the compilation.
+        void confirm(std::uint64_t version, std::string script, const std::string& chunkName);
+
+        // Set before the first confirm
+        void setConfirmCallback(const ConfirmCallback& cb) { _confirmCallback = cb; }
+
+    private:
+        struct Request {
+            std::uint64_t generation{0};
+            std::vector<LuaSyntaxValidator::Job> jobs;
+            std::string chunkName;
+        };
+
+        struct Confirmation {
+            std::uint64_t version{0};
+            std::string script;
+            std::string chunkName;
+        };
+
+        void run();
+
+        ResultCallback _callback{nullptr};
+        ConfirmCallback _confirmCallback{nullptr};
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::optional<Request> _pending;
+        std::optional<Confirmation> _confirmation;
+        std::atomic<std::uint64_t> _latest{0};
+        bool _stop{false};
+        lua_State* _lua{nullptr};
+        std::thread _thread;
+    };
+}
+
+#endif //MAGIA_LUAVALIDATIONWORKER_H
@@ -5,15 +5,24 @@
 #ifndef MAGIADEBUGGER_H
 #define MAGIADEBUGGER_H
 
+#include "BreakpointIndex.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
-#include <unordered_set>
+#include <mutex>
+#include <string>
 
 namespace sol{
     class state;
 }
 
+struct lua_State;
+
 namespace mg{
 
+    class DebugSession;
+
     class MagiaDebugger {
     public:
         using PauseCallback = std::function<void(void* L, void* ar,  int line, const std::string& functionName)>;
@@ -26,15 +35,62 @@ namespace mg{
             Stopping,
         };
 
-        inline static std::unordered_set<int> breakpoints;
-        static void setHook(const std::shared_ptr<sol::state>& sol);
-        static void appendBreakpoint(int line);
-        static void removeBreakpoint(int line);
-        inline static DebuggerState state = DebuggerState::Coding;
+        // Stores the session in the extra space of the state, so the hook finds the session
+        // of the state it runs on in O(1). Coroutines inherit the extra space of the main state.
+        // The hook itself is installed by the script thread, see DebugSession::attach.
+        static void setHook(const std::shared_ptr<sol::state>& sol, DebugSession* session);
+
+        static DebugSession* session(lua_State* L);
+    };
+
+    // Debugger state of one lua_State. Every editor owns its session, so several scripts can
+    // run and be debugged at the same time without sharing anything.
+    class DebugSession {
+    public:
+        using DebuggerState = MagiaDebugger::DebuggerState;
+        using PauseCallback = MagiaDebugger::PauseCallback;
+
+        DebugSession() = default;
+        DebugSession(const DebugSession&) = delete;
+        DebugSession& operator=(const DebugSession&) = delete;
+
+        DebuggerState state() const { return _state.load(); }
+
+        // Changes the state and wakes up the script thread if it is waiting on a pause. The
+        // hook of a running script picks the change up itself.
+        void setState(DebuggerState newState);
+
+        // Script thread only, around a run. lua_sethook is never called from another thread:
+        // it writes the hook fields unsynchronised and walks the call stack the running
+        // thread may be freeing. A count hook stays armed while the script runs and switches
+        // the mask when the state or the breakpoints ask for another one.
+        void attach(lua_State* L);
+        void detach(lua_State* L);
+        void applyHook(lua_State* L);
+
+        // Blocks the script thread, without polling, until the state leaves Paused
+        void waitWhilePaused();
+
+        // line is 0 based as in the editor, source is the chunk name the script is loaded with
+        void appendBreakpoint(const std::string& source, int line,
+                              const std::string& condition = {}, int hitTarget = 0);
+        void removeBreakpoint(const std::string& source, int line);
+
+        BreakpointIndex& breakpoints() { return _breakpoints; }
+
+        void setPauseCallback(const PauseCallback& cb);
+        const PauseCallback& pauseCallback() const { return _pauseCallback; }
+
+    private:
+        // Instructions between two looks at the state while nothing else is hooked
+        static constexpr int CheckInterval = 1000;
 
-        static void setPauseCallback(const PauseCallback& cb);
+        std::atomic<DebuggerState> _state{DebuggerState::Coding};
+        BreakpointIndex _breakpoints;
+        PauseCallback _pauseCallback{nullptr};
 
-        inline static PauseCallback pauseCallback{nullptr};
+        std::mutex _pauseMutex;
+        std::condition_variable _pauseCondition;
     };
 
 }
@@ -7,13 +7,19 @@
 
 
 #include "ScintillaEdit.h"
-#include <thread>
+#include "LuaSyntaxValidator.h"
+#include "MagiaDebugger.h"
+#include "ScriptExecutor.h"
+#include "IdentifierIndex.h"
+#include <future>
 
 namespace sol {
     class state;
 }
 
 namespace mg {
+    class LuaValidationWorker;
+
     using PrintCallback = std::function<void(const std::string &)>;
     using FinishExecution = std::function<void(bool)>;
 
@@ -36,6 +42,8 @@ namespace mg {
         void stepExecution();
         void continueExecution();
 
+        DebugSession& debugSession() { return _debugSession; }
+
     signals:
         void scriptStarted();
         void scriptPaused();
@@ -62,19 +70,42 @@ namespace mg {
                              Scintilla::KeyMod modifiers,
                              int margin);
 
+        void editBreakpoint(int line);
+
         void idleMouseStart(int x, int y);
 
         void idleMouseEnd(int x, int y);
 
         void showAutocomplete();
 
+        void showMemberAutocomplete();
+
+        void refreshIdentifiers();
+
+        void collectGlobals();
+
         void updateErrorMaker(int errorLine);
 
         int extractErrorLine(const std::string &errorMsg);
 
-        int validateScript(const std::string &script);
+        void validateScript();
+
+        void onValidationResults(std::uint64_t generation,
+                                 const std::vector<LuaSyntaxValidator::ChunkResult>& results);
+
+        void publishValidation();
+
+        void confirmValidation();
+
+        void onConfirmation(std::uint64_t version, const LuaSyntaxValidator::ChunkResult& result);
+
+        void showConfirmation(const LuaSyntaxValidator::ChunkResult& result);
+
+        std::string_view lineView(int line);
+
+        std::string_view rangeView(int firstLine, int lastLine);
 
-        void executeScript(const std::string &script,const ScriptExecutionCallback& cb);
+        void executeScript(std::string script, const ScriptExecutionCallback& cb);
 
         bool showErrorIfAny(int x, int line, int pos);
 
@@ -83,9 +114,24 @@ namespace mg {
         std::shared_ptr<sol::state> _lua{nullptr};
 
         QTimer *_syntaxTimer{nullptr};
+        QTimer *_confirmTimer{nullptr};
+        std::uint64_t _documentVersion{0};        // bumped by every text change
+        std::uint64_t _confirmedVersion{0};
+        std::size_t _confirmedHash{0};            // content the last confirmation parsed
+        std::size_t _pendingConfirmHash{0};       // content of the confirmation asked last
+        LuaSyntaxValidator::ChunkResult _confirmedResult;
+        LuaSyntaxValidator _validator;
+        IdentifierIndex _identifiers;
+        std::vector<std::string> _completionWords;
+        std::unique_ptr<LuaValidationWorker> _validationWorker{nullptr};
+        std::uint64_t _validationGeneration{0};
+        std::string _chunkName{"script"};
+        DebugSession _debugSession;
         std::string _currentError;
-        std::thread _scriptWorker;
+        CancellationToken _scriptToken;
+        std::future<void> _scriptRun;
         PrintCallback _printCallback{nullptr};
+        std::string _printLine;
         void *_lua_state_on_pause{nullptr};
         void *_debug_state_on_pause{nullptr};
         bool _isPausedInsideFunction{false};
@@ -6,8 +6,10 @@
 #define TESTSCINTILLACMAKE_MAGIAEDITORWIDGET_H
 
 #include <QWidget>
+#include "PrintBuffer.h"
 
 class QToolBar;
+class QTimer;
 
 namespace mg {
     class MagiaEditor;
@@ -17,6 +19,7 @@ namespace mg {
         Q_OBJECT
     public:
         MagiaEditorWidget(QWidget* parent = nullptr);
+        ~MagiaEditorWidget() override;
         void resizeEvent(QResizeEvent *event) override;
 
     public slots:
@@ -40,12 +43,17 @@ namespace mg {
 
         void setupActions();
         void connectActions();
+        void drainOutput();
 
         MagiaEditor* _editor{nullptr};
         ConsoleOutput* _console{nullptr};
         QToolBar *_scriptToolBar;
         QToolBar *_debugToolBar;
         QWidget* _centralWidget{nullptr};
+
+        // filled by the script thread, drained into the console once per frame
+        PrintBuffer _output;
+        QTimer* _outputTimer{nullptr};
     };
 }
 #endif //TESTSCINTILLACMAKE_MAGIAEDITORWIDGET_H
@@ -0,0 +1,54 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef MAGIA_PRINTBUFFER_H
+#define MAGIA_PRINTBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace mg {
+
+    // Lock free single producer / single consumer byte ring between the script thread
+    // (print) and the GUI thread, which drains it in batches on a timer. Every message
+    // ends with '\n'. A message that does not fit is dropped whole and counted, the script
+    // never waits for the GUI.
+    class PrintBuffer {
+    public:
+        // capacity is rounded up to a power of two
+        explicit PrintBuffer(std::size_t capacity = 1 << 20);
+
+        PrintBuffer(const PrintBuffer&) = delete;
+        PrintBuffer& operator=(const PrintBuffer&) = delete;
+
+        // Producer side
+        bool push(std::string_view message);
+
+        // Consumer side, appends up to maxBytes of whole messages to out and returns the bytes taken
+        std::size_t drain(std::string& out, std::size_t maxBytes);
+
+        // Consumer side, messages dropped since the last call
+        std::uint64_t takeDropped() { return _dropped.exchange(0, std::memory_order_relaxed); }
+
+        bool empty() const {
+            return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        void copyIn(std::size_t position, const char* data, std::size_t size);
+
+        std::unique_ptr<char[]> _data;
+        std::size_t _mask{0};
+
+        // head and tail only grow, the slot is position & _mask
+        alignas(64) std::atomic<std::size_t> _head{0};  // written by the producer
+        alignas(64) std::atomic<std::size_t> _tail{0};  // written by the consumer
+        alignas(64) std::atomic<std::uint64_t> _dropped{0};
+    };
+}
+
+#endif //MAGIA_PRINTBUFFER_H
@@ -0,0 +1,81 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef MAGIA_SCRIPTEXECUTOR_H
+#define MAGIA_SCRIPTEXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mg {
+
+    // Shared flag between whoever started a job and the job itself. Cancelling only asks the
+    // job to stop, the callback is how a running Lua script gets interrupted (see DebugSession).
+    class CancellationToken {
+    public:
+        CancellationToken();
+
+        void cancel() const;
+        bool cancelled() const;
+
+        // Called once on cancel, right away if the token is already cancelled
+        void onCancel(std::function<void()> cb) const;
+
+    private:
+        struct State {
+            std::atomic<bool> cancelled{false};
+            std::mutex mutex;
+            std::function<void()> callback{nullptr};
+        };
+
+        std::shared_ptr<State> _state;
+    };
+
+    // Fixed pool of threads running scripts from a FIFO queue. A job is always run, even when
+    // cancelled while queued, so it can report back to its owner; it should check the token first.
+    // The destructor cancels every queued and running job and joins the workers.
+    class ScriptExecutor {
+    public:
+        using Job = std::function<void(const CancellationToken& token)>;
+
+        explicit ScriptExecutor(std::size_t workers);
+        ~ScriptExecutor();
+
+        ScriptExecutor(const ScriptExecutor&) = delete;
+        ScriptExecutor& operator=(const ScriptExecutor&) = delete;
+
+        // Pool shared by every editor of the process
+        static ScriptExecutor& instance();
+
+        // The future is ready when the job returns, it holds the exception a job let escape
+        std::future<void> submit(Job job, const CancellationToken& token = {});
+
+        std::size_t workers() const { return _threads.size(); }
+
+    private:
+        struct Task {
+            Job job;
+            CancellationToken token;
+            std::promise<void> done;
+        };
+
+        void run(std::size_t worker);
+
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::deque<Task> _queue;
+        std::vector<std::unique_ptr<CancellationToken>> _running;
+        bool _stop{false};
+        std::vector<std::thread> _threads;
+    };
+}
+
+#endif //MAGIA_SCRIPTEXECUTOR_H
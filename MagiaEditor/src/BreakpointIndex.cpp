@@ -0,0 +1,132 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#include "BreakpointIndex.h"
+
+namespace mg{
+
+    void BreakpointIndex::set(const std::string& source, int line, const std::string& condition, int hitTarget){
+        if(line < 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& entry = _sources[source];
+        auto& breakpoint = entry.breakpoints[line];
+        breakpoint.line = line;
+        breakpoint.condition = condition;
+        breakpoint.hitTarget = hitTarget;
+        setBit(entry.lines, line, true);
+        publish();
+    }
+
+    void BreakpointIndex::remove(const std::string& source, int line){
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _sources.find(source);
+        if(it == _sources.end())
+            return;
+
+        it->second.breakpoints.erase(line);
+        setBit(it->second.lines, line, false);
+        if(it->second.breakpoints.empty())
+            _sources.erase(it);
+        publish();
+    }
+
+    void BreakpointIndex::clear(){
+        std::lock_guard<std::mutex> lock(_mutex);
+        _sources.clear();
+        publish();
+    }
+
+    bool BreakpointIndex::find(const std::string& source, int line, Breakpoint& breakpoint) const{
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _sources.find(source);
+        if(it == _sources.end())
+            return false;
+
+        auto found = it->second.breakpoints.find(line);
+        if(found == it->second.breakpoints.end())
+            return false;
+
+        breakpoint = found->second;
+        return true;
+    }
+
+    bool BreakpointIndex::hit(const std::string& source, int line){
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _sources.find(source);
+        if(it == _sources.end())
+            return false;
+
+        auto found = it->second.breakpoints.find(line);
+        if(found == it->second.breakpoints.end())
+            return false;
+
+        auto& breakpoint = found->second;
+        ++breakpoint.hits;
+        return breakpoint.hits >= breakpoint.hitTarget;
+    }
+
+    void BreakpointIndex::prepareRun(){
+        std::lock_guard<std::mutex> lock(_mutex);
+        for(auto& [name, source] : _sources)
+            for(auto& [line, breakpoint] : source.breakpoints)
+                breakpoint.hits = 0;
+
+        _running = true;
+        releaseSnapshots();
+    }
+
+    void BreakpointIndex::finishRun(){
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running = false;
+        releaseSnapshots();
+    }
+
+    // keeps only the snapshot currently published, the caller holds the lock
+    void BreakpointIndex::releaseSnapshots(){
+        const auto* current = _anyLine.load();
+        for(auto& snapshot : _snapshots) {
+            if(snapshot.get() == current) {
+                auto keep = std::move(snapshot);
+                _snapshots.clear();
+                _snapshots.push_back(std::move(keep));
+                return;
+            }
+        }
+        _snapshots.clear();
+    }
+
+    void BreakpointIndex::setBit(Bitmap& bitmap, int line, bool value){
+        const auto word = static_cast<std::size_t>(line) >> 6;
+        if(word >= bitmap.size()) {
+            if(!value)
+                return;
+            bitmap.resize(word + 1, 0);
+        }
+
+        const auto mask = std::uint64_t{1} << (line & 63);
+        bitmap[word] = value ? (bitmap[word] | mask) : (bitmap[word] & ~mask);
+    }
+
+    void BreakpointIndex::publish(){
+        auto lines = std::make_unique<Bitmap>();
+        std::size_t count = 0;
+
+        for(const auto& [name, source] : _sources) {
+            if(lines->size() < source.lines.size())
+                lines->resize(source.lines.size(), 0);
+            for(std::size_t i = 0; i < source.lines.size(); ++i)
+                (*lines)[i] |= source.lines[i];
+            count += source.breakpoints.size();
+        }
+
+        _count.store(count, std::memory_order_relaxed);
+        _anyLine.store(lines.get(), std::memory_order_release);
+        _snapshots.push_back(std::move(lines));
+
+        if(!_running)
+            releaseSnapshots();
+    }
+}
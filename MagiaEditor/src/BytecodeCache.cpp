@@ -0,0 +1,192 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#include "BytecodeCache.h"
+#include "lua.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <iterator>
+#include <thread>
+
+namespace mg{
+
+    namespace {
+        constexpr char FileMagic[4] = {'M', 'G', 'B', 'C'};
+
+        int writeChunk(lua_State*, const void* data, size_t size, void* userData) {
+            static_cast<std::string*>(userData)->append(static_cast<const char*>(data), size);
+            return 0;
+        }
+    }
+
+    BytecodeCache::BytecodeCache(std::size_t capacity):
+    _capacity(capacity){}
+
+    BytecodeCache& BytecodeCache::instance(){
+        static BytecodeCache cache;
+        return cache;
+    }
+
+    void BytecodeCache::setDirectory(const std::string& directory){
+        std::error_code error;
+        if(!directory.empty())
+            std::filesystem::create_directories(directory, error);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _directory = error ? std::string{} : directory;
+    }
+
+    int BytecodeCache::load(lua_State* L, std::string_view source, const std::string& chunkName){
+        const auto hash = key(source, chunkName);
+
+        std::string bytecode;
+        if(find(hash, bytecode)) {
+            if(luaL_loadbufferx(L, bytecode.data(), bytecode.size(), chunkName.c_str(), "b") == LUA_OK)
+                return LUA_OK;
+
+            // written by another Lua build, compile it again
+            lua_pop(L, 1);
+        }
+
+        int status = luaL_loadbufferx(L, source.data(), source.size(), chunkName.c_str(), "t");
+        if(status != LUA_OK)
+            return status;
+
+        bytecode.clear();
+        if(lua_dump(L, writeChunk, &bytecode, 0) == 0)
+            store(hash, std::move(bytecode));
+
+        return LUA_OK;
+    }
+
+    bool BytecodeCache::prime(lua_State* L, std::string_view source, const std::string& chunkName){
+        const int top = lua_gettop(L);
+        bool compiled = load(L, source, chunkName) == LUA_OK;
+        lua_settop(L, top);
+        return compiled;
+    }
+
+    void BytecodeCache::clear(){
+        std::lock_guard<std::mutex> lock(_mutex);
+        _uses.clear();
+        _entries.clear();
+        _size = 0;
+    }
+
+    std::uint64_t BytecodeCache::key(std::string_view source, const std::string& chunkName){
+        // unlike std::hash it is stable between runs so it can name the files on disk
+        auto hash = fnv(chunkName);
+        hash = fnv(std::string_view("\0", 1), hash);
+        hash = fnv(source, hash);
+        return hash ^ source.size();
+    }
+
+    // FNV-1a
+    std::uint64_t BytecodeCache::fnv(std::string_view bytes, std::uint64_t hash){
+        for(unsigned char c : bytes) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool BytecodeCache::find(std::uint64_t key, std::string& bytecode){
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _entries.find(key);
+            if(it != _entries.end()) {
+                _uses.splice(_uses.begin(), _uses, it->second.use);
+                bytecode = it->second.bytecode;
+                return true;
+            }
+
+            if(_directory.empty())
+                return false;
+            path = filePath(key);
+        }
+
+        std::ifstream file(path, std::ios::binary);
+        if(!file)
+            return false;
+
+        // a truncated, corrupted or foreign file is compiled again rather than handed to the
+        // binary loader
+        FileHeader header{};
+        if(!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+           std::memcmp(header.magic, FileMagic, sizeof(FileMagic)) != 0 ||
+           header.luaVersion != LUA_VERSION_NUM || header.length == 0 || header.length > _capacity)
+            return false;
+
+        bytecode.resize(static_cast<std::size_t>(header.length));
+        if(!file.read(bytecode.data(), static_cast<std::streamsize>(header.length)) ||
+           file.peek() != std::ifstream::traits_type::eof() ||
+           fnv(bytecode) != header.checksum) {
+            bytecode.clear();
+            return false;
+        }
+
+        store(key, bytecode);
+        return true;
+    }
+
+    void BytecodeCache::store(std::uint64_t key, std::string bytecode){
+        std::string path;
+        std::string copy;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(bytecode.size() > _capacity || _entries.count(key))
+                return;
+
+            if(!_directory.empty()) {
+                path = filePath(key);
+                copy = bytecode;
+            }
+
+            _size += bytecode.size();
+            _uses.push_front(key);
+            _entries[key] = Entry{std::move(bytecode), _uses.begin()};
+
+            while(_size > _capacity) {
+                auto last = _entries.find(_uses.back());
+                _size -= last->second.bytecode.size();
+                _entries.erase(last);
+                _uses.pop_back();
+            }
+        }
+
+        if(path.empty() || std::filesystem::exists(path))
+            return;
+
+        // written aside and renamed, a concurrent reader never sees half a chunk
+        std::string temporary = path + ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        FileHeader header{};
+        std::memcpy(header.magic, FileMagic, sizeof(FileMagic));
+        header.luaVersion = LUA_VERSION_NUM;
+        header.length = copy.size();
+        header.checksum = fnv(copy);
+
+        bool written;
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(copy.data(), static_cast<std::streamsize>(copy.size()));
+            written = static_cast<bool>(file);
+        }
+
+        std::error_code error;
+        if(written)
+            std::filesystem::rename(temporary, path, error);
+        if(!written || error)
+            std::filesystem::remove(temporary, error);
+    }
+
+    std::string BytecodeCache::filePath(std::uint64_t key) const{
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.mgbc", static_cast<unsigned long long>(key));
+        return (std::filesystem::path(_directory) / (std::to_string(LUA_VERSION_NUM) + "-" + name)).string();
+    }
+}
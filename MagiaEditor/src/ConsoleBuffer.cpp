@@ -0,0 +1,157 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#include "ConsoleBuffer.h"
+#include <algorithm>
+#include <cctype>
+
+namespace mg{
+
+    namespace {
+        bool sameChar(char a, char b, bool caseSensitive) {
+            if(caseSensitive)
+                return a == b;
+            return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+        }
+
+        std::size_t findIn(std::string_view text, std::string_view query, std::size_t from, bool caseSensitive) {
+            if(from > text.size())
+                return std::string_view::npos;
+
+            auto it = std::search(text.begin() + from, text.end(), query.begin(), query.end(),
+                                  [caseSensitive](char a, char b){ return sameChar(a, b, caseSensitive); });
+            return it == text.end() ? std::string_view::npos : static_cast<std::size_t>(it - text.begin());
+        }
+
+        std::size_t findLastIn(std::string_view text, std::string_view query, std::size_t before, bool caseSensitive) {
+            std::size_t found = std::string_view::npos;
+            std::size_t pos = 0;
+            while((pos = findIn(text, query, pos, caseSensitive)) != std::string_view::npos && pos < before) {
+                found = pos;
+                ++pos;
+            }
+            return found;
+        }
+    }
+
+    ConsoleBuffer::ConsoleBuffer(std::size_t maxLines, std::size_t maxBytes){
+        setLimits(maxLines, maxBytes);
+    }
+
+    void ConsoleBuffer::setLimits(std::size_t maxLines, std::size_t maxBytes){
+        maxLines = std::max<std::size_t>(1, maxLines);
+
+        // rebuilds the ring in order, only happens on configuration
+        std::vector<std::string> lines(maxLines);
+        std::size_t keep = std::min(_count, maxLines);
+        for(std::size_t i = 0; i < keep; ++i)
+            lines[i] = std::move(_lines[(_first + _count - keep + i) % _lines.size()]);
+
+        for(std::size_t i = 0; i + keep < _count; ++i)
+            _bytes -= _lines[(_first + i) % _lines.size()].size();
+
+        _dropped += _count - keep;
+        _lines = std::move(lines);
+        _first = 0;
+        _count = keep;
+        _maxLines = maxLines;
+        _maxBytes = maxBytes;
+        trim();
+    }
+
+    void ConsoleBuffer::append(std::string_view text){
+        while(!text.empty()) {
+            auto newline = text.find('\n');
+            auto part = text.substr(0, newline);
+
+            if(_openLine && _count > 0) {
+                auto& last = _lines[(_first + _count - 1) % _lines.size()];
+                last.append(part.data(), part.size());
+                _bytes += part.size();
+                _widest = std::max(_widest, last.size());
+            }
+            else {
+                pushLine(part);
+            }
+
+            _openLine = newline == std::string_view::npos;
+            if(_openLine)
+                break;
+            text.remove_prefix(newline + 1);
+        }
+
+        trim();
+    }
+
+    void ConsoleBuffer::clear(){
+        for(auto& line : _lines)
+            std::string().swap(line);
+
+        _dropped += _count;
+        _first = 0;
+        _count = 0;
+        _bytes = 0;
+        _widest = 0;
+        _openLine = false;
+    }
+
+    void ConsoleBuffer::pushLine(std::string_view text){
+        if(_count == _lines.size()) {
+            _bytes -= _lines[_first].size();
+            _first = (_first + 1) % _lines.size();
+            --_count;
+            ++_dropped;
+        }
+
+        // assign keeps the capacity of the recycled slot, no allocation once the ring is warm
+        auto& slot = _lines[(_first + _count) % _lines.size()];
+        slot.assign(text.data(), text.size());
+        ++_count;
+        _bytes += text.size();
+        _widest = std::max(_widest, text.size());
+    }
+
+    void ConsoleBuffer::trim(){
+        while(_bytes > _maxBytes && _count > 1) {
+            auto& oldest = _lines[_first];
+            _bytes -= oldest.size();
+            std::string().swap(oldest);
+            _first = (_first + 1) % _lines.size();
+            --_count;
+            ++_dropped;
+        }
+    }
+
+    bool ConsoleBuffer::find(std::string_view query, Match from, bool backward, bool caseSensitive, Match& found) const{
+        if(query.empty() || _count == 0)
+            return false;
+
+        from.line = std::min(from.line, _count - 1);
+
+        // the starting line is looked at twice: from the column first, the rest after wrapping
+        for(std::size_t step = 0; step <= _count; ++step) {
+            std::size_t index = backward ? (from.line + _count - step % _count) % _count
+                                         : (from.line + step) % _count;
+            std::string_view text = line(index);
+            std::size_t column;
+
+            if(!backward)
+                column = findIn(text, query, step == 0 ? from.column : 0, caseSensitive);
+            else
+                column = findLastIn(text, query, step == 0 ? from.column : text.size() + 1, caseSensitive);
+
+            if(step == _count && column != std::string_view::npos) {
+                if(!backward && column >= from.column) column = std::string_view::npos;
+                if(backward && column < from.column) column = std::string_view::npos;
+            }
+
+            if(column != std::string_view::npos) {
+                found = {index, column};
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
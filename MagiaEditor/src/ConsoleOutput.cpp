@@ -2,22 +2,259 @@
 // Created by Arthur Motelevicz on 06/12/23.
 //
 #include "ConsoleOutput.h"
+#include <QApplication>
+#include <QClipboard>
+#include <QContextMenuEvent>
+#include <QInputDialog>
+#include <QKeyEvent>
+#include <QLineEdit>
+#include <QPainter>
+#include <QScrollBar>
 
 namespace mg {
 
+    namespace {
+        constexpr int margin = 4;
+
+        // painting a huge line would cost more than the whole viewport
+        constexpr std::size_t maxPaintedBytes = 4096;
+    }
+
     ConsoleOutput::ConsoleOutput(QWidget *parent)
-    : QPlainTextEdit(parent) {}
+    : QAbstractScrollArea(parent) {
+        setFocusPolicy(Qt::StrongFocus);
+        viewport()->setCursor(Qt::IBeamCursor);
+        verticalScrollBar()->setSingleStep(1);
+    }
+
+    void ConsoleOutput::setLimits(std::size_t maxLines, std::size_t maxBytes) {
+        _buffer.setLimits(maxLines, maxBytes);
+        updateScrollBars();
+        viewport()->update();
+    }
+
+    void ConsoleOutput::append(std::string_view text) {
+        auto* bar = verticalScrollBar();
+        const bool following = bar->value() == bar->maximum();
+        const auto dropped = _buffer.droppedLines();
+
+        _buffer.append(text);
+        updateScrollBars();
+
+        // keeps the lines on screen in place while the oldest are trimmed, or follows the tail
+        if(following)
+            bar->setValue(bar->maximum());
+        else
+            bar->setValue(bar->value() - static_cast<int>(_buffer.droppedLines() - dropped));
+
+        viewport()->update();
+    }
+
+    void ConsoleOutput::appendPlainText(const QString& text) {
+        auto utf8 = text.toUtf8();
+        utf8.append('\n');
+        append({utf8.constData(), static_cast<std::size_t>(utf8.size())});
+    }
+
+    void ConsoleOutput::clear() {
+        _buffer.clear();
+        _selectionAnchor = _selectionEnd = 0;
+        _selecting = false;
+        _matchLength = 0;
+        updateScrollBars();
+        viewport()->update();
+    }
+
+    bool ConsoleOutput::findNext(const QString& text, bool backward, bool caseSensitive) {
+        if(text.isEmpty())
+            return false;
+
+        auto query = text.toUtf8();
+        const auto dropped = _buffer.droppedLines();
+
+        // continues right after (or before) the current match
+        ConsoleBuffer::Match from{static_cast<std::size_t>(verticalScrollBar()->value()), 0};
+        if(_matchLength > 0 && _matchLine >= dropped && _matchLine - dropped < _buffer.lineCount()) {
+            from.line = _matchLine - dropped;
+            from.column = backward ? _matchColumn : _matchColumn + 1;
+        }
+
+        ConsoleBuffer::Match found;
+        _query = text;
+        if(!_buffer.find({query.constData(), static_cast<std::size_t>(query.size())}, from, backward, caseSensitive, found)) {
+            _matchLength = 0;
+            viewport()->update();
+            return false;
+        }
+
+        _matchLine = dropped + found.line;
+        _matchColumn = found.column;
+        _matchLength = static_cast<std::size_t>(query.size());
+        scrollToLine(found.line);
+        viewport()->update();
+        return true;
+    }
+
+    void ConsoleOutput::copy() {
+        if(!hasSelection())
+            return;
+
+        const auto dropped = _buffer.droppedLines();
+        auto first = std::max(std::min(_selectionAnchor, _selectionEnd), dropped) - dropped;
+        auto last = std::max(_selectionAnchor, _selectionEnd) - dropped;
+
+        std::string text;
+        for(auto i = first; i <= last && i < _buffer.lineCount(); ++i) {
+            text += _buffer.line(i);
+            text += '\n';
+        }
+
+        QApplication::clipboard()->setText(QString::fromStdString(text));
+    }
+
+    void ConsoleOutput::selectAll() {
+        if(_buffer.lineCount() == 0)
+            return;
+
+        _selectionAnchor = _buffer.droppedLines();
+        _selectionEnd = _selectionAnchor + _buffer.lineCount() - 1;
+        _selecting = true;
+        viewport()->update();
+    }
+
+    void ConsoleOutput::paintEvent(QPaintEvent *) {
+        QPainter painter(viewport());
+        const auto metrics = viewport()->fontMetrics();
+        const int height = lineHeight();
+        const int x = margin - horizontalScrollBar()->value();
+        const int width = viewport()->width();
+
+        const auto dropped = _buffer.droppedLines();
+        const auto first = static_cast<std::size_t>(verticalScrollBar()->value());
+        const auto last = std::min(_buffer.lineCount(), first + visibleLines() + 1);
+        const auto selectionFirst = std::min(_selectionAnchor, _selectionEnd);
+        const auto selectionLast = std::max(_selectionAnchor, _selectionEnd);
+
+        for(auto i = first; i < last; ++i) {
+            const int y = margin + static_cast<int>(i - first) * height;
+            const auto& line = _buffer.line(i);
+            const auto id = dropped + i;
+            const bool selected = hasSelection() && id >= selectionFirst && id <= selectionLast;
+
+            if(selected)
+                painter.fillRect(0, y, width, height, palette().highlight());
+
+            if(_matchLength > 0 && id == _matchLine && _matchColumn < line.size()) {
+                int start = metrics.horizontalAdvance(QString::fromUtf8(line.data(), static_cast<int>(_matchColumn)));
+                int length = metrics.horizontalAdvance(QString::fromUtf8(line.data() + _matchColumn,
+                                                                         static_cast<int>(std::min(_matchLength, line.size() - _matchColumn))));
+                painter.fillRect(x + start, y, length, height, QColor(255, 200, 0, 140));
+            }
+
+            painter.setPen(selected ? palette().color(QPalette::HighlightedText) : palette().color(QPalette::Text));
+            painter.drawText(x, y + metrics.ascent(),
+                             QString::fromUtf8(line.data(), static_cast<int>(std::min(line.size(), maxPaintedBytes))));
+        }
+    }
+
+    void ConsoleOutput::resizeEvent(QResizeEvent *event) {
+        QAbstractScrollArea::resizeEvent(event);
+        updateScrollBars();
+    }
 
     void ConsoleOutput::contextMenuEvent(QContextMenuEvent *event) {
-        QMenu *menu = createStandardContextMenu();
-        menu->addSeparator();
+        QMenu menu(this);
+
+        auto* copyAction = menu.addAction("Copy", this, &ConsoleOutput::copy);
+        copyAction->setEnabled(hasSelection());
+        menu.addAction("Select All", this, &ConsoleOutput::selectAll);
+        menu.addAction("Find...", this, &ConsoleOutput::askForQuery);
+        menu.addSeparator();
+        menu.addAction("Clear", this, &ConsoleOutput::clear);
+
+        menu.exec(event->globalPos());
+    }
+
+    void ConsoleOutput::mousePressEvent(QMouseEvent *event) {
+        if(event->button() != Qt::LeftButton)
+            return QAbstractScrollArea::mousePressEvent(event);
+
+        _selectionAnchor = _selectionEnd = lineIdAt(event->position().toPoint().y());
+        _selecting = true;
+        viewport()->update();
+    }
+
+    void ConsoleOutput::mouseMoveEvent(QMouseEvent *event) {
+        if(!(event->buttons() & Qt::LeftButton))
+            return QAbstractScrollArea::mouseMoveEvent(event);
+
+        _selectionEnd = lineIdAt(event->position().toPoint().y());
+        viewport()->update();
+    }
 
-        auto *clearAction = new QAction("Clear", this);
-        connect(clearAction, &QAction::triggered, this, &ConsoleOutput::clear);
-        menu->addAction(clearAction);
+    void ConsoleOutput::keyPressEvent(QKeyEvent *event) {
+        if(event->matches(QKeySequence::Copy))
+            return copy();
+        if(event->matches(QKeySequence::SelectAll))
+            return selectAll();
+        if(event->matches(QKeySequence::Find))
+            return askForQuery();
+        if(event->matches(QKeySequence::FindNext)) {
+            findNext(_query);
+            return;
+        }
+        if(event->matches(QKeySequence::FindPrevious)) {
+            findNext(_query, true);
+            return;
+        }
+
+        QAbstractScrollArea::keyPressEvent(event);
+    }
+
+    void ConsoleOutput::updateScrollBars() {
+        const auto lines = static_cast<int>(_buffer.lineCount());
+        const int page = visibleLines();
+        verticalScrollBar()->setPageStep(page);
+        verticalScrollBar()->setRange(0, std::max(0, lines - page));
+
+        // monospaced console, the widest line in characters is enough
+        const int charWidth = viewport()->fontMetrics().horizontalAdvance(QLatin1Char('M'));
+        const auto widest = static_cast<int>(std::min(_buffer.widestLine(), maxPaintedBytes)) * charWidth + 2 * margin;
+        horizontalScrollBar()->setPageStep(viewport()->width());
+        horizontalScrollBar()->setRange(0, std::max(0, widest - viewport()->width()));
+    }
+
+    void ConsoleOutput::scrollToLine(std::size_t line) {
+        auto* bar = verticalScrollBar();
+        const auto first = static_cast<std::size_t>(bar->value());
+        if(line < first || line >= first + visibleLines())
+            bar->setValue(static_cast<int>(line) - visibleLines() / 2);
+    }
+
+    void ConsoleOutput::askForQuery() {
+        bool ok = false;
+        auto query = QInputDialog::getText(this, "Find", "Find in console:", QLineEdit::Normal, _query, &ok);
+        if(ok)
+            findNext(query);
+    }
+
+    int ConsoleOutput::lineHeight() const {
+        return std::max(1, viewport()->fontMetrics().lineSpacing());
+    }
+
+    int ConsoleOutput::visibleLines() const {
+        return std::max(1, (viewport()->height() - 2 * margin) / lineHeight());
+    }
+
+    std::uint64_t ConsoleOutput::lineIdAt(int y) const {
+        auto index = static_cast<std::size_t>(verticalScrollBar()->value() + std::max(0, y - margin) / lineHeight());
+        if(_buffer.lineCount() > 0)
+            index = std::min(index, _buffer.lineCount() - 1);
+        return _buffer.droppedLines() + index;
+    }
 
-        menu->exec(event->globalPos());
-        delete menu;
+    bool ConsoleOutput::hasSelection() const {
+        return _selecting && _buffer.lineCount() > 0;
     }
 
 }
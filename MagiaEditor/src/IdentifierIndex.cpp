@@ -0,0 +1,221 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#include "IdentifierIndex.h"
+#include <algorithm>
+
+namespace mg{
+
+    namespace {
+        // bytes of UTF-8 sequences count as identifier characters, as in most lexers
+        bool isWordChar(unsigned char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+        }
+
+        bool startsWith(std::string_view word, std::string_view prefix) {
+            return word.size() >= prefix.size() && word.compare(0, prefix.size(), prefix) == 0;
+        }
+
+        // Smallest string greater than every word starting with prefix, empty when there is none
+        std::string prefixEnd(std::string_view prefix) {
+            std::string end(prefix);
+            while(!end.empty() && static_cast<unsigned char>(end.back()) == 0xFF)
+                end.pop_back();
+            if(!end.empty())
+                end.back() = static_cast<char>(static_cast<unsigned char>(end.back()) + 1);
+            return end;
+        }
+    }
+
+    void IdentifierIndex::reset(int lineCount) {
+        _words.clear();
+        _lines = std::vector<LineInfo>(std::max(1, lineCount));
+        _dirtyFrom = -1;
+        _dirtyTo = -1;
+        markDirty(0, static_cast<int>(_lines.size()) - 1);
+    }
+
+    void IdentifierIndex::linesInserted(int line, int count) {
+        if(_lines.empty())
+            _lines.resize(1);
+
+        line = std::clamp(line, 0, static_cast<int>(_lines.size()) - 1);
+
+        if(count > 0) {
+            _lines.insert(_lines.begin() + line + 1, count, LineInfo{});
+            if(_dirtyFrom > line) _dirtyFrom += count;
+            if(_dirtyTo > line) _dirtyTo += count;
+        }
+
+        markDirty(line, line + std::max(0, count));
+    }
+
+    void IdentifierIndex::linesRemoved(int line, int count) {
+        if(_lines.empty())
+            _lines.resize(1);
+
+        line = std::clamp(line, 0, static_cast<int>(_lines.size()) - 1);
+        count = std::min(count, static_cast<int>(_lines.size()) - 1 - line);
+
+        if(count > 0) {
+            for(int i = line + 1; i <= line + count; ++i)
+                clearLine(_lines[i]);
+
+            _lines.erase(_lines.begin() + line + 1, _lines.begin() + line + 1 + count);
+            if(_dirtyFrom > line) _dirtyFrom = std::max(line, _dirtyFrom - count);
+            if(_dirtyTo > line) _dirtyTo = std::max(line, _dirtyTo - count);
+        }
+
+        markDirty(line, line);
+    }
+
+    void IdentifierIndex::linesRestyled(int firstLine, int lastLine) {
+        if(_lines.empty())
+            return;
+
+        markDirty(std::max(0, firstLine), std::min(lastLine, static_cast<int>(_lines.size()) - 1));
+    }
+
+    void IdentifierIndex::setIgnoredStyles(const std::bitset<256>& styles) {
+        if(styles == _ignoredStyles)
+            return;
+
+        _ignoredStyles = styles;
+        if(!_lines.empty())
+            markDirty(0, static_cast<int>(_lines.size()) - 1);
+    }
+
+    void IdentifierIndex::markDirty(int from, int to) {
+        if(from > to)
+            return;
+
+        for(int i = from; i <= to; ++i)
+            _lines[i].dirty = true;
+
+        _dirtyFrom = _dirtyFrom < 0 ? from : std::min(_dirtyFrom, from);
+        _dirtyTo = std::max(_dirtyTo, to);
+    }
+
+    void IdentifierIndex::clearLine(LineInfo& info) {
+        for(auto word : info.words)
+            if(--word->second == 0)
+                _words.erase(word);
+
+        info.words.clear();
+    }
+
+    bool IdentifierIndex::refresh(const LineReader& readLine, const StyleReader& styleAt, int maxLines) {
+        if(_dirtyFrom < 0)
+            return true;
+
+        const int lastLine = std::min(_dirtyTo, static_cast<int>(_lines.size()) - 1);
+        int line = _dirtyFrom;
+        // bounded in lines rather than in dirty lines, the caller styles exactly this slice
+        const int sliceEnd = maxLines < lastLine - line + 1 ? line + maxLines - 1 : lastLine;
+        for(; line <= sliceEnd; ++line) {
+            if(_lines[line].dirty)
+                scanLine(line, readLine(line), styleAt);
+        }
+
+        // the next dirty line, if any, is where the next refresh starts
+        while(line <= lastLine && !_lines[line].dirty)
+            ++line;
+
+        if(line > lastLine) {
+            _dirtyFrom = -1;
+            _dirtyTo = -1;
+            return true;
+        }
+
+        _dirtyFrom = line;
+        return false;
+    }
+
+    void IdentifierIndex::scanLine(int line, std::string_view text, const StyleReader& styleAt) {
+        auto& info = _lines[line];
+        clearLine(info);
+        info.dirty = false;
+
+        std::size_t i = 0;
+        while(i < text.size()) {
+            if(!isWordChar(static_cast<unsigned char>(text[i]))) {
+                ++i;
+                continue;
+            }
+
+            std::size_t start = i;
+            while(i < text.size() && isWordChar(static_cast<unsigned char>(text[i])))
+                ++i;
+
+            // numbers are not identifiers, whatever the lexer says
+            if(text[start] >= '0' && text[start] <= '9')
+                continue;
+
+            if(_ignoredStyles.any() && _ignoredStyles.test(static_cast<unsigned char>(styleAt(line, static_cast<int>(start)))))
+                continue;
+
+            std::string_view word = text.substr(start, i - start);
+            auto it = _words.find(word);
+            if(it == _words.end())
+                it = _words.emplace(std::string(word), 0).first;
+
+            ++it->second;
+            info.words.push_back(it);
+        }
+    }
+
+    std::vector<std::string> IdentifierIndex::complete(std::string_view prefix,
+                                                       const std::vector<std::string>& extra,
+                                                       std::size_t limit) const {
+        struct Candidate {
+            std::string_view word;
+            int score;
+        };
+
+        std::vector<Candidate> candidates;
+
+        auto extraIt = std::lower_bound(extra.begin(), extra.end(), prefix,
+                                        [](const std::string& word, std::string_view value){ return std::string_view(word) < value; });
+
+        const std::string end = prefixEnd(prefix);
+        const auto last = end.empty() ? _words.end() : _words.lower_bound(end);
+
+        // both ranges are sorted, walk them together so a word in both is listed once
+        for(auto it = _words.lower_bound(prefix); it != last; ++it) {
+            while(extraIt != extra.end() && startsWith(*extraIt, prefix) && *extraIt < it->first)
+                candidates.push_back({*extraIt++, 1});
+
+            bool known = extraIt != extra.end() && *extraIt == it->first;
+            if(known)
+                ++extraIt;
+
+            // the word being typed counts itself once
+            if(it->first == prefix && it->second <= 1 && !known)
+                continue;
+
+            candidates.push_back({it->first, it->second + (known ? 1 : 0)});
+        }
+
+        for(; extraIt != extra.end() && startsWith(*extraIt, prefix); ++extraIt)
+            candidates.push_back({*extraIt, 1});
+
+        auto better = [](const Candidate& a, const Candidate& b){
+            if(a.score != b.score)
+                return a.score > b.score;
+            if(a.word.size() != b.word.size())
+                return a.word.size() < b.word.size();
+            return a.word < b.word;
+        };
+
+        std::size_t count = std::min(limit, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + static_cast<std::ptrdiff_t>(count), candidates.end(), better);
+
+        std::vector<std::string> completions;
+        completions.reserve(count);
+        for(std::size_t i = 0; i < count; ++i)
+            completions.emplace_back(candidates[i].word);
+
+        return completions;
+    }
+}
@@ -0,0 +1,362 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#include "LuaSyntaxValidator.h"
+#include "lua.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <unordered_set>
+
+namespace mg{
+
+    namespace {
+        // Level of the long bracket ("[[", "[==[", ...) opening at i, -1 if there is none
+        int longBracketLevel(std::string_view text, std::size_t i) {
+            if(i >= text.size() || text[i] != '[')
+                return -1;
+
+            std::size_t j = i + 1;
+            int level = 0;
+            while(j < text.size() && text[j] == '=') {
+                ++level;
+                ++j;
+            }
+
+            return (j < text.size() && text[j] == '[') ? level : -1;
+        }
+
+        // Position right after the closing long bracket of the given level, npos if not on this line
+        std::size_t findLongBracketEnd(std::string_view text, std::size_t i, int level) {
+            while((i = text.find(']', i)) != std::string_view::npos) {
+                std::size_t j = i + 1;
+                int closing = 0;
+                while(j < text.size() && text[j] == '=') {
+                    ++closing;
+                    ++j;
+                }
+
+                if(closing == level && j < text.size() && text[j] == ']')
+                    return j + 1;
+
+                ++i;
+            }
+
+            return std::string_view::npos;
+        }
+
+        bool isIdentifierStart(char c) {
+            return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        bool isIdentifierChar(char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        std::string_view leadingWord(std::string_view text) {
+            std::size_t end = 0;
+            while(end < text.size() && isIdentifierChar(text[end]))
+                ++end;
+            return text.substr(0, end);
+        }
+
+        // Chunk results carry lines relative to the chunk, including the "(to close 'x' at line N)" hints
+        std::string shiftLineReferences(const std::string& message, int offset) {
+            static const std::string token = "at line ";
+            std::string shifted;
+            std::size_t last = 0;
+            std::size_t pos = 0;
+
+            while((pos = message.find(token, last)) != std::string::npos) {
+                std::size_t digits = pos + token.size();
+                std::size_t end = digits;
+                while(end < message.size() && std::isdigit(static_cast<unsigned char>(message[end])))
+                    ++end;
+
+                shifted.append(message, last, digits - last);
+                if(end > digits)
+                    shifted += std::to_string(std::atoi(message.c_str() + digits) + offset);
+                last = end;
+            }
+
+            shifted.append(message, last, std::string::npos);
+            return shifted;
+        }
+    }
+
+    void LuaSyntaxValidator::reset(int lineCount) {
+        _lines.assign(std::max(1, lineCount), LineInfo{});
+        _chunks.clear();
+        _cache.clear();
+        _dirtyFrom = _dirtyTo = -1;
+        markDirty(0, static_cast<int>(_lines.size()) - 1);
+    }
+
+    void LuaSyntaxValidator::linesInserted(int line, int count) {
+        if(_lines.empty())
+            _lines.resize(1);
+
+        line = std::clamp(line, 0, static_cast<int>(_lines.size()) - 1);
+
+        if(count > 0) {
+            _lines.insert(_lines.begin() + line + 1, count, LineInfo{});
+            if(_dirtyFrom > line) _dirtyFrom += count;
+            if(_dirtyTo > line) _dirtyTo += count;
+        }
+
+        markDirty(line, line + std::max(0, count));
+    }
+
+    void LuaSyntaxValidator::linesRemoved(int line, int count) {
+        if(_lines.empty())
+            _lines.resize(1);
+
+        line = std::clamp(line, 0, static_cast<int>(_lines.size()) - 1);
+        count = std::min(count, static_cast<int>(_lines.size()) - 1 - line);
+
+        if(count > 0) {
+            _lines.erase(_lines.begin() + line + 1, _lines.begin() + line + 1 + count);
+            if(_dirtyFrom > line) _dirtyFrom = std::max(line, _dirtyFrom - count);
+            if(_dirtyTo > line) _dirtyTo = std::max(line, _dirtyTo - count);
+        }
+
+        markDirty(line, line);
+    }
+
+    void LuaSyntaxValidator::markDirty(int from, int to) {
+        to = std::min(to, static_cast<int>(_lines.size()) - 1);
+        for(int i = from; i <= to; ++i) {
+            _lines[i].dirty = true;
+            _lines[i].glued = false;
+        }
+
+        _dirtyFrom = _dirtyFrom < 0 ? from : std::min(_dirtyFrom, from);
+        _dirtyTo = std::max(_dirtyTo, to);
+    }
+
+    std::vector<LuaSyntaxValidator::Job> LuaSyntaxValidator::collectJobs(const LineReader& readLine,
+                                                                         const RangeReader& readRange) {
+        std::vector<Job> jobs;
+        const int lineCount = static_cast<int>(_lines.size());
+
+        // Rescan from the first edited line until the lexical state converges again
+        if(_dirtyFrom >= 0) {
+            ScanState state = _dirtyFrom > 0 ? _lines[_dirtyFrom - 1].state : ScanState{};
+            for(int i = _dirtyFrom; i < lineCount; ++i) {
+                auto& info = _lines[i];
+                auto text = readLine(i);
+                bool startsChunk = i == 0 || (state.isTopLevel() && !info.glued && startsStatement(text));
+                ScanState next = scanLine(text, state);
+                bool changed = next != info.state || startsChunk != info.startsChunk;
+
+                info.state = next;
+                info.startsChunk = startsChunk;
+                state = next;
+
+                if(i > _dirtyTo && !changed)
+                    break;
+            }
+        }
+
+        _chunks.clear();
+        for(int i = 0; i < lineCount; ++i) {
+            if(i != 0 && !_lines[i].startsChunk)
+                continue;
+            if(!_chunks.empty())
+                _chunks.back().lastLine = i - 1;
+            _chunks.push_back({i, lineCount - 1});
+        }
+
+        std::unordered_set<std::size_t> live;
+        std::unordered_set<std::size_t> queued;
+        for(const auto& chunk : _chunks) {
+            auto& head = _lines[chunk.firstLine];
+            const int count = chunk.lastLine - chunk.firstLine + 1;
+            bool dirty = head.chunkLines != count;
+
+            for(int i = chunk.firstLine; i <= chunk.lastLine; ++i) {
+                dirty = dirty || _lines[i].dirty;
+                _lines[i].dirty = false;
+                if(i != chunk.firstLine) {
+                    _lines[i].chunkLines = 0;
+                    _lines[i].chunkHash = 0;
+                }
+            }
+
+            std::string_view text;
+            if(dirty) {
+                text = readRange(chunk.firstLine, chunk.lastLine);
+                head.chunkHash = std::hash<std::string_view>{}(text);
+                head.chunkLines = count;
+            }
+
+            // unchanged chunks may still miss a result when their request was superseded
+            if(_cache.find(head.chunkHash) == _cache.end() && queued.insert(head.chunkHash).second) {
+                if(!dirty)
+                    text = readRange(chunk.firstLine, chunk.lastLine);
+                jobs.push_back({head.chunkHash, std::string(text)});
+            }
+
+            live.insert(head.chunkHash);
+        }
+
+        // Results of chunks that no longer exist in the document are useless
+        for(auto it = _cache.begin(); it != _cache.end();) {
+            if(live.count(it->first) == 0)
+                it = _cache.erase(it);
+            else
+                ++it;
+        }
+
+        _dirtyFrom = _dirtyTo = -1;
+        return jobs;
+    }
+
+    void LuaSyntaxValidator::storeResults(const std::vector<ChunkResult>& results) {
+        for(const auto& result : results)
+            _cache[result.hash] = result;
+    }
+
+    bool LuaSyntaxValidator::resolve(const std::string& chunkName, std::string& errorMessage) {
+        errorMessage.clear();
+
+        for(std::size_t c = 0; c < _chunks.size(); ++c) {
+            const auto& chunk = _chunks[c];
+            auto it = _cache.find(_lines[chunk.firstLine].chunkHash);
+            if(it == _cache.end())
+                return false;
+
+            const auto& result = it->second;
+            if(result.errorLine < 0)
+                continue;
+
+            // The statement goes on in the next chunk (e.g. "x = a +" followed by "local y"),
+            // merge both so the error is reported where a full parse would report it
+            if(c + 1 < _chunks.size() && result.message.find("<eof>") != std::string::npos) {
+                int next = _chunks[c + 1].firstLine;
+                markDirty(next, next);
+                _lines[next].glued = true;
+                return false;
+            }
+
+            errorMessage = "[string \"" + chunkName + "\"]:" +
+                           std::to_string(chunk.firstLine + result.errorLine) + ":" +
+                           shiftLineReferences(result.message, chunk.firstLine);
+            return true;
+        }
+
+        return true;
+    }
+
+    LuaSyntaxValidator::ChunkResult LuaSyntaxValidator::compile(lua_State* L, const Job& job, const std::string& chunkName) {
+        ChunkResult result;
+        result.hash = job.hash;
+
+        if(luaL_loadbuffer(L, job.text.data(), job.text.size(), chunkName.c_str()) != LUA_OK) {
+            const char* error = lua_tostring(L, -1);
+            std::string message = error ? error : "";
+
+            // "[string "name"]:12: msg" -> line 12, ": msg" is kept so it can be prefixed again
+            auto pos = message.find("]:");
+            auto end = pos == std::string::npos ? pos : message.find(':', pos + 2);
+            if(end != std::string::npos) {
+                result.errorLine = std::atoi(message.c_str() + pos + 2);
+                result.message = message.substr(end + 1);
+            }
+            else {
+                result.errorLine = 1;
+                result.message = " " + message;
+            }
+        }
+
+        lua_settop(L, 0);
+        return result;
+    }
+
+    LuaSyntaxValidator::ScanState LuaSyntaxValidator::scanLine(std::string_view text, ScanState state) {
+        const std::size_t size = text.size();
+        std::size_t i = 0;
+
+        if(state.longLevel >= 0) {
+            i = findLongBracketEnd(text, 0, state.longLevel);
+            if(i == std::string_view::npos)
+                return state;
+            state.longLevel = -1;
+        }
+
+        while(i < size) {
+            const char c = text[i];
+
+            if(c == '-' && i + 1 < size && text[i + 1] == '-') {
+                int level = longBracketLevel(text, i + 2);
+                if(level < 0)
+                    break; // line comment
+
+                i = findLongBracketEnd(text, i + level + 4, level);
+                if(i == std::string_view::npos) {
+                    state.longLevel = level;
+                    return state;
+                }
+                continue;
+            }
+
+            if(c == '[') {
+                int level = longBracketLevel(text, i);
+                if(level >= 0) {
+                    i = findLongBracketEnd(text, i + level + 2, level);
+                    if(i == std::string_view::npos) {
+                        state.longLevel = level;
+                        return state;
+                    }
+                    continue;
+                }
+            }
+
+            if(c == '"' || c == '\'') {
+                ++i;
+                while(i < size && text[i] != c) {
+                    if(text[i] == '\\')
+                        ++i;
+                    ++i;
+                }
+                ++i;
+                continue;
+            }
+
+            if(isIdentifierStart(c)) {
+                std::size_t start = i;
+                while(i < size && isIdentifierChar(text[i]))
+                    ++i;
+
+                auto word = text.substr(start, i - start);
+                if(word == "function" || word == "if" || word == "do" || word == "repeat")
+                    ++state.blocks;
+                else if(word == "end" || word == "until")
+                    state.blocks = std::max(0, state.blocks - 1);
+                continue;
+            }
+
+            if(std::isdigit(static_cast<unsigned char>(c))) {
+                while(i < size && (isIdentifierChar(text[i]) || text[i] == '.'))
+                    ++i;
+                continue;
+            }
+
+            if(c == '(' || c == '{' || c == '[')
+                ++state.brackets;
+            else if(c == ')' || c == '}' || c == ']')
+                state.brackets = std::max(0, state.brackets - 1);
+
+            ++i;
+        }
+
+        return state;
+    }
+
+    bool LuaSyntaxValidator::startsStatement(std::string_view text) {
+        auto word = leadingWord(text);
+        return word == "function" || word == "local" || word == "if" || word == "for" ||
+               word == "while" || word == "repeat" || word == "do" || word == "goto";
+    }
+}
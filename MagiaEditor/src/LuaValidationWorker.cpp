@@ -0,0 +1,110 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#include "LuaValidationWorker.h"
+#include "BytecodeCache.h"
+#include "lua.hpp"
+
+namespace mg{
+
+    LuaValidationWorker::LuaValidationWorker(const ResultCallback& cb):
+    _callback(cb),
+    _thread([this](){ run(); }){}
+
+    LuaValidationWorker::~LuaValidationWorker(){
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+            _pending.reset();
+            _confirmation.reset();
+        }
+
+        // makes a running request stop at the next chunk
+        _latest = 0;
+        _wake.notify_all();
+
+        if(_thread.joinable())
+            _thread.join();
+    }
+
+    void LuaValidationWorker::submit(std::uint64_t generation,
+                                     std::vector<LuaSyntaxValidator::Job> jobs,
+                                     const std::string& chunkName){
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _pending = Request{generation, std::move(jobs), chunkName};
+            _latest = generation;
+        }
+
+        _wake.notify_one();
+    }
+
+    void LuaValidationWorker::confirm(std::uint64_t version, std::string script, const std::string& chunkName){
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _confirmation = Confirmation{version, std::move(script), chunkName};
+        }
+
+        _wake.notify_one();
+    }
+
+    void LuaValidationWorker::run(){
+        _lua = luaL_newstate();
+
+        while(true) {
+            Request request;
+            std::optional<Confirmation> confirmation;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wake.wait(lock, [this](){ return _stop || _pending.has_value() || _confirmation.has_value(); });
+
+                if(_stop)
+                    break;
+
+                // validation comes first, the confirmation waits until the document settles
+                if(!_pending) {
+                    confirmation = std::move(_confirmation);
+                    _confirmation.reset();
+                }
+                else {
+                    request = std::move(*_pending);
+                    _pending.reset();
+                }
+            }
+
+            if(confirmation) {
+                // a clean script is stored as bytecode by the same compilation, only an error
+                // is compiled again to read its message
+                LuaSyntaxValidator::ChunkResult result;
+                if(!BytecodeCache::instance().prime(_lua, confirmation->script, confirmation->chunkName))
+                    result = LuaSyntaxValidator::compile(_lua, {0, std::move(confirmation->script)}, confirmation->chunkName);
+
+                if(_confirmCallback)
+                    _confirmCallback(confirmation->version, result);
+                continue;
+            }
+
+            std::vector<LuaSyntaxValidator::ChunkResult> results;
+            results.reserve(request.jobs.size());
+
+            for(const auto& job : request.jobs) {
+                if(_latest != request.generation)
+                    break;
+                results.push_back(LuaSyntaxValidator::compile(_lua, job, request.chunkName));
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(_stop)
+                    break;
+            }
+
+            if(_callback && !results.empty())
+                _callback(request.generation, results);
+        }
+
+        lua_close(_lua);
+        _lua = nullptr;
+    }
+}
@@ -6,61 +6,173 @@
 #include "lua.hpp"
 #include <iostream>
 #include <sol/sol.hpp>
-#include <thread>
 
 namespace mg{
 
-    void luaDebugHook(lua_State *L, lua_Debug *ar) {
-        lua_getinfo(L, "nSl", ar);
-        int currentLine = ar->currentline;
-        std::string currentFunction = ar->name ? ar->name : "global";
-//        std::cout << "Current Line: " << currentLine << std::endl;
-//        std::cout << "Current function: " << currentFunction << std::endl;
-
-        if(MagiaDebugger::state == MagiaDebugger::DebuggerState::Step_over){
-            MagiaDebugger::state = MagiaDebugger::DebuggerState::Paused;
-            if(MagiaDebugger::pauseCallback)
-                MagiaDebugger::pauseCallback(L, ar, currentLine - 1, currentFunction);
+    // Evaluates "return <condition>" with the locals of the paused frame over the globals.
+    // A condition that fails to compile or run pauses, so the user notices it.
+    bool evaluateCondition(lua_State *L, lua_Debug *ar, const std::string& condition) {
+        std::string code = "return " + condition;
+        if(luaL_loadbuffer(L, code.data(), code.size(), "=condition") != LUA_OK) {
+            lua_pop(L, 1);
+            return true;
         }
 
-        while(MagiaDebugger::state == MagiaDebugger::DebuggerState::Paused &&
-                MagiaDebugger::state != MagiaDebugger::DebuggerState::Stopping) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        lua_newtable(L);
+        const char* name;
+        for(int i = 1; (name = lua_getlocal(L, ar, i)) != nullptr; ++i) {
+            // temporaries are named "(temporary)", "(for state)"...
+            if(name[0] == '(')
+                lua_pop(L, 1);
+            else
+                lua_setfield(L, -2, name);
         }
 
-        bool isBreakPoint = MagiaDebugger::breakpoints.find(ar->currentline) != MagiaDebugger::breakpoints.end();
+        lua_newtable(L);
+        lua_pushglobaltable(L);
+        lua_setfield(L, -2, "__index");
+        lua_setmetatable(L, -2);
+
+        // _ENV is the first upvalue of a loaded chunk
+        if(!lua_setupvalue(L, -2, 1))
+            lua_pop(L, 1);
+
+        bool result = true;
+        if(lua_pcall(L, 0, 1, 0) == LUA_OK)
+            result = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+
+        return result;
+    }
+
+    void luaDebugHook(lua_State *L, lua_Debug *ar) {
+        auto* session = MagiaDebugger::session(L);
+        if(!session)
+            return;
+
+        // the state or the breakpoints may want another mask since the last event
+        session->applyHook(L);
+        auto state = session->state();
 
-        if(isBreakPoint && MagiaDebugger::state == MagiaDebugger::DebuggerState::Debugging){
-            MagiaDebugger::state = MagiaDebugger::DebuggerState::Paused;
-            if(MagiaDebugger::pauseCallback)
-                MagiaDebugger::pauseCallback(L, ar, currentLine - 1, currentFunction);
+        // count/call/return events are only armed to notice changes and interrupt the script
+        if(ar->event != LUA_HOOKLINE || state == MagiaDebugger::DebuggerState::Stopping) {
+            if(state == MagiaDebugger::DebuggerState::Stopping)
+                luaL_error(L, "Script interrupted!");
+            return;
         }
 
-        while(MagiaDebugger::state == MagiaDebugger::DebuggerState::Paused &&
-              MagiaDebugger::state != MagiaDebugger::DebuggerState::Stopping) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto& breakpoints = session->breakpoints();
+
+        // currentline is already filled for line events, nothing else is needed to skip the line
+        bool mayBreak = state == MagiaDebugger::DebuggerState::Debugging &&
+                        breakpoints.mayBreak(ar->currentline);
+
+        if(state != MagiaDebugger::DebuggerState::Step_over && !mayBreak)
+            return;
+
+        lua_getinfo(L, mayBreak ? "nS" : "n", ar);
+
+        if(state != MagiaDebugger::DebuggerState::Step_over) {
+            BreakpointIndex::Breakpoint breakpoint;
+            std::string source = ar->source ? ar->source : "";
+
+            if(!breakpoints.find(source, ar->currentline, breakpoint))
+                return;
+
+            if(!breakpoint.condition.empty() && !evaluateCondition(L, ar, breakpoint.condition))
+                return;
+
+            if(!breakpoints.hit(source, ar->currentline))
+                return;
         }
+        int currentLine = ar->currentline;
+        std::string currentFunction = ar->name ? ar->name : "global";
 
-        if (MagiaDebugger::state == MagiaDebugger::DebuggerState::Stopping) {
+        session->setState(MagiaDebugger::DebuggerState::Paused);
+        if(session->pauseCallback())
+            session->pauseCallback()(L, ar, currentLine - 1, currentFunction);
+
+        session->waitWhilePaused();
+
+        if (session->state() == MagiaDebugger::DebuggerState::Stopping) {
             luaL_error(L, "Script interrupted!");
         }
+        session->applyHook(L);
+    }
+
+    void MagiaDebugger::setHook(const std::shared_ptr<sol::state>& sol, DebugSession* session){
+        lua_State* L = sol->lua_state();
+        *static_cast<DebugSession**>(lua_getextraspace(L)) = session;
+    }
+
+    DebugSession* MagiaDebugger::session(lua_State* L){
+        return *static_cast<DebugSession**>(lua_getextraspace(L));
+    }
+
+    void DebugSession::attach(lua_State* L){
+        applyHook(L);
     }
 
-    void MagiaDebugger::setHook(const std::shared_ptr<sol::state>& sol){
-        lua_sethook(sol->lua_state(),luaDebugHook, LUA_MASKLINE, 0);
-//        lua_sethook(sol->lua_state(), luaDebugHook, LUA_MASKLINE | LUA_MASKCALL | LUA_MASKRET, 0);
+    void DebugSession::detach(lua_State* L){
+        lua_sethook(L, nullptr, 0, 0);
     }
 
-    void MagiaDebugger::appendBreakpoint(int line){
-        breakpoints.insert(line + 1);
+    void DebugSession::applyHook(lua_State* L){
+        // line events while debugging with breakpoints or a pending step, every instruction
+        // once a stop is requested, and a periodic count to notice either otherwise
+        int mask = LUA_MASKCOUNT;
+        int count = CheckInterval;
+        switch (_state.load()) {
+            case DebuggerState::Stopping:
+                mask = LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT;
+                count = 1;
+                break;
+            case DebuggerState::Debugging:
+                if(!_breakpoints.empty())
+                    mask |= LUA_MASKLINE;
+                break;
+            case DebuggerState::Paused:
+            case DebuggerState::Step_over:
+                mask |= LUA_MASKLINE;
+                break;
+            case DebuggerState::Coding:
+            case DebuggerState::Running:
+                break;
+        }
+
+        if(lua_gethook(L) != luaDebugHook || lua_gethookmask(L) != mask || lua_gethookcount(L) != count)
+            lua_sethook(L, luaDebugHook, mask, count);
     }
 
-    void MagiaDebugger::removeBreakpoint(int line){
-        breakpoints.erase(line + 1);
+    void DebugSession::appendBreakpoint(const std::string& source, int line,
+                                        const std::string& condition, int hitTarget){
+        _breakpoints.set(source, line + 1, condition, hitTarget);
+    }
+
+    void DebugSession::removeBreakpoint(const std::string& source, int line){
+        _breakpoints.remove(source, line + 1);
+    }
+
+    void DebugSession::setPauseCallback(const PauseCallback& cb){
+        _pauseCallback = cb;
+    }
+
+    void DebugSession::setState(DebuggerState newState){
+        {
+            std::lock_guard<std::mutex> lock(_pauseMutex);
+            _state = newState;
+        }
+
+        // the run is over, the hook no longer reads the breakpoint snapshots
+        if(newState == DebuggerState::Coding)
+            _breakpoints.finishRun();
+
+        _pauseCondition.notify_all();
     }
 
-    void MagiaDebugger::setPauseCallback(const PauseCallback& cb){
-        pauseCallback = cb;
+    void DebugSession::waitWhilePaused(){
+        std::unique_lock<std::mutex> lock(_pauseMutex);
+        _pauseCondition.wait(lock, [this](){ return _state != DebuggerState::Paused; });
     }
 
 }
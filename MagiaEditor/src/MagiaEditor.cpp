@@ -10,8 +10,13 @@
 #include "Lexilla.h"
 #include <sol/sol.hpp>
 #include <QTimer>
+#include <QInputDialog>
 #include <regex>
+#include <algorithm>
+#include <cctype>
 #include "MagiaDebugger.h"
+#include "LuaValidationWorker.h"
+#include "BytecodeCache.h"
 #include "lua.hpp"
 
 namespace mg{
@@ -43,6 +48,9 @@ namespace mg{
         this->autoCSetMaxWidth(50);
         this->autoCSetMaxHeight(10);
 
+        // completions come ranked, Scintilla must not sort them again
+        send(SCI_AUTOCSETORDER, SC_ORDER_CUSTOM);
+
         // Conectar sinais e slots para eventos de digitação
         connect(this, &ScintillaEdit::charAdded, this, &MagiaEditor::onCharAdded);
         connect(this, &ScintillaEdit::modified, this, &MagiaEditor::scriptModified);
@@ -54,19 +62,49 @@ namespace mg{
         _lua = std::make_shared<sol::state>();
         _lua->open_libraries(sol::lib::base, sol::lib::math, sol::lib::os);
 
-        MagiaDebugger::setHook(_lua);
+        MagiaDebugger::setHook(_lua, &_debugSession);
 
         // syntax timer setup
         _syntaxTimer = new QTimer(this);
         _syntaxTimer->setInterval(800); // 1000 ms = 1 segundo
+        _syntaxTimer->setSingleShot(true);
         connect(_syntaxTimer, &QTimer::timeout, this, &MagiaEditor::syntaxTimerTimeout);
 
+        // the whole document is parsed once the chunks report it clean and it stays idle
+        _confirmTimer = new QTimer(this);
+        _confirmTimer->setInterval(2000);
+        _confirmTimer->setSingleShot(true);
+        connect(_confirmTimer, &QTimer::timeout, this, &MagiaEditor::confirmValidation);
+        _validator.reset(lineCount());
+
+        std::bitset<256> textStyles;
+        for(int style : {SCE_LUA_COMMENT, SCE_LUA_COMMENTLINE, SCE_LUA_COMMENTDOC, SCE_LUA_NUMBER,
+                         SCE_LUA_STRING, SCE_LUA_CHARACTER, SCE_LUA_LITERALSTRING, SCE_LUA_STRINGEOL})
+            textStyles.set(style);
+        _identifiers.setIgnoredStyles(textStyles);
+        _identifiers.reset(lineCount());
+
+        _validationWorker = std::make_unique<LuaValidationWorker>(
+            [this](std::uint64_t generation, const std::vector<LuaSyntaxValidator::ChunkResult>& results){
+                QMetaObject::invokeMethod(this, [this, generation, results](){
+                    onValidationResults(generation, results);
+                }, Qt::QueuedConnection);
+            });
+        _validationWorker->setConfirmCallback([this](std::uint64_t version, const LuaSyntaxValidator::ChunkResult& result){
+            QMetaObject::invokeMethod(this, [this, version, result](){
+                onConfirmation(version, result);
+            }, Qt::QueuedConnection);
+        });
+
         this->setMouseDwellTime(500);
 
         // Define uma função de print personalizada
         _lua->set_function("print", [this](sol::variadic_args va, sol::this_state ts) {
             lua_State* L = ts;  // Obter o lua_State atual
-            std::string output;
+
+            // only the script thread prints, the buffer is reused to skip an allocation per call
+            std::string& output = _printLine;
+            output.clear();
             for (auto v : va) {
                 sol::object arg = v.get<sol::object>();
                 arg.push(L);  // Coloca o objeto no topo da pilha Lua
@@ -107,14 +145,14 @@ namespace mg{
         });
 
 
-        MagiaDebugger::setPauseCallback([this](void *L, void *ar, int line, const std::string& functionName){
+        _debugSession.setPauseCallback([this](void *L, void *ar, int line, const std::string& functionName){
 
             _isPausedInsideFunction = functionName != "global";
             _lua_state_on_pause = L;
             _debug_state_on_pause = ar;
 
             QMetaObject::invokeMethod(this, [this,line](){
-                if(MagiaDebugger::state == MagiaDebugger::DebuggerState::Paused)
+                if(_debugSession.state() == MagiaDebugger::DebuggerState::Paused)
                     send(SCI_MARKERADD, line, styles::Markers::BREAKPOINT_ACHIEVED);
 
                 send(SCI_MARKERADD, line, styles::Markers::BREAKPOINT_ACHIEVED_BACKGROUND);
@@ -122,15 +160,25 @@ namespace mg{
 
             emit scriptPaused();
         });
+
+        // the globals a script defined are offered once it ends
+        connect(this, &MagiaEditor::scriptFinished, this, &MagiaEditor::collectGlobals);
+        collectGlobals();
     }
 
-    MagiaEditor::~MagiaEditor(){}
+    MagiaEditor::~MagiaEditor(){
+        // the worker posts its results to this object, stop it while we are still alive
+        _validationWorker.reset();
+
+        // the script job uses this object as well, interrupt it and wait for it to unwind
+        _scriptToken.cancel();
+        if(_scriptRun.valid())
+            _scriptRun.wait();
+    }
 
     void MagiaEditor::syntaxTimerTimeout() {
-        int length = this->textLength();
-        std::string script = this->getText(length).toStdString();
-        int errorLine = validateScript(script);
-        updateErrorMaker(errorLine);
+        validateScript();
+        refreshIdentifiers();
     }
 
     void MagiaEditor::scriptModified(Scintilla::ModificationFlags type,
@@ -142,6 +190,28 @@ namespace mg{
                                     Scintilla::FoldLevel foldNow,
                                     Scintilla::FoldLevel foldPrev)
     {
+        const auto flags = static_cast<int>(type);
+
+        // a restyled line may have moved in or out of a comment or string
+        if(flags & SC_MOD_CHANGESTYLE) {
+            _identifiers.linesRestyled(lineFromPosition(position), lineFromPosition(position + length));
+            return;
+        }
+
+        // only text changes matter for the validation, marker changes are ignored
+        if(flags & SC_MOD_INSERTTEXT) {
+            _validator.linesInserted(lineFromPosition(position), linesAdded);
+            _identifiers.linesInserted(lineFromPosition(position), linesAdded);
+        }
+        else if(flags & SC_MOD_DELETETEXT) {
+            _validator.linesRemoved(lineFromPosition(position), -linesAdded);
+            _identifiers.linesRemoved(lineFromPosition(position), -linesAdded);
+        }
+        else
+            return;
+
+        ++_documentVersion;
+        _confirmTimer->stop();
         _syntaxTimer->start();
     }
 
@@ -159,25 +229,56 @@ namespace mg{
             return;
         }
 
+        // shift click sets a condition and a hit count on the line
+        if(margin == styles::Margins::SYMBOLS && (static_cast<int>(modifiers) & SCMOD_SHIFT)) {
+            editBreakpoint(lineClicked);
+            return;
+        }
+
         if(margin == styles::Margins::SYMBOLS){
             if (send(SCI_MARKERGET, lineClicked) & (1 << styles::Markers::BREAKPOINT)) {
                 send(SCI_MARKERDELETE, lineClicked, styles::Markers::BREAKPOINT);
                 send(SCI_MARKERDELETE, lineClicked, styles::Markers::BREAKPOINT_BACKGROUND);
-                MagiaDebugger::removeBreakpoint(lineClicked);
+                _debugSession.removeBreakpoint(_chunkName, lineClicked);
             } else {
                 send(SCI_MARKERADD, lineClicked, styles::Markers::BREAKPOINT);
                 send(SCI_MARKERADD, lineClicked, styles::Markers::BREAKPOINT_BACKGROUND);
-                MagiaDebugger::appendBreakpoint(lineClicked);
+                _debugSession.appendBreakpoint(_chunkName, lineClicked);
             }
         }
     }
 
 
+    void MagiaEditor::editBreakpoint(int line) {
+        BreakpointIndex::Breakpoint current;
+        _debugSession.breakpoints().find(_chunkName, line + 1, current);
+
+        bool ok = false;
+        auto condition = QInputDialog::getText(this, tr("Breakpoint"), tr("Pause when (Lua expression, empty pauses always):"),
+                                               QLineEdit::Normal, QString::fromStdString(current.condition), &ok);
+        if(!ok)
+            return;
+
+        int hitTarget = QInputDialog::getInt(this, tr("Breakpoint"), tr("Pause from hit (0 pauses on every hit):"),
+                                             current.hitTarget, 0, 1000000, 1, &ok);
+        if(!ok)
+            return;
+
+        if(!(send(SCI_MARKERGET, line) & (1 << styles::Markers::BREAKPOINT))) {
+            send(SCI_MARKERADD, line, styles::Markers::BREAKPOINT);
+            send(SCI_MARKERADD, line, styles::Markers::BREAKPOINT_BACKGROUND);
+        }
+        _debugSession.appendBreakpoint(_chunkName, line, condition.trimmed().toStdString(), hitTarget);
+    }
+
     void MagiaEditor::onCharAdded(int ch) {
-        // Implementação de lógica de quando mostrar o autocomplete
-        if (ch == '(' || ch == ' ') {
-            // Exemplo: mostrar autocomplete após '(' ou ' '
-            showAutocomplete();
+        if (ch == '_' || (ch >= 0 && ch < 0x80 && std::isalnum(ch))) {
+            // Scintilla narrows an open list by itself while the word grows
+            if(!autoCActive())
+                showAutocomplete();
+        }
+        else if(ch == '.' || ch == ':') {
+            showMemberAutocomplete();
         }
         else if(ch == '\n'){
             onNewLine();
@@ -195,12 +296,97 @@ namespace mg{
     }
 
     void MagiaEditor::showAutocomplete() {
-        // Exemplo de fonte de dados para autocomplete (palavras-chave Lua)
-        QStringList luaKeywords = {"function", "end", "if", "then", "else", "for", "while", "do", "repeat", "until"};
-        QString wordList = luaKeywords.join(" ");
+        constexpr int MinPrefix = 2;
+
+        auto caret = currentPos();
+        auto start = wordStartPosition(caret, true);
+        if(caret - start < MinPrefix)
+            return;
+
+        // a member name is completed from its table, not from the document
+        if(start > 0 && (charAt(start - 1) == '.' || charAt(start - 1) == ':'))
+            return;
+
+        refreshIdentifiers();
+
+        std::string prefix = textRange(start, caret).toStdString();
+        auto completions = _identifiers.complete(prefix, _completionWords);
+        if(completions.empty())
+            return;
+
+        std::string list;
+        for(const auto& word : completions) {
+            list += word;
+            list += ' ';
+        }
+        list.pop_back();
+
+        autoCShow(caret - start, list.c_str());
+    }
+
+    void MagiaEditor::showMemberAutocomplete() {
+        // the state belongs to the script thread while it runs
+        if(_debugSession.state() != MagiaDebugger::DebuggerState::Coding)
+            return;
+
+        auto separator = currentPos() - 1;
+        auto start = wordStartPosition(separator, true);
+        if(start == separator)
+            return;
+
+        std::string name = textRange(start, separator).toStdString();
+        sol::object value = (*_lua)[name];
+        if(value.get_type() != sol::type::table)
+            return;
+
+        std::vector<std::string> members;
+        for(const auto& [key, member] : value.as<sol::table>())
+            if(key.get_type() == sol::type::string)
+                members.push_back(key.as<std::string>());
+
+        if(members.empty())
+            return;
+
+        std::sort(members.begin(), members.end());
+
+        std::string list;
+        for(const auto& member : members) {
+            list += member;
+            list += ' ';
+        }
+        list.pop_back();
 
-        // Exibir lista de autocomplete
-        this->autoCShow(0,wordList.toUtf8().data());
+        autoCShow(0, list.c_str());
+    }
+
+    void MagiaEditor::refreshIdentifiers() {
+        int lastLine = _identifiers.lastDirtyLine();
+        if(lastLine < 0)
+            return;
+
+        // the lexer may still be behind the edit, the styles decide what is an identifier
+        auto end = lastLine + 1 < lineCount() ? send(SCI_POSITIONFROMLINE, lastLine + 1) : textLength();
+        send(SCI_COLOURISE, send(SCI_GETENDSTYLED), end);
+
+        _identifiers.refresh([this](int line){ return lineView(line); },
+                             [this](int line, int column){
+                                 return static_cast<int>(send(SCI_GETSTYLEAT, send(SCI_POSITIONFROMLINE, line) + column));
+                             });
+    }
+
+    void MagiaEditor::collectGlobals() {
+        if(_debugSession.state() != MagiaDebugger::DebuggerState::Coding)
+            return;
+
+        _completionWords = {"and", "break", "do", "else", "elseif", "end", "false", "for", "function", "goto", "if",
+                            "in", "local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while"};
+
+        for(const auto& [key, value] : _lua->globals())
+            if(key.get_type() == sol::type::string)
+                _completionWords.push_back(key.as<std::string>());
+
+        std::sort(_completionWords.begin(), _completionWords.end());
+        _completionWords.erase(std::unique(_completionWords.begin(), _completionWords.end()), _completionWords.end());
     }
 
     void MagiaEditor::updateErrorMaker(int errorLine) {
@@ -214,35 +400,140 @@ namespace mg{
         }
     }
 
-    int MagiaEditor::validateScript(const std::string& script) {
+    void MagiaEditor::validateScript() {
+        auto jobs = _validator.collectJobs([this](int line){ return lineView(line); },
+                                           [this](int firstLine, int lastLine){ return rangeView(firstLine, lastLine); });
+
+        // every round supersedes the previous one, stale results only feed the cache
+        ++_validationGeneration;
+
+        if(jobs.empty()) {
+            publishValidation();
+            return;
+        }
+
+        _validationWorker->submit(_validationGeneration, std::move(jobs), _chunkName);
+    }
+
+    void MagiaEditor::onValidationResults(std::uint64_t generation,
+                                          const std::vector<LuaSyntaxValidator::ChunkResult>& results) {
+        _validator.storeResults(results);
+
+        if(generation == _validationGeneration)
+            publishValidation();
+    }
+
+    void MagiaEditor::publishValidation() {
+        std::string errorMsg;
+
+        // two chunks were merged to locate an error, validate them together right away
+        if(!_validator.resolve(_chunkName, errorMsg)) {
+            validateScript();
+            return;
+        }
+
+        updateErrorMaker(extractErrorLine(errorMsg));
+
+        // the confirmation also compiles the script for the next run, on long idle only
+        if(errorMsg.empty() && textLength() > 0 && _confirmedVersion != _documentVersion)
+            _confirmTimer->start();
+    }
 
-        sol::load_result result = _lua->load(script);
-//        auto result = _lua->script(script);
-        if (!result.valid()) {
-            sol::error err = result;
-            std::string errorMsg = err.what();
+    void MagiaEditor::confirmValidation() {
+        if(_confirmedVersion == _documentVersion || textLength() == 0)
+            return;
 
-            // Extrair e retornar o número da linha do erro (implemente esta função)
-            return extractErrorLine(errorMsg);
+        // edited back to what was parsed last (an undo, a save of the same text), nothing to
+        // compile or store again
+        auto script = rangeView(0, lineCount() - 1);
+        const auto hash = std::hash<std::string_view>{}(script);
+        if(hash == _confirmedHash) {
+            _confirmedVersion = _documentVersion;
+            showConfirmation(_confirmedResult);
+            return;
         }
 
-        return -1; // Retorna -1 se a sintaxe estiver correta
+        _pendingConfirmHash = hash;
+        _validationWorker->confirm(_documentVersion, std::string(script), _chunkName);
+    }
+
+    void MagiaEditor::onConfirmation(std::uint64_t version, const LuaSyntaxValidator::ChunkResult& result) {
+        // edited since, the next clean round asks again. Otherwise it answers the last confirm.
+        if(version != _documentVersion)
+            return;
+
+        _confirmedVersion = version;
+        _confirmedHash = _pendingConfirmHash;
+        _confirmedResult = result;
+        showConfirmation(result);
+    }
+
+    void MagiaEditor::showConfirmation(const LuaSyntaxValidator::ChunkResult& result) {
+        if(result.errorLine >= 0)
+            updateErrorMaker(extractErrorLine("[string \"" + _chunkName + "\"]:" + std::to_string(result.errorLine) + ":" + result.message));
+    }
+
+    std::string_view MagiaEditor::lineView(int line) {
+        auto start = send(SCI_POSITIONFROMLINE, line);
+        auto end = send(SCI_GETLINEENDPOSITION, line);
+        if(start < 0 || end <= start)
+            return {};
+
+        // points straight into the document buffer, valid until the next modification
+        auto* text = reinterpret_cast<const char*>(send(SCI_GETRANGEPOINTER, start, end - start));
+        return {text, static_cast<std::size_t>(end - start)};
+    }
+
+    std::string_view MagiaEditor::rangeView(int firstLine, int lastLine) {
+        auto start = send(SCI_POSITIONFROMLINE, firstLine);
+        auto end = lastLine + 1 < lineCount() ? send(SCI_POSITIONFROMLINE, lastLine + 1) : textLength();
+        if(start < 0 || end <= start)
+            return {};
+
+        auto* text = reinterpret_cast<const char*>(send(SCI_GETRANGEPOINTER, start, end - start));
+        return {text, static_cast<std::size_t>(end - start)};
     }
 
-    void MagiaEditor::executeScript(const std::string& script, const ScriptExecutionCallback& cb) {
+    void MagiaEditor::executeScript(std::string script, const ScriptExecutionCallback& cb) {
+        _scriptToken = CancellationToken();
+        _scriptToken.onCancel([this](){
+            _debugSession.setState(MagiaDebugger::DebuggerState::Stopping);
+        });
+
+        _scriptRun = ScriptExecutor::instance().submit([this, script = std::move(script), cb](const CancellationToken& token){
+            if(token.cancelled()) {
+                cb(false, "Script interrupted!");
+                return;
+            }
 
-        _scriptWorker = std::thread([this, script, cb](){
             try {
-                _lua->script(script);
+                lua_State* L = _lua->lua_state();
+
+                // unchanged scripts load straight from bytecode, the chunk name is the source
+                // the breakpoints are registered for
+                int status = BytecodeCache::instance().load(L, script, _chunkName);
+                if(status == LUA_OK) {
+                    _debugSession.attach(L);
+                    status = lua_pcall(L, 0, 0, 0);
+                    _debugSession.detach(L);
+                }
+
+                if(status != LUA_OK) {
+                    const char* error = lua_tostring(L, -1);
+                    std::string message = error ? error : "Unknown error";
+                    lua_pop(L, 1);
+                    std::cerr << "Error: " << message;
+                    cb(false, message);
+                    return;
+                }
+
                 cb(true, "");
             }
             catch(const sol::error& err){
                 std::cerr << "Error: " << err.what();
                 cb(false, err.what());
             }
-        });
-
-        _scriptWorker.detach();
+        }, _scriptToken);
     }
 
     int MagiaEditor::extractErrorLine(const std::string& errorMsg) {
@@ -267,7 +558,7 @@ namespace mg{
         //show error tooltip logic
         showErrorIfAny(x, line , pos);
 
-        if(MagiaDebugger::state == MagiaDebugger::DebuggerState::Paused)
+        if(_debugSession.state() == MagiaDebugger::DebuggerState::Paused)
             showVariableValueIfAny(pos);
     }
 
@@ -362,10 +653,10 @@ namespace mg{
 
 
     void MagiaEditor::execute(){
-        if(MagiaDebugger::state != MagiaDebugger::DebuggerState::Coding)
+        if(_debugSession.state() != MagiaDebugger::DebuggerState::Coding)
             return;
 
-        MagiaDebugger::state = MagiaDebugger::DebuggerState::Running;
+        _debugSession.setState(MagiaDebugger::DebuggerState::Running);
 
         internalExecute();
     }
@@ -373,10 +664,11 @@ namespace mg{
 
     void MagiaEditor::executeDebug(){
 
-        if(MagiaDebugger::state != MagiaDebugger::DebuggerState::Coding)
+        if(_debugSession.state() != MagiaDebugger::DebuggerState::Coding)
             return;
 
-        MagiaDebugger::state = MagiaDebugger::DebuggerState::Debugging;
+        _debugSession.breakpoints().prepareRun();
+        _debugSession.setState(MagiaDebugger::DebuggerState::Debugging);
         internalExecute();
     }
 
@@ -385,31 +677,31 @@ namespace mg{
         this->markerDeleteAll(styles::Markers::BREAKPOINT_ACHIEVED);
         this->markerDeleteAll(styles::Markers::BREAKPOINT_ACHIEVED_BACKGROUND);
 
-        if(MagiaDebugger::state == MagiaDebugger::DebuggerState::Coding ||
-            MagiaDebugger::state == MagiaDebugger::DebuggerState::Stopping)
+        if(_debugSession.state() == MagiaDebugger::DebuggerState::Coding ||
+            _debugSession.state() == MagiaDebugger::DebuggerState::Stopping)
             return;
 
-        MagiaDebugger::state = MagiaDebugger::DebuggerState::Stopping;
-        _lua->stack_clear();
-        _lua->collect_garbage();
+        // wakes up a paused script right away, the hook raises the interruption error and
+        // the script thread cleans the state up, it must not be touched from here
+        _scriptToken.cancel();
     }
 
     void MagiaEditor::stepExecution() {
-        if(MagiaDebugger::state != MagiaDebugger::DebuggerState::Paused)
+        if(_debugSession.state() != MagiaDebugger::DebuggerState::Paused)
             return;
 
         this->markerDeleteAll(styles::Markers::BREAKPOINT_ACHIEVED);
         this->markerDeleteAll(styles::Markers::BREAKPOINT_ACHIEVED_BACKGROUND);
 
-        MagiaDebugger::state = MagiaDebugger::DebuggerState::Step_over;
+        _debugSession.setState(MagiaDebugger::DebuggerState::Step_over);
     }
 
     void MagiaEditor::continueExecution(){
         this->markerDeleteAll(styles::Markers::BREAKPOINT_ACHIEVED);
         this->markerDeleteAll(styles::Markers::BREAKPOINT_ACHIEVED_BACKGROUND);
 
-        if(MagiaDebugger::state == MagiaDebugger::DebuggerState::Paused){
-            MagiaDebugger::state = MagiaDebugger::DebuggerState::Debugging;
+        if(_debugSession.state() == MagiaDebugger::DebuggerState::Paused){
+            _debugSession.setState(MagiaDebugger::DebuggerState::Debugging);
             return;
         }
     }
@@ -418,12 +710,15 @@ namespace mg{
         emit scriptStarted();
         auto length = this->textLength();
         std::string script = this->getText(length).toStdString();
-        executeScript(script,[this](bool success, const std::string& msg){
+        executeScript(std::move(script),[this](bool success, const std::string& msg){
             if(!success) {
+                _lua->stack_clear();
+                _lua->collect_garbage();
+
                 if(_printCallback)
                     _printCallback(msg);
 
-                MagiaDebugger::state = MagiaDebugger::DebuggerState::Coding;
+                _debugSession.setState(MagiaDebugger::DebuggerState::Coding);
                 emit scriptFinished();
                 return;
             }
@@ -433,7 +728,7 @@ namespace mg{
             if(_printCallback)
                 _printCallback("\nScript execution ended!\n");
 
-            MagiaDebugger::state = MagiaDebugger::DebuggerState::Coding;
+            _debugSession.setState(MagiaDebugger::DebuggerState::Coding);
 
             emit scriptFinished();
         });
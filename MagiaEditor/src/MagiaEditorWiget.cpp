@@ -8,6 +8,7 @@
 #include <QVBoxLayout>
 #include <QToolBar>
 #include <QVBoxLayout>
+#include <QTimer>
 #include "ConsoleOutput.h"
 
 namespace mg{
@@ -64,7 +65,6 @@ namespace mg{
         bottomLayout->addWidget(_debugToolBar);
 
         _console = new ConsoleOutput(bottomWidget);
-        _console->setReadOnly(true);
         _console->setMaximumHeight(150);
         _console->setStyleSheet("background-color: black; color: white; padding: 10px;");
         _console->setFont(QFont("Courier New", 16));
@@ -78,17 +78,29 @@ namespace mg{
         connect(_editor, &mg::MagiaEditor::scriptPaused, this, &MagiaEditorWidget::onScriptPaused);
         connect(_editor, &mg::MagiaEditor::scriptStarted, this, &MagiaEditorWidget::onScriptStarted);
 
+        _outputTimer = new QTimer(this);
+        _outputTimer->setInterval(16);
+        connect(_outputTimer, &QTimer::timeout, this, &MagiaEditorWidget::drainOutput);
+
+        // called on the script thread, no event is posted per print
         _editor->setPrintCallback([this](const std::string& print){
-            QMetaObject::invokeMethod(this, [this, print](){
-                _console->appendPlainText(print.c_str());
-            });
+            _output.push(print);
         });
 
         //set the initial state
-        MagiaDebugger::state = MagiaDebugger::DebuggerState::Coding;
+        _editor->debugSession().setState(MagiaDebugger::DebuggerState::Coding);
         updateActions();
     }
 
+    MagiaEditorWidget::~MagiaEditorWidget(){
+        // the editor is a child, ~QWidget would delete it after _output is gone. Its
+        // destructor interrupts the script and waits for it, and the script prints into
+        // _output until then, so the editor goes first.
+        _outputTimer->stop();
+        delete _editor;
+        _editor = nullptr;
+    }
+
 
     void MagiaEditorWidget::setupActions() {
         _playAction =   new QAction(QIcon(":/resources/images/play_active.svg"), tr("Run Script"), this);
@@ -140,8 +152,27 @@ namespace mg{
         updateActions();
     }
 
+    void MagiaEditorWidget::drainOutput() {
+        static constexpr std::size_t maxBytesPerFrame = 256 * 1024;
+
+        std::string batch;
+        _output.drain(batch, maxBytesPerFrame);
+
+        if(auto dropped = _output.takeDropped())
+            batch += "[" + std::to_string(dropped) + " prints dropped, the console could not keep up]\n";
+
+        if(!batch.empty())
+            _console->append(batch);
+
+        // the last prints of a run may land after scriptFinished, stop once they are shown.
+        // The state is read first, the prints of a finished run are visible after it.
+        if(_editor->debugSession().state() == MagiaDebugger::DebuggerState::Coding && _output.empty())
+            _outputTimer->stop();
+    }
+
     void MagiaEditorWidget::updateActions(){
-        switch (MagiaDebugger::state) {
+        const auto state = _editor->debugSession().state();
+        switch (state) {
             case MagiaDebugger::DebuggerState::Coding:
                 _playAction->setEnabled(true);
                 _debugAction->setEnabled(true);
@@ -176,25 +207,25 @@ namespace mg{
                 break;
         }
 
-        _playAction->setIcon(QIcon(MagiaDebugger::state == MagiaDebugger::DebuggerState::Coding ?
+        _playAction->setIcon(QIcon(state == MagiaDebugger::DebuggerState::Coding ?
                                    ":/resources/images/play_active.svg" :
                                    ":/resources/images/play_inactive.svg"));
 
-        _debugAction->setIcon(QIcon(MagiaDebugger::state == MagiaDebugger::DebuggerState::Coding ?
+        _debugAction->setIcon(QIcon(state == MagiaDebugger::DebuggerState::Coding ?
                                    ":/resources/images/debug_active.svg" :
                                    ":/resources/images/debug_inactive.svg"));
 
-        _stopAction->setIcon(QIcon(MagiaDebugger::state == MagiaDebugger::DebuggerState::Coding ?
+        _stopAction->setIcon(QIcon(state == MagiaDebugger::DebuggerState::Coding ?
                                    ":/resources/images/stop_inactive.svg" :
                                    ":/resources/images/stop_active.svg"));
 
-        _stepOverAction->setIcon(QIcon(MagiaDebugger::state == MagiaDebugger::DebuggerState::Paused||
-                                       MagiaDebugger::state == MagiaDebugger::DebuggerState::Step_over ?
+        _stepOverAction->setIcon(QIcon(state == MagiaDebugger::DebuggerState::Paused||
+                                       state == MagiaDebugger::DebuggerState::Step_over ?
                                    ":/resources/images/step_over_active.svg" :
                                    ":/resources/images/step_over_inactive.svg"));
 
-        _continueAction->setIcon(QIcon(MagiaDebugger::state == MagiaDebugger::DebuggerState::Paused||
-                                       MagiaDebugger::state == MagiaDebugger::DebuggerState::Step_over ?
+        _continueAction->setIcon(QIcon(state == MagiaDebugger::DebuggerState::Paused||
+                                       state == MagiaDebugger::DebuggerState::Step_over ?
                                    ":/resources/images/continue_active.svg" :
                                    ":/resources/images/continue_inactive.svg"));
 
@@ -210,6 +241,7 @@ namespace mg{
 
     void MagiaEditorWidget::onScriptStarted() {
         _console->clear();
+        _outputTimer->start();
     }
 
     QWidget* MagiaEditorWidget::getCentralWidget(){
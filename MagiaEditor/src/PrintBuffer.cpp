@@ -0,0 +1,68 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#include "PrintBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace mg{
+
+    PrintBuffer::PrintBuffer(std::size_t capacity){
+        std::size_t size = 64;
+        while(size < capacity)
+            size <<= 1;
+
+        _data = std::make_unique<char[]>(size);
+        _mask = size - 1;
+    }
+
+    bool PrintBuffer::push(std::string_view message){
+        const std::size_t head = _head.load(std::memory_order_relaxed);
+        const std::size_t tail = _tail.load(std::memory_order_acquire);
+        const std::size_t free = _mask + 1 - (head - tail);
+
+        if(message.size() + 1 > free) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        copyIn(head, message.data(), message.size());
+        copyIn(head + message.size(), "\n", 1);
+        _head.store(head + message.size() + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t PrintBuffer::drain(std::string& out, std::size_t maxBytes){
+        const std::size_t tail = _tail.load(std::memory_order_relaxed);
+        const std::size_t head = _head.load(std::memory_order_acquire);
+        std::size_t size = std::min(head - tail, maxBytes);
+        if(size == 0)
+            return 0;
+
+        const std::size_t start = tail & _mask;
+        const std::size_t first = std::min(size, _mask + 1 - start);
+        const std::size_t offset = out.size();
+        out.append(_data.get() + start, first);
+        out.append(_data.get(), size - first);
+
+        // stops at the last complete message, unless a single one is larger than maxBytes
+        if(tail + size != head) {
+            auto newline = out.find_last_of('\n');
+            if(newline != std::string::npos && newline >= offset) {
+                size = newline + 1 - offset;
+                out.resize(newline + 1);
+            }
+        }
+
+        _tail.store(tail + size, std::memory_order_release);
+        return size;
+    }
+
+    void PrintBuffer::copyIn(std::size_t position, const char* data, std::size_t size){
+        const std::size_t start = position & _mask;
+        const std::size_t first = std::min(size, _mask + 1 - start);
+        std::memcpy(_data.get() + start, data, first);
+        std::memcpy(_data.get(), data + first, size - first);
+    }
+}
@@ -0,0 +1,124 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#include "ScriptExecutor.h"
+#include <algorithm>
+
+namespace mg{
+
+    CancellationToken::CancellationToken():
+    _state(std::make_shared<State>()){}
+
+    void CancellationToken::cancel() const{
+        std::function<void()> callback;
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            if(_state->cancelled.exchange(true))
+                return;
+            callback = std::move(_state->callback);
+        }
+
+        if(callback)
+            callback();
+    }
+
+    bool CancellationToken::cancelled() const{
+        return _state->cancelled.load();
+    }
+
+    void CancellationToken::onCancel(std::function<void()> cb) const{
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            if(!_state->cancelled) {
+                _state->callback = std::move(cb);
+                return;
+            }
+        }
+
+        if(cb)
+            cb();
+    }
+
+    ScriptExecutor::ScriptExecutor(std::size_t workers){
+        workers = std::max<std::size_t>(1, workers);
+        _running.resize(workers);
+        _threads.reserve(workers);
+        for(std::size_t i = 0; i < workers; ++i)
+            _threads.emplace_back([this, i](){ run(i); });
+    }
+
+    ScriptExecutor::~ScriptExecutor(){
+        std::vector<CancellationToken> tokens;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+            for(auto& task : _queue)
+                tokens.push_back(task.token);
+            for(auto& running : _running)
+                if(running)
+                    tokens.push_back(*running);
+        }
+
+        // outside the lock, the callbacks may wake paused scripts that then finish their job
+        for(auto& token : tokens)
+            token.cancel();
+
+        _wake.notify_all();
+        for(auto& thread : _threads)
+            if(thread.joinable())
+                thread.join();
+    }
+
+    ScriptExecutor& ScriptExecutor::instance(){
+        // a paused debug session keeps its worker busy, so leave room for a few of them
+        static ScriptExecutor executor(std::max(4u, std::thread::hardware_concurrency()));
+        return executor;
+    }
+
+    std::future<void> ScriptExecutor::submit(Job job, const CancellationToken& token){
+        Task task{std::move(job), token, {}};
+        auto future = task.done.get_future();
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            stopping = _stop;
+            _queue.push_back(std::move(task));
+        }
+
+        if(stopping)
+            CancellationToken(token).cancel();
+
+        _wake.notify_one();
+        return future;
+    }
+
+    void ScriptExecutor::run(std::size_t worker){
+        while(true) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wake.wait(lock, [this](){ return _stop || !_queue.empty(); });
+
+                // queued jobs still run once cancelled, so they can report back before we leave
+                if(_queue.empty())
+                    break;
+
+                task = std::move(_queue.front());
+                _queue.pop_front();
+                _running[worker] = std::make_unique<CancellationToken>(task.token);
+            }
+
+            try {
+                task.job(task.token);
+                task.done.set_value();
+            }
+            catch(...) {
+                task.done.set_exception(std::current_exception());
+            }
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running[worker].reset();
+        }
+    }
+}
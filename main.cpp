@@ -1,11 +1,18 @@
 #include "mainwindow.h"
+#include "BytecodeCache.h"
 
 #include <QApplication>
+#include <QStandardPaths>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    // compiled chunks survive restarts, unchanged scripts skip the parser
+    const auto cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if(!cacheDir.isEmpty())
+        mg::BytecodeCache::instance().setDirectory((cacheDir + "/bytecode").toStdString());
+
     MainWindow w;
     w.show();
     return a.exec();
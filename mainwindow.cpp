@@ -29,12 +29,29 @@ MainWindow::MainWindow(QWidget *parent)
     _fileExplorer = new FileExplorerWidget(_centralWidget);
     _mainLayout->addWidget(_fileExplorer);
     
+    // Trigram index of the project, answers the searches of the explorer and the agent
+    _trigramIndex = new aic::TrigramIndex(this);
+    _fileExplorer->setTrigramIndex(_trigramIndex);
+
+    // Ctrl+P palette, its file list follows the index
+    _quickOpen = new aic::QuickOpen(_centralWidget);
+    _quickOpen->setIndex(_trigramIndex);
+    connect(_quickOpen, &aic::QuickOpen::fileChosen, this, &MainWindow::handleFileSelected);
+
     // Set the project root path
     QString projectPath = QDir::currentPath();
     _fileExplorer->setRootPath(projectPath);
     
+    // Writes files for the editor and the agent, off the GUI thread
+    _saveService = new aic::SaveService(this);
+
+    // Runs the agent's shell commands without blocking the window
+    _commandRunner = new aic::CommandRunner(this);
+    connect(_saveService, &aic::SaveService::saved, _trigramIndex, &aic::TrigramIndex::fileChanged);
+
     // Create and setup code editor
     _editor = new aic::CodeEditor(_centralWidget);
+    _editor->setSaveService(_saveService);
     _editorLayout->addWidget(_editor->getCentralWidget(), 7); // 70% of space
     
     // Setup terminal
@@ -52,7 +69,18 @@ MainWindow::MainWindow(QWidget *parent)
     
     // Connect signals
     connect(_aiChat, &AIChatWidget::promptSubmitted, this, &MainWindow::handleAIPrompt);
+    connect(_commandRunner, &aic::CommandRunner::started, _aiChat, &AIChatWidget::commandStarted);
+    connect(_commandRunner, &aic::CommandRunner::output, _aiChat, [this](int id, const QByteArray& chunk, bool) {
+        _aiChat->appendCommandOutput(id, chunk);
+    });
+    connect(_commandRunner, &aic::CommandRunner::finished, _aiChat, [this](int id, int) {
+        _aiChat->commandFinished(id);
+    });
+    connect(_aiChat, &AIChatWidget::stopRequested, _commandRunner, &aic::CommandRunner::killAll);
     connect(_fileExplorer, &FileExplorerWidget::fileSelected, this, &MainWindow::handleFileSelected);
+    connect(_fileExplorer, &FileExplorerWidget::searchResultSelected, this, [this](const QString& filePath, int line) {
+        _editor->openFile(filePath, line);
+    });
     
     setCentralWidget(_centralWidget);
     
@@ -65,6 +93,12 @@ MainWindow::MainWindow(QWidget *parent)
 
 void MainWindow::registerAICallbacks()
 {
+    // Actions of one turn run concurrently where they can, their observations reach the
+    // agent together with a single call once the turn is over
+    _actionScheduler = new aic::ActionScheduler(this);
+    connect(_actionScheduler, &aic::ActionScheduler::observationsReady, _aiChat, &AIChatWidget::addObservations);
+    connect(_actionScheduler, &aic::ActionScheduler::busyChanged, _aiChat, &AIChatWidget::setToolsBusy);
+
     // Registrar callback para execução de comandos no terminal
     _agentProcessor->registerActionCallback("run_command", [this](const mgutils::JsonDocument& doc) {
         if(doc.HasMember("command")) {
@@ -83,8 +117,14 @@ void MainWindow::registerAICallbacks()
               fullCommand += " " + arg;
             }
             
-            // Executar o comando no terminal
-            this->executeBashCommand(fullCommand);
+            // Executar o comando no terminal. Exclusive: it may touch any file
+            _actionScheduler->submit("run_command", QString(), aic::ActionScheduler::Access::Exclusive, aic::ActionScheduler::Thread::Gui,
+                                     [this, fullCommand](const aic::ActionScheduler::Reply& reply) {
+                executeBashCommand(fullCommand, [reply](const QString& message) {
+                    reply.observe(message.toStdString());
+                    reply.done();
+                });
+            });
         }
     });
     
@@ -93,20 +133,22 @@ void MainWindow::registerAICallbacks()
         if(doc.HasMember("file") && doc.HasMember("content")) {
             std::string filePath = doc["file"].GetString();
             std::string content = doc["content"].GetString();
-            try {
-              mgutils::Files::writeFile(filePath, content);
-              std::stringstream ss;
-              ss <<  "<observation><action>write_file</action><result>Arquivo "<< filePath << " criado com sucesso.</result></observation>";
-              logW << ss.str();
-              _aiChat->getAgent()->addObservation(ss.str());
-              _aiChat->updateAgent();
-            } catch (...) {
-              std::stringstream ss;
-              ss <<  "<observation><action>write_file</action><result>Erro ao escrever arquivo: " << filePath << ".</result></observation>";
-              logE << ss.str();
-              _aiChat->getAgent()->addObservation(ss.str());
-              _aiChat->updateAgent();
-            }
+            // the observation follows once the file is on disk
+            _actionScheduler->submit("write_file", QString::fromStdString(filePath), aic::ActionScheduler::Access::Write, aic::ActionScheduler::Thread::Gui,
+                                     [this, filePath, content](const aic::ActionScheduler::Reply& reply) {
+              _saveService->save(QString::fromStdString(filePath), QByteArray::fromStdString(content), [reply, filePath](bool ok, const QString& error) {
+                std::stringstream ss;
+                if (ok) {
+                  ss <<  "<observation><action>write_file</action><result>Arquivo "<< filePath << " criado com sucesso.</result></observation>";
+                  logW << ss.str();
+                } else {
+                  ss <<  "<observation><action>write_file</action><result>Erro ao escrever arquivo: " << filePath << ": " << error.toStdString() << ".</result></observation>";
+                  logE << ss.str();
+                }
+                reply.observe(ss.str());
+                reply.done();
+              });
+            });
         }
     });
     
@@ -115,20 +157,22 @@ void MainWindow::registerAICallbacks()
         if(doc.HasMember("directory"))
         {
             std::string relativePath = doc["directory"].GetString();
-            try{
-              mgutils::Files::createDirectory(relativePath);
-              std::stringstream ss;
-              ss <<  "<observation><action>write_file</action><result>Diretório criado com sucesso: " << relativePath << "</result></observation>";
-              logW << ss.str();
-              _aiChat->getAgent()->addObservation(ss.str());
-              _aiChat->updateAgent();
-            } catch (...) {
-              std::stringstream ss;
-              ss <<  "<observation><action>write_file</action><result>Erro ao criar diretório: " << relativePath << "</result></observation>";
-              logE << ss.str();
-              _aiChat->getAgent()->addObservation(ss.str());
-              _aiChat->updateAgent();
-            }
+            _actionScheduler->submit("make_dir", QString::fromStdString(relativePath), aic::ActionScheduler::Access::Write, aic::ActionScheduler::Thread::Pool,
+                                     [relativePath](const aic::ActionScheduler::Reply& reply) {
+              try{
+                mgutils::Files::createDirectory(relativePath);
+                std::stringstream ss;
+                ss <<  "<observation><action>write_file</action><result>Diretório criado com sucesso: " << relativePath << "</result></observation>";
+                logW << ss.str();
+                reply.observe(ss.str());
+              } catch (...) {
+                std::stringstream ss;
+                ss <<  "<observation><action>write_file</action><result>Erro ao criar diretório: " << relativePath << "</result></observation>";
+                logE << ss.str();
+                reply.observe(ss.str());
+              }
+              reply.done();
+            });
         }
     });
     
@@ -136,20 +180,23 @@ void MainWindow::registerAICallbacks()
     _agentProcessor->registerActionCallback("view_file", [&](const mgutils::JsonDocument& doc) {
         if(doc.HasMember("file")) {
             std::string filePath = doc["file"].GetString();
-            try {
-              std::string content = mgutils::Files::readFile(filePath);
-              std::stringstream ss;
-              ss <<  "<observation><action>view_file</action><result>Conteúdo do arquivo: " << filePath << "\ncontent:" << content << "</result></observation>";
-              logW << ss.str();
-              _aiChat->getAgent()->addObservation(ss.str());
-              _aiChat->updateAgent();
-            } catch (...) {
-              std::stringstream ss;
-              ss <<  "<observation><action>view_file</action><result>Erro ao visualizar arquivo: " << filePath << "</result></observation>";
-              logE << ss.str();
-              _aiChat->getAgent()->addObservation(ss.str());
-              _aiChat->updateAgent();
-            }
+            // reads run side by side on the scheduler's threads
+            _actionScheduler->submit("view_file", QString::fromStdString(filePath), aic::ActionScheduler::Access::Read, aic::ActionScheduler::Thread::Pool,
+                                     [filePath](const aic::ActionScheduler::Reply& reply) {
+              try {
+                std::string content = mgutils::Files::readFile(filePath);
+                std::stringstream ss;
+                ss <<  "<observation><action>view_file</action><result>Conteúdo do arquivo: " << filePath << "\ncontent:" << content << "</result></observation>";
+                logW << ss.str();
+                reply.observe(ss.str());
+              } catch (...) {
+                std::stringstream ss;
+                ss <<  "<observation><action>view_file</action><result>Erro ao visualizar arquivo: " << filePath << "</result></observation>";
+                logE << ss.str();
+                reply.observe(ss.str());
+              }
+              reply.done();
+            });
         }
     });
     
@@ -158,22 +205,22 @@ void MainWindow::registerAICallbacks()
         if(doc.HasMember("file") && doc.HasMember("changes")) {
             std::string filePath = doc["file"].GetString();
             std::string changes = doc["changes"].GetString();
-            try {
-                if(!mgutils::Files::fileExists(filePath))
-                    mgutils::Files::createFile(filePath);
-              mgutils::Files::writeFile(filePath, changes);
-              std::stringstream ss;
-              ss <<  "<observation><action>edit_file</action><result>Arquivo "<< filePath << " criado com sucesso.</result></observation>";
-              logW << ss.str();
-              _aiChat->getAgent()->addObservation(ss.str());
-              _aiChat->updateAgent();
-            } catch (...) {
-              std::stringstream ss;
-              ss <<  "<observation><action>edit_file</action><result>Erro ao editar arquivo: " << filePath << ".</result></observation>";
-              logE << ss.str();
-              _aiChat->getAgent()->addObservation(ss.str());
-              _aiChat->updateAgent();
-            }
+            // missing files are created by the save
+            _actionScheduler->submit("edit_file", QString::fromStdString(filePath), aic::ActionScheduler::Access::Write, aic::ActionScheduler::Thread::Gui,
+                                     [this, filePath, changes](const aic::ActionScheduler::Reply& reply) {
+              _saveService->save(QString::fromStdString(filePath), QByteArray::fromStdString(changes), [reply, filePath](bool ok, const QString& error) {
+                std::stringstream ss;
+                if (ok) {
+                  ss <<  "<observation><action>edit_file</action><result>Arquivo "<< filePath << " criado com sucesso.</result></observation>";
+                  logW << ss.str();
+                } else {
+                  ss <<  "<observation><action>edit_file</action><result>Erro ao editar arquivo: " << filePath << ": " << error.toStdString() << ".</result></observation>";
+                  logE << ss.str();
+                }
+                reply.observe(ss.str());
+                reply.done();
+              });
+            });
         }
     });
     
@@ -191,26 +238,61 @@ void MainWindow::registerAICallbacks()
     });
     
     // Registrar callback para grep search
-    _agentProcessor->registerActionCallback("grep_search", [](const mgutils::JsonDocument& doc) {
-        if(doc.HasMember("pattern") && doc.HasMember("file")) {
+    // without a file, or with a directory, the whole workspace is searched. Matches reach the
+    // agent in batches as they are found, the summary closes the search.
+    _agentProcessor->registerActionCallback("grep_search", [&](const mgutils::JsonDocument& doc) {
+        if(doc.HasMember("pattern")) {
             std::string pattern = doc["pattern"].GetString();
-            std::string file = doc["file"].GetString();
-            try {
-                std::string content = mgutils::Files::readFile(file);
-                std::stringstream ss(content);
-                std::string line;
-                int lineNumber = 0;
-                logW << "Resultados da busca por '" << pattern << "' em " << file << ":";
-                std::regex patternRegex(pattern);
-                while (std::getline(ss, line)) {
-                    lineNumber++;
-                    if (std::regex_search(line, patternRegex)) {
-                        logI << file << ":" << lineNumber << ": " << line;
+            QString root = QDir::currentPath();
+            if(doc.HasMember("file")) {
+                root = QString::fromStdString(doc["file"].GetString());
+            } else if(doc.HasMember("directory")) {
+                root = QString::fromStdString(doc["directory"].GetString());
+            }
+
+            aic::WorkspaceSearch::Query query;
+            query.text = QString::fromStdString(pattern);
+            query.regex = true;
+            query.matchCase = true;
+            // every match goes back to the model, a few hundred are more than it can use
+            query.maxMatches = 200;
+
+            _actionScheduler->submit("grep_search", root, aic::ActionScheduler::Access::Read, aic::ActionScheduler::Thread::Gui,
+                                     [this, root, query, pattern](const aic::ActionScheduler::Reply& reply) {
+                // one search per call, so searches the agent starts together do not cancel each other
+                auto search = new aic::WorkspaceSearch(this);
+                auto candidates = QFileInfo(root).isDir()
+                    ? _trigramIndex->candidates(QByteArray::fromStdString(aic::WorkspaceSearch::prefilterLiteral(query)), root)
+                    : std::nullopt;
+                connect(search, &aic::WorkspaceSearch::matchesFound, this, [reply](const QVector<aic::SearchMatch>& matches) {
+                    std::stringstream ss;
+                    ss << "<observation><action>grep_search</action><result>";
+                    for (const auto& match : matches) {
+                        ss << match.path.toStdString() << ":" << match.line << ": " << match.text.toStdString() << "\n";
                     }
+                    ss << "</result></observation>";
+                    logI << ss.str();
+                    reply.observe(ss.str());
+                });
+                connect(search, &aic::WorkspaceSearch::finished, this, [reply, search, pattern](int files, int matches, bool truncated) {
+                    std::stringstream ss;
+                    ss << "<observation><action>grep_search</action><result>Busca por '" << pattern << "' concluída: "
+                       << matches << (truncated ? "+" : "") << " resultados em " << files << " arquivos.</result></observation>";
+                    logW << ss.str();
+                    reply.observe(ss.str());
+                    reply.done();
+                    search->deleteLater();
+                });
+
+                if (!(candidates ? search->start(*candidates, query) : search->start(root, query))) {
+                    std::stringstream ss;
+                    ss << "<observation><action>grep_search</action><result>Padrão inválido: " << pattern << "</result></observation>";
+                    logE << ss.str();
+                    reply.observe(ss.str());
+                    reply.done();
+                    search->deleteLater();
                 }
-            } catch (...) {
-                logE << "Erro ao realizar busca grep: " << pattern << " em " << file;
-            }
+            });
         }
     });
     
@@ -218,27 +300,29 @@ void MainWindow::registerAICallbacks()
     _agentProcessor->registerActionCallback("list_directory", [&](const mgutils::JsonDocument& doc) {
         if(doc.HasMember("directory")) {
             std::string directory = doc["directory"].GetString();
-            auto files = mgutils::Files::listDirectories(directory);
-            if(!files.empty())
-            {
-              std::string fileList;
-              for(auto &f : files)
-                fileList += f + "\n";
+            _actionScheduler->submit("list_directory", QString::fromStdString(directory), aic::ActionScheduler::Access::Read, aic::ActionScheduler::Thread::Pool,
+                                     [directory](const aic::ActionScheduler::Reply& reply) {
+              auto files = mgutils::Files::listDirectories(directory);
+              if(!files.empty())
+              {
+                std::string fileList;
+                for(auto &f : files)
+                  fileList += f + "\n";
 
-              std::stringstream ss;
-              ss <<  "<observation><action>list_directory</action><result>Conteúdo do diretório: " << directory << "\ncontent:" << fileList << "</result></observation>";
-              logW << ss.str();
-              _aiChat->getAgent()->addObservation(ss.str());
-              _aiChat->updateAgent();
-            }
-            else
-            {
-              std::stringstream ss;
-              ss <<  "<observation><action>list_directory</action><result>O diretório: " << directory << " está vazio.</result></observation>";
-              logW << ss.str();
-              _aiChat->getAgent()->addObservation(ss.str());
-              _aiChat->updateAgent();
-            }
+                std::stringstream ss;
+                ss <<  "<observation><action>list_directory</action><result>Conteúdo do diretório: " << directory << "\ncontent:" << fileList << "</result></observation>";
+                logW << ss.str();
+                reply.observe(ss.str());
+              }
+              else
+              {
+                std::stringstream ss;
+                ss <<  "<observation><action>list_directory</action><result>O diretório: " << directory << " está vazio.</result></observation>";
+                logW << ss.str();
+                reply.observe(ss.str());
+              }
+              reply.done();
+            });
 
         }
     });
@@ -289,7 +373,7 @@ void MainWindow::registerAICallbacks()
     });
     
     // Registrar callback para busca na base de código
-    _agentProcessor->registerActionCallback("codebase_search", [](const mgutils::JsonDocument& doc) {
+    _agentProcessor->registerActionCallback("codebase_search", [&](const mgutils::JsonDocument& doc) {
         if(doc.HasMember("query")) {
             std::string query = doc["query"].GetString();
             std::string corpus = "";
@@ -300,7 +384,29 @@ void MainWindow::registerAICallbacks()
             if (!corpus.empty()) {
                 logW << "Corpus: " << corpus;
             }
-            // Aqui seria implementada a lógica para realizar a busca semântica na base de código
+
+            // files holding the most words of the query, straight from the trigram index (which
+            // belongs to the GUI thread)
+            _actionScheduler->submit("codebase_search", QString(), aic::ActionScheduler::Access::Read, aic::ActionScheduler::Thread::Gui,
+                                     [this, query](const aic::ActionScheduler::Reply& reply) {
+                std::stringstream ss;
+                ss << "<observation><action>codebase_search</action><result>";
+                if (!_trigramIndex->isReady()) {
+                    ss << "O índice da base de código ainda está sendo construído.";
+                } else {
+                    auto files = _trigramIndex->rankFiles(QString::fromStdString(query), 20);
+                    if (files.empty()) {
+                        ss << "Nenhum arquivo encontrado para: " << query;
+                    }
+                    for (const auto& [file, words] : files) {
+                        ss << QDir(_trigramIndex->root()).relativeFilePath(file).toStdString() << " (" << words << " termos)\n";
+                    }
+                }
+                ss << "</result></observation>";
+                logW << ss.str();
+                reply.observe(ss.str());
+                reply.done();
+            });
         }
     });
 }
@@ -397,9 +503,6 @@ void MainWindow::setupTerminal()
         _terminal->startShellProgram();
     });
     
-    // Conectar o sinal receivedData para capturar a saída do terminal
-//    connect(_terminal, &QTermWidget::receivedData, this, &MainWindow::handleTerminalOutput);
-    
     // Start the shell
     _terminal->startShellProgram();
     
@@ -426,10 +529,17 @@ void MainWindow::setupActions()
     _toggleTerminalAction->setStatusTip("Show/Hide Terminal");
     connect(_toggleTerminalAction, &QAction::triggered, this, &MainWindow::toggleTerminal);
     
+    // Create quick open action
+    _quickOpenAction = new QAction("Go to File", this);
+    _quickOpenAction->setShortcut(QKeySequence("Ctrl+P"));
+    _quickOpenAction->setStatusTip("Open a file of the project by name");
+    connect(_quickOpenAction, &QAction::triggered, _quickOpen, &aic::QuickOpen::popup);
+    
     // Add actions to window
     addAction(_toggleAIChatAction);
     addAction(_toggleFileExplorerAction);
     addAction(_toggleTerminalAction);
+    addAction(_quickOpenAction);
 }
 
 void MainWindow::toggleAIChatWidget()
@@ -465,83 +575,55 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+void MainWindow::closeEvent(QCloseEvent* event)
+{
+    // the commands get their SIGTERM while the event loop still runs, the runner kills
+    // what is left when it goes away
+    _commandRunner->killAll();
+    QMainWindow::closeEvent(event);
+}
+
 void MainWindow::handleAIPrompt(const QString& prompt)
 {
+    // a new prompt takes over, the commands of the previous one are not waited for
+    _commandRunner->killAll();
+
     // TODO: Implement AI response handling here
     // For demonstration, we'll echo the prompt back
 //    _aiChat->findChild<QTextEdit*>()->append("<b>AI:</b> Processing: " + prompt);
 }
 
-void MainWindow::executeBashCommand(const std::string &command)
+void MainWindow::executeBashCommand(const std::string &command, const std::function<void(const QString&)>& done)
 {
-  QProcess process;
-  process.start("bash", QStringList() << "-c" << QString::fromStdString(command));
-
-  // Aguarda o término do comando
-  process.waitForFinished();
+  // never blocks the GUI thread: the output streams into the chat, the observation
+  // (head and tail of it) goes to the agent once the command is over
+  aic::CommandRunner::Options options;
+  options.workingDirectory = QDir::currentPath();
 
-  int exitCode = process.exitCode();
-  QString output = process.readAllStandardOutput();
-  QString errorOutput = process.readAllStandardError();
-  QString message;
-  if (exitCode == 0) {
-    // Sucesso: processou o comando corretamente
-    if (_aiChat) {
-      message = "Command ["  + QString::fromStdString(command) +  "] executado com sucesso! A saída foi: ```\n" + output + "\n```";
-    }
-  } else {
-    // Erro na execução do comando
-    if (_aiChat) {
-       message = "Command error (" + QString::number(exitCode) + "):\n```\n" + errorOutput + "\n```";
+  _commandRunner->run(QString::fromStdString(command), options, [done](const aic::CommandRunner::Result& result) {
+    QString message;
+    if (result.failedToStart) {
+      message = "Command [" + result.command + "] não pôde ser iniciado.";
+    } else if (result.timedOut || result.killed) {
+      message = "Command [" + result.command + "] " + (result.timedOut ? "excedeu o tempo limite" : "foi interrompido") +
+                ". Saída até então:\n```\n" + result.output + "\n" + result.errorOutput + "\n```";
+    } else if (result.exitCode == 0) {
+      // Sucesso: processou o comando corretamente
+      message = "Command ["  + result.command +  "] executado com sucesso! A saída foi: ```\n" + result.output + "\n```";
+    } else {
+      // Erro na execução do comando
+      message = "Command error (" + QString::number(result.exitCode) + "):\n```\n" + result.errorOutput + "\n" + result.output + "\n```";
     }
-  }
-  _aiChat->getAgent()->addObservation(message.toStdString());
-  qDebug() << "Terminal: " + message;
+
+    qDebug() << "Terminal: " + message;
+    done(message);
+  });
 }
-// Modifique o método de execução para incluir o marcador
 void MainWindow::executeTerminalCommand(const std::string &command)
 {
   if (_terminal) {
-    // Converter e montar o comando com o marcador
-    QString qCommand = QString::fromStdString(command);
-    QString marker = "echo __COMMAND_DONE__\n";
-    qCommand += "\n" + marker;
-
-    // Limpa o buffer de saída para o novo comando
-    commandOutput.clear();
-
     // Envia o comando para o terminal
-    _terminal->sendText(qCommand);
+    _terminal->sendText(QString::fromStdString(command) + "\n");
   }
 }
 
-QString cleanTerminalOutput(QString input) {
-  // Regex para remover sequências ANSI
-  QRegularExpression ansiRegex("\x1B\\[[0-?]*[ -/]*[@-~]");
-  return input.remove(ansiRegex);
-}
-
-void MainWindow::handleTerminalOutput(const QString& text)
-{
-  // Limpa o texto recebido
-  QString cleanText = cleanTerminalOutput(text);
-  commandOutput += cleanText;
-
-  // Verifica se o marcador foi recebido
-  if (commandOutput.contains("__COMMAND_DONE__")) {
-    // Remove o marcador da saída
-    commandOutput.replace("__COMMAND_DONE__", "");
-
-    // Cria e envia a mensagem para a IA
-    if (_aiChat) {
-      QString message = "Terminal output:\n```\n" + commandOutput + "\n```";
-      _aiChat->appendTerminalOutput(message);
-    }
-
-    // Limpa o buffer para o próximo comando
-    commandOutput.clear();
-  }
-
-  logD << "Terminal recebeu: " << text.toStdString();
-}
-
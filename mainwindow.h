@@ -5,10 +5,15 @@
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QAction>
+#include <QCloseEvent>
 #include <qtermwidget.h>
 #include "views/CodeEditor.h"
+#include "views/SaveService.h"
+#include "views/CommandRunner.h"
+#include "views/ActionScheduler.h"
 #include "views/AIChatWidget.h"
 #include "views/FileExplorerWidget.h"
+#include "views/QuickOpen.h"
 #include "ais/include/AgentProcessor.h"
 
 QT_BEGIN_NAMESPACE
@@ -25,6 +30,9 @@ public:
 
     void executeTerminalCommand(const std::string &command) override;
 
+protected:
+    void closeEvent(QCloseEvent* event) override;
+
 private:
     void setupActions();
     void setupTerminal();
@@ -32,7 +40,6 @@ private:
     
 private slots:
     void handleAIPrompt(const QString& prompt);
-    void handleTerminalOutput(const QString& text);
     void toggleAIChatWidget();
     void toggleFileExplorer();
     void toggleTerminal();
@@ -45,15 +52,20 @@ private:
     QVBoxLayout* _editorLayout{nullptr};
     FileExplorerWidget* _fileExplorer{nullptr};
     aic::CodeEditor* _editor{nullptr};
+    aic::SaveService* _saveService{nullptr};
+    aic::CommandRunner* _commandRunner{nullptr};
+    aic::ActionScheduler* _actionScheduler{nullptr};
+    aic::TrigramIndex* _trigramIndex{nullptr};
+    aic::QuickOpen* _quickOpen{nullptr};
     AIChatWidget* _aiChat{nullptr};
     QTermWidget* _terminal{nullptr};
     QAction* _toggleAIChatAction{nullptr};
     QAction* _toggleFileExplorerAction{nullptr};
     QAction* _toggleTerminalAction{nullptr};
+    QAction* _quickOpenAction{nullptr};
     std::shared_ptr<ais::AgentProcessor> _agentProcessor{nullptr};
 
-    QString commandOutput;
-    void executeBashCommand(const std::string &command);
+    void executeBashCommand(const std::string &command, const std::function<void(const QString&)>& done);
 
 
 };
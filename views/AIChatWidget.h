@@ -10,8 +10,13 @@
 #include <QTimer>
 #include <QMetaObject>
 #include <QLabel>
+#include <atomic>
+#include <map>
 #include "MgStyles.h"
 #include "MagiaTheme.h"
+#include "ObservationAggregator.h"
+#include "ContextManager.h"
+#include "ActionStreamParser.h"
 
 #ifndef Q_MOC_RUN
 #include <ais>
@@ -28,48 +33,97 @@ public:
       : QWidget(parent),
         _streamer(std::make_shared<ais::AIStreamer>()),
         _processor(processor ? processor : std::make_shared<ais::AgentProcessor>(executor)),
-        _agent(std::make_shared<ais::AIAgent>(ais::agents::cascadeV2)),
-        _pendingUpdate(false)
+        _agent(std::make_shared<ais::AIAgent>(ais::agents::cascadeV2))
   {
     setFixedWidth(400);
     setupUI();
     setupAI();
   }
 
-  // Método para adicionar saída do terminal ao chat e enviar para a IA
-  void appendTerminalOutput(const QString& output) {
-    // Adiciona a saída como uma mensagem do usuário para a IA
-//    _agent->addAssistantMessageaddAssistantMessage(output.toStdString());
+  // Output of a command the agent runs, shown as it arrives with the answer's own batching;
+  // the agent only gets the summary once the command is over. Past MaxCommandOutputShown
+  // bytes the chunks are only counted, a command printing gigabytes would freeze the view.
+  void commandStarted(int id, const QString& command) {
+    _commandOutput[id] = {};
+    appendResponse("$ " + command + "\n");
+    stopButton->show();
+  }
 
-    // Faz uma nova chamada à IA para processar a saída
-    _streamer->call(*_agent);
+  void appendCommandOutput(int id, const QByteArray& chunk) {
+    auto& output = _commandOutput[id];
+    const qint64 room = MaxCommandOutputShown - output.shown;
+    if (room <= 0) {
+      output.hidden += chunk.size();
+      return;
+    }
+
+    const QByteArray part = chunk.left(static_cast<qsizetype>(room));
+    output.shown += part.size();
+    output.hidden += chunk.size() - part.size();
+    appendResponse(QString::fromUtf8(part));
   }
 
-  std::shared_ptr<ais::AIAgent> getAgent() {
-    return _agent;
+  void commandFinished(int id) {
+    auto it = _commandOutput.find(id);
+    if (it != _commandOutput.end()) {
+      if (it->second.hidden > 0)
+        appendResponse(QString("\n... [%1 bytes not shown] ...\n").arg(it->second.hidden));
+      _commandOutput.erase(it);
+    }
+    stopButton->setVisible(!_commandOutput.empty());
+  }
+
+  // Observations of the tools of the current turn. The agent is called again once, when the
+  // answer is over and the tools are done.
+  void addObservations(const std::vector<std::string>& observations) {
+    _observations.add(observations);
   }
 
-  // Método que tenta atualizar o agente; se o agente estiver processando,
-  // marca a atualização como pendente e tentará novamente assim que o processamento terminar.
-  void updateAgent() {
-      _pendingUpdate = true;
+  // Whether tools asked for in this turn are still running
+  void setToolsBusy(bool busy) {
+    _observations.setBusy(busy);
   }
 
+  void setObservationDebounce(int ms) {
+    _observations.setDebounce(ms);
+  }
 
+  // Size of the history sent with each request, see ContextManager
+  void setContextOptions(const aic::ContextManager::Options& options) {
+    _context.setOptions(options);
+  }
 
 private:
-  void updateAgentInternal() {
-    if (!_isProcessing) {
-      _streamer->call(*_agent);
-    } else {
-      logW << "Agent is processing already. Update marked as pending.";
-      _pendingUpdate = true;
+  // The agent is rebuilt from the compacted history for every request, it only holds what
+  // this one sends
+  void callAgent() {
+    const int before = _context.totalTokens();
+    auto agent = std::make_shared<ais::AIAgent>(ais::agents::cascadeV2);
+    for (const auto& message : _context.compacted()) {
+      switch (message.role) {
+        case aic::ContextManager::Role::User: agent->addUserMessage(message.text); break;
+        case aic::ContextManager::Role::Assistant: agent->addAssistantMessage(message.text); break;
+        case aic::ContextManager::Role::Observation: agent->addObservation(message.text); break;
+      }
     }
+    logI << "Context: ~" << _context.totalTokens() << " tokens (" << before << " before compaction).";
+
+    _agent = agent;
+    _streamer->call(*_agent);
   }
 
+  static constexpr qint64 MaxCommandOutputShown = 16 * 1024;
+
+  struct CommandOutput
+  {
+    qint64 shown{0};
+    qint64 hidden{0};
+  };
+
   QTextEdit *responseArea;
   QLineEdit *promptInput;
   QPushButton *sendButton;
+  QPushButton *stopButton;
   QPushButton *closeButton;
   QLabel *titleLabel;
 
@@ -77,53 +131,83 @@ private:
   std::shared_ptr<ais::AIStreamer> _streamer;
   std::shared_ptr<ais::AgentProcessor> _processor;
   std::shared_ptr<ais::AIAgent> _agent;
-
-  bool _isProcessing{false};
-  bool _pendingUpdate{false};
+  aic::ContextManager _context;
+
+  std::atomic<bool> _isProcessing{false};   // cleared on the streamer's thread
+  aic::ObservationAggregator _observations;
+  aic::ActionStreamParser _actionParser;   // reset and fed on the streamer's thread only
+  std::map<int, CommandOutput> _commandOutput;   // commands still running, by id
+  QString _pendingText;
+  QTimer _textTimer;
   QTimer _processingTimer;
 
+  // Chunks arrive a few characters at a time, the text area is updated once per frame
+  void appendResponse(const QString& text) {
+    _pendingText += text;
+    if (!_textTimer.isActive())
+      _textTimer.start();
+  }
+
+  void flushResponse() {
+    _textTimer.stop();
+    if (_pendingText.isEmpty())
+      return;
+    responseArea->moveCursor(QTextCursor::End);
+    responseArea->insertPlainText(_pendingText);
+    _pendingText.clear();
+  }
+
   void setupAI() {
+    _textTimer.setSingleShot(true);
+    _textTimer.setInterval(30);
+    connect(&_textTimer, &QTimer::timeout, this, &AIChatWidget::flushResponse);
+
+    connect(&_observations, &aic::ObservationAggregator::ready, this, [this](const std::vector<std::string>& observations) {
+      for (const auto& observation : observations)
+        _context.addObservation(observation);
+      logI << "Sending " << observations.size() << " observations to the agent.";
+      callAgent();
+    });
+
     _streamer->setOnStart([this]() {
+      // on the streamer's thread, before the first update of the answer
+      _actionParser.reset();
       QMetaObject::invokeMethod(this, [this]() {
         _isProcessing = true;
+        _observations.turnStarted();
         sendButton->setEnabled(false);
         promptInput->setEnabled(false);
       }, Qt::QueuedConnection);
     });
 
+    // Actions are cut out of the stream as it arrives, each goes to the processor whole as
+    // soon as it is closed, so its tool runs while the rest of the answer streams
     _streamer->setOnUpdate([this](const std::string &update) {
-      QMetaObject::invokeMethod(this, [this, update]() {
-        responseArea->insertPlainText(QString::fromStdString(update));
-        _processor->process(update);
+      std::vector<std::string> actions;
+      _actionParser.feed(update, [&actions](std::string_view action) { actions.emplace_back(action); });
+
+      QMetaObject::invokeMethod(this, [this, update, actions = std::move(actions)]() {
+        appendResponse(QString::fromStdString(update));
+        for (const auto& action : actions)
+          _processor->process(action);
       }, Qt::QueuedConnection);
     });
 
     _streamer->setOnFinish([this](const std::string &answer)
     {
       _isProcessing = false;
-      _agent->addAssistantMessage(answer);
-
-      if (_pendingUpdate)
-      {
-        QMetaObject::invokeMethod(this, [this]()
-        {
-          _pendingUpdate = false;
-          updateAgentInternal();
-        });
-        return;
-//
-//        QTimer::singleShot(2000, this, [this]() {
-//          _pendingUpdate = false;
-//          updateAgentInternal();
-//        });
-//        return;
-      }
+      if (_actionParser.insideAction())
+        logW << "Answer ended inside an action, it was not run.";
 
-      QMetaObject::invokeMethod(this, [this]()
+      // queued behind the updates, so the actions of the answer are all submitted by now
+      QMetaObject::invokeMethod(this, [this, answer]()
       {
+        _context.addAssistant(answer);
         sendButton->setEnabled(true);
         promptInput->setEnabled(true);
+        flushResponse();
         responseArea->append("\n");
+        _observations.turnFinished();
 
       }, Qt::QueuedConnection);
     });
@@ -214,7 +298,17 @@ private:
                                   .arg(mg::theme::Colors::DEFAULT_TEXT, 6, 16, QChar('0'))
                                   .arg(mg::theme::Colors::ACTIVE_ITEM, 6, 16, QChar('0')));
 
+    // stops the commands the agent is running, shown while there are any
+    stopButton = new QPushButton("Stop", inputContainer);
+    stopButton->setStyleSheet(QString("QPushButton { padding: 8px 16px; background-color: transparent; color: #%1; border: 1px solid #%2; border-radius: 4px; }"
+                                      "QPushButton:hover { background-color: #%3; }")
+                                  .arg(mg::theme::Colors::DEFAULT_TEXT, 6, 16, QChar('0'))
+                                  .arg(mg::theme::Colors::BORDER, 6, 16, QChar('0'))
+                                  .arg(mg::theme::Colors::ACTIVE_ITEM, 6, 16, QChar('0')));
+    stopButton->hide();
+
     inputLayout->addWidget(promptInput);
+    inputLayout->addWidget(stopButton);
     inputLayout->addWidget(sendButton);
     contentLayout->addWidget(inputContainer);
 
@@ -223,6 +317,7 @@ private:
     connect(sendButton, &QPushButton::clicked, this, &AIChatWidget::onSendClicked);
     connect(promptInput, &QLineEdit::returnPressed, this, &AIChatWidget::onSendClicked);
     connect(closeButton, &QPushButton::clicked, this, &QWidget::hide);
+    connect(stopButton, &QPushButton::clicked, this, &AIChatWidget::stopRequested);
 
     setLayout(mainLayout);
   }
@@ -231,17 +326,27 @@ private slots:
   void onSendClicked() {
     auto prompt = promptInput->text();
     if (!prompt.isEmpty() && !_isProcessing) {
-      _agent->addUserMessage(prompt.toStdString());
+      // right away, a second Enter before the answer starts would send the prompt twice
+      _isProcessing = true;
+      sendButton->setEnabled(false);
+      promptInput->setEnabled(false);
+
+      _context.addUser(prompt.toStdString());
+      flushResponse();
       responseArea->append("<b>You:</b> " + prompt);
       responseArea->append("<b>AI:</b> ");
       promptInput->clear();
-      _streamer->call(*_agent);
+      _observations.turnStarted();
+      callAgent();
       emit promptSubmitted(prompt);
     }
   }
 
 signals:
   void promptSubmitted(const QString &prompt);
+
+  // The user wants the running commands gone
+  void stopRequested();
 };
 
 #endif // AICHATWIDGET_H
@@ -0,0 +1,276 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_ACTIONSCHEDULER_H
+#define QWIDGET_LUA_EDITOR_ACTIONSCHEDULER_H
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QObject>
+#include <QString>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aic
+{
+
+  // Runs the actions the agent asks for in one turn concurrently where that is safe: reads
+  // go to a pool of threads, an action touching a path waits only for the earlier actions
+  // it conflicts with (a read for the writes before it, a write for everything before it)
+  // on that path, on a directory holding it or on anything inside it. An action without a
+  // path (a search over the workspace) touches everything, and an exclusive action (a shell
+  // command, which may do anything) waits for all of them. Observations are collected in
+  // the order the actions were asked for and handed over together once every action is
+  // over, when to call the model again is up to the receiver.
+  class ActionScheduler : public QObject
+  {
+  Q_OBJECT
+
+  public:
+    enum class Access { Read, Write, Exclusive };
+
+    // Where the job itself runs. Jobs that create QObjects or talk to widgets stay on the GUI
+    // thread, they are expected to be asynchronous themselves.
+    enum class Thread { Pool, Gui };
+
+    // Handed to a job to report back, from any thread. done() must be called exactly once.
+    class Reply
+    {
+    public:
+      Reply(ActionScheduler* scheduler, int id): _scheduler(scheduler), _id(id){}
+
+      void observe(std::string observation) const
+      {
+        auto scheduler = _scheduler;
+        auto id = _id;
+        QMetaObject::invokeMethod(scheduler, [scheduler, id, observation = std::move(observation)]() mutable {
+          scheduler->observe(id, std::move(observation));
+        }, Qt::QueuedConnection);
+      }
+
+      void done() const
+      {
+        auto scheduler = _scheduler;
+        auto id = _id;
+        QMetaObject::invokeMethod(scheduler, [scheduler, id](){ scheduler->complete(id); }, Qt::QueuedConnection);
+      }
+
+    private:
+      ActionScheduler* _scheduler;
+      int _id;
+    };
+
+    using Job = std::function<void(const Reply& reply)>;
+
+    explicit ActionScheduler(QObject* parent = nullptr): QObject(parent)
+    {
+      const unsigned threads = std::min(8u, std::max(2u, std::thread::hardware_concurrency()));
+      for (unsigned i = 0; i < threads; ++i)
+        _threads.emplace_back([this](){ work(); });
+    }
+
+    // Jobs not started yet are dropped, running ones are waited for
+    ~ActionScheduler() override
+    {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _tasks.clear();
+      }
+      _wake.notify_all();
+      for (auto& thread : _threads)
+        thread.join();
+    }
+
+    // path is the file or directory the action reads or writes, empty for the whole workspace
+    void submit(const QString& name, const QString& path, Access access, Thread thread, Job job)
+    {
+      const int id = ++_lastId;
+      const bool wasIdle = _actions.empty();
+      auto& action = _actions[id];
+      action.name = name;
+      action.thread = thread;
+      action.job = std::move(job);
+
+      for (int before : dependencies(id, path.isEmpty() ? QString() : QFileInfo(path).absoluteFilePath(), access)) {
+        auto it = _actions.find(before);
+        if (it == _actions.end())
+          continue;
+        it->second.dependents.push_back(id);
+        ++action.waiting;
+      }
+
+      if (wasIdle)
+        emit busyChanged(true);
+      if (action.waiting == 0)
+        dispatch(id);
+    }
+
+    bool isIdle() const
+    {
+      return _actions.empty();
+    }
+
+  signals:
+    // Every observation of the actions asked for since the last batch, in that order
+    void observationsReady(const std::vector<std::string>& observations);
+
+    // true when the first action is submitted, false once every action is over (right after
+    // observationsReady)
+    void busyChanged(bool busy);
+
+  private:
+    struct Action
+    {
+      QString name;
+      Thread thread{Thread::Pool};
+      Job job;
+      int waiting{0};                  // earlier actions still to finish
+      std::vector<int> dependents;
+    };
+
+    // A path an action not finished yet reads or writes, empty for everything
+    struct PathUse
+    {
+      int id;
+      QString path;
+      Access access;
+    };
+
+    // One is the other, or a directory holding it
+    static bool overlap(const QString& a, const QString& b)
+    {
+      if (a.isEmpty() || b.isEmpty() || a == b)
+        return true;
+
+      auto inside = [](const QString& path, const QString& directory){
+        return path.startsWith(directory.endsWith('/') ? directory : directory + '/');
+      };
+      return inside(a, b) || inside(b, a);
+    }
+
+    // The earlier actions id has to wait for, and the bookkeeping for the later ones
+    std::vector<int> dependencies(int id, const QString& path, Access access)
+    {
+      std::vector<int> before;
+      if (_lastExclusive)
+        before.push_back(_lastExclusive);
+
+      if (access == Access::Exclusive) {
+        for (const auto& [other, action] : _actions)
+          if (other != id)
+            before.push_back(other);
+        _lastExclusive = id;
+        _uses.clear();
+        return before;
+      }
+
+      // two reads never conflict, whatever their paths
+      for (const auto& use : _uses)
+        if ((use.access == Access::Write || access == Access::Write) && overlap(use.path, path))
+          before.push_back(use.id);
+
+      _uses.push_back({id, path, access});
+      return before;
+    }
+
+    void dispatch(int id)
+    {
+      auto& action = _actions[id];
+      Reply reply(this, id);
+
+      if (action.thread == Thread::Gui) {
+        action.job(reply);
+        return;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back([job = std::move(action.job), reply](){ job(reply); });
+      }
+      _wake.notify_one();
+    }
+
+    void observe(int id, std::string observation)
+    {
+      _observations[id].push_back(std::move(observation));
+    }
+
+    void complete(int id)
+    {
+      auto it = _actions.find(id);
+      if (it == _actions.end())
+        return;
+
+      std::vector<int> dependents = std::move(it->second.dependents);
+      _actions.erase(it);
+
+      if (_lastExclusive == id)
+        _lastExclusive = 0;
+      _uses.erase(std::remove_if(_uses.begin(), _uses.end(), [id](const PathUse& use){ return use.id == id; }),
+                  _uses.end());
+
+      for (int dependent : dependents) {
+        auto next = _actions.find(dependent);
+        if (next != _actions.end() && --next->second.waiting == 0)
+          dispatch(dependent);
+      }
+
+      if (_actions.empty()) {
+        flush();
+        emit busyChanged(false);
+      }
+    }
+
+    void flush()
+    {
+      std::vector<std::string> observations;
+      for (auto& [id, list] : _observations)
+        for (auto& observation : list)
+          observations.push_back(std::move(observation));
+      _observations.clear();
+
+      if (!observations.empty())
+        emit observationsReady(observations);
+    }
+
+    void work()
+    {
+      while (true) {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _wake.wait(lock, [this](){ return _stop || !_tasks.empty(); });
+          if (_stop)
+            return;
+
+          task = std::move(_tasks.front());
+          _tasks.pop_front();
+        }
+        task();
+      }
+    }
+
+    int _lastId{0};
+    int _lastExclusive{0};
+    std::map<int, Action> _actions;                        // not finished yet, in order
+    std::vector<PathUse> _uses;                            // of the actions since the last exclusive one
+    std::map<int, std::vector<std::string>> _observations;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::deque<std::function<void()>> _tasks;
+    std::vector<std::thread> _threads;
+    bool _stop{false};
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_ACTIONSCHEDULER_H
@@ -0,0 +1,172 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_ACTIONSTREAMPARSER_H
+#define QWIDGET_LUA_EDITOR_ACTIONSTREAMPARSER_H
+
+#include <string>
+#include <string_view>
+
+namespace aic
+{
+
+  // Finds the action blocks (<action ...>...</action>) of an answer while it streams. Each
+  // chunk is looked at once, where it left off, and a block is handed over the moment its
+  // closing tag arrives, so its tool can start before the rest of the answer is written.
+  // In a JSON body a closing tag inside a string does not end the block: a file written by
+  // the agent may well hold one.
+  class ActionStreamParser
+  {
+  public:
+    explicit ActionStreamParser(std::string tag = "action")
+        : _open("<" + tag), _close("</" + tag + ">"){}
+
+    // onAction(std::string_view block) gets every block completed by chunk, tags included
+    template<typename Callback>
+    void feed(std::string_view chunk, Callback&& onAction)
+    {
+      size_t i = 0;
+      while (i < chunk.size()) {
+        switch (_state) {
+          case State::Text:
+            i = scanText(chunk, i);
+            break;
+          case State::OpenTag:
+            i = scanOpenTag(chunk, i);
+            break;
+          case State::Body:
+            i = scanBody(chunk, i);
+            if (_state == State::Text) {
+              onAction(std::string_view(_block));
+              _block.clear();
+            }
+            break;
+        }
+      }
+    }
+
+    // Forgets a block left open, for the next answer
+    void reset()
+    {
+      _state = State::Text;
+      _matched = 0;
+      _block.clear();
+    }
+
+    bool insideAction() const
+    {
+      return _state != State::Text;
+    }
+
+  private:
+    enum class State { Text, OpenTag, Body };
+    enum class Body { Unknown, Json, Other };
+
+    // Looks for the opening tag; only '<' can start it, the rest is skipped in one go
+    size_t scanText(std::string_view chunk, size_t i)
+    {
+      if (_matched == 0) {
+        i = chunk.find('<', i);
+        if (i == std::string_view::npos)
+          return chunk.size();
+      }
+
+      for (; i < chunk.size(); ++i) {
+        const char c = chunk[i];
+        if (_matched == _open.size()) {
+          // <action> or <action attributes>, not <actions>
+          if (c == '>' || c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            _block = _open;
+            _matched = 0;
+            _state = State::OpenTag;
+            return i;
+          }
+          _matched = 0;
+        }
+
+        if (c == _open[_matched])
+          ++_matched;
+        else if (_matched > 0)
+          _matched = c == '<' ? 1 : 0;
+
+        if (_matched == 0)
+          return i + 1;
+      }
+      return i;
+    }
+
+    // Attributes up to the '>', quoted values may hold one
+    size_t scanOpenTag(std::string_view chunk, size_t i)
+    {
+      for (; i < chunk.size(); ++i) {
+        const char c = chunk[i];
+        _block += c;
+        if (_quote) {
+          if (c == _quote)
+            _quote = 0;
+        }
+        else if (c == '"' || c == '\'') {
+          _quote = c;
+        }
+        else if (c == '>') {
+          _state = State::Body;
+          _body = Body::Unknown;
+          _inString = _escaped = false;
+          return i + 1;
+        }
+      }
+      return i;
+    }
+
+    size_t scanBody(std::string_view chunk, size_t i)
+    {
+      const size_t start = i;
+      for (; i < chunk.size(); ++i) {
+        const char c = chunk[i];
+
+        if (_body == Body::Unknown && c != ' ' && c != '\t' && c != '\n' && c != '\r')
+          _body = c == '{' || c == '[' ? Body::Json : Body::Other;
+
+        if (_inString) {
+          if (_escaped)
+            _escaped = false;
+          else if (c == '\\')
+            _escaped = true;
+          else if (c == '"')
+            _inString = false;
+          continue;
+        }
+
+        if (c == _close[_matched]) {
+          if (++_matched == _close.size()) {
+            _block.append(chunk.data() + start, i + 1 - start);
+            _matched = 0;
+            _state = State::Text;
+            return i + 1;
+          }
+          continue;
+        }
+
+        _matched = c == '<' ? 1 : 0;
+        if (c == '"' && _body == Body::Json)
+          _inString = true;
+      }
+
+      _block.append(chunk.data() + start, i - start);
+      return i;
+    }
+
+    const std::string _open;
+    const std::string _close;
+    State _state{State::Text};
+    size_t _matched{0};          // characters of the tag being matched so far
+    std::string _block;
+
+    char _quote{0};
+    Body _body{Body::Unknown};
+    bool _inString{false};
+    bool _escaped{false};
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_ACTIONSTREAMPARSER_H
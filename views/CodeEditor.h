@@ -13,12 +13,22 @@
 #include <QVBoxLayout>
 #include <QResizeEvent>
 #include "GenericEditor.h"
-#include <QFile>
-#include <QTextStream>
+#include "FileLoader.h"
+#include "DocumentManager.h"
+#include "SaveService.h"
+#include "FindBar.h"
 #include "MagiaTheme.h"
 #include <QLabel>
+#include <QProgressBar>
+#include <QToolButton>
+#include <QMenu>
+#include <QTabBar>
 #include <QPushButton>
 #include <QHBoxLayout>
+#include <QPointer>
+#include <QShortcut>
+#include <QMessageBox>
+#include <functional>
 
 namespace aic
 {
@@ -40,25 +50,248 @@ namespace aic
       return _centralWidget;
     }
 
-    void openFile(const QString& filePath)
-    {
-      QFile file(filePath);
-      if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream in(&file);
-        QString content = in.readAll();
-        file.close();
-        _editor->setText(content.toUtf8().constData());
-        _editor->setLexerForFile(filePath);  // Set the appropriate lexer based on file extension
-        _currentFilePath = filePath;
-        
-        // Update file info in the header
-        QFileInfo fileInfo(filePath);
-        _fileNameLabel->setText(fileInfo.fileName());
-        _filePathLabel->setText(fileInfo.absolutePath());
+    ~CodeEditor() override
+    {
+      // the documents can only be released through the view, which is still alive here
+      _loader->cancel();
+      _documents->closeAll();
+    }
+
+    // Opens the file in its own tab, or switches to the tab it already has. line (1 based)
+    // is shown once the document is in the editor.
+    void openFile(const QString& filePath, int line = -1)
+    {
+      _pendingLine = line > 0 ? std::make_pair(filePath, line) : std::make_pair(QString(), -1);
+
+      int index = _documents->indexOf(filePath);
+      if (index < 0) {
+        index = _documents->add(filePath, QFileInfo(filePath).size());
+        _tabs->addTab(QFileInfo(filePath).fileName());
+        _tabs->setTabToolTip(index, filePath);
       }
+
+      if (index == _tabs->currentIndex())
+        showDocument(index);
+      else
+        _tabs->setCurrentIndex(index);
+
+      // a document already showing does not go through a switch
+      if (_documents->at(index).handle && index == _documents->current())
+        applyPendingLine(filePath);
+    }
+
+    void setSaveService(SaveService* saveService)
+    {
+      _saveService = saveService;
+    }
+
+    // Snapshots the current document and hands it to the save service, the editor stays
+    // usable while it is written. saved runs once the file is on disk and the document was
+    // not edited in the meantime.
+    void saveCurrentFile(std::function<void()> saved = nullptr)
+    {
+      int index = _documents->current();
+      if (!_saveService || index < 0 || !_documents->at(index).handle)
+        return;
+
+      // the character pointer is only valid until the next edit, the copy goes to the I/O thread
+      auto length = _editor->send(SCI_GETLENGTH);
+      auto text = reinterpret_cast<const char*>(_editor->send(SCI_GETCHARACTERPOINTER));
+      QByteArray content(text, static_cast<qsizetype>(length));
+
+      // the save point waits for the disk, edits typed while writing keep the document modified
+      const QString filePath = _documents->at(index).path;
+      const quint64 edits = _documents->at(index).edits;
+      QPointer<CodeEditor> self(this);
+      _saveService->save(filePath, std::move(content), [self, filePath, edits, saved](bool ok, const QString& error){
+        if (!self)
+          return;
+
+        int savedIndex = self->_documents->indexOf(filePath);
+        if (ok) {
+          if (savedIndex < 0 || !self->_documents->saved(savedIndex, edits))
+            return;
+
+          // the current tab follows savePointChanged
+          if (savedIndex != self->_documents->current())
+            self->_tabs->setTabText(savedIndex, QFileInfo(filePath).fileName());
+          if (saved)
+            saved();
+          return;
+        }
+
+        if (savedIndex >= 0)
+          self->_tabs->setTabText(savedIndex, QFileInfo(filePath).fileName() + " ●");
+        self->_filePathLabel->setText(tr("Could not save %1: %2").arg(filePath, error));
+      });
     }
 
   private:
+    void showDocument(int index)
+    {
+      // a failed load is retried when the file is opened again
+      if (index >= 0 && index == _documents->current() && (_documents->at(index).handle || _loader->isLoading()))
+        return;
+
+      if (index < 0) {
+        _loader->cancel();
+        _documents->activate(-1);
+        _editor->setIdentifierIndex(nullptr);
+        _currentFilePath.clear();
+        _loadProgress->hide();
+        _fileNameLabel->clear();
+        _filePathLabel->clear();
+        return;
+      }
+
+      const auto& document = _documents->at(index);
+      const QString filePath = document.path;
+      _currentFilePath = filePath;
+      updateFileInfo(filePath);
+
+      // decided before the text or the lexer reach the editor
+      _editor->setFileSize(document.bytes);
+
+      // already loaded: styling, undo and caret come back with the document
+      if (_documents->activate(index)) {
+        _loader->cancel();
+        _loadProgress->hide();
+        _editor->documentChanged(filePath);
+        _editor->setIdentifierIndex(document.identifiers);
+        _findBar->documentChanged();
+        updateTabTitle(_editor->send(SCI_GETMODIFY));
+        applyPendingLine(filePath);
+        return;
+      }
+
+      // the preview is thrown away, nothing to index
+      _editor->setIdentifierIndex(nullptr);
+
+      // small files are loaded before load() returns
+      if (!_loader->load(_editor, filePath) || !_loader->isLoading())
+        return;
+
+      // big files show their first screen read only while the rest loads in the background
+      QByteArray preview = FileLoader::preview(filePath);
+      _editor->send(SCI_SETTEXT, 0, reinterpret_cast<sptr_t>(preview.constData()));
+      _editor->send(SCI_EMPTYUNDOBUFFER);
+      _editor->setReadOnly(true);
+      _editor->setLexerForFile(filePath);
+
+      _loadProgress->setValue(0);
+      _loadProgress->show();
+    }
+
+    void onFileLoaded(const QString& filePath, void* document, int eolMode)
+    {
+      // keeps the place the user scrolled to in the preview
+      auto firstLine = _editor->send(SCI_GETFIRSTVISIBLELINE);
+      auto caret = _editor->send(SCI_GETCURRENTPOS);
+
+      if (!_documents->attach(filePath, document, QFileInfo(filePath).size()))
+        return;
+
+      _editor->send(SCI_SETEOLMODE, eolMode);
+      _editor->send(SCI_EMPTYUNDOBUFFER);
+      _editor->send(SCI_SETSAVEPOINT);
+
+      // the lexer belongs to the document, it stays with it from now on
+      _editor->setLexerForFile(filePath);
+      _editor->setIdentifierIndex(_documents->at(_documents->current()).identifiers);
+      _findBar->documentChanged();
+
+      _editor->send(SCI_GOTOPOS, caret);
+      _editor->send(SCI_SETFIRSTVISIBLELINE, firstLine);
+      _loadProgress->hide();
+      applyPendingLine(filePath);
+    }
+
+    void applyPendingLine(const QString& filePath)
+    {
+      if (_pendingLine.first != filePath)
+        return;
+
+      _editor->send(SCI_GOTOLINE, _pendingLine.second - 1);
+      _editor->send(SCI_VERTICALCENTRECARET);
+      _editor->setFocus();
+      _pendingLine = {QString(), -1};
+    }
+
+    // The view only tells about the document it shows, the others kept their state when
+    // they were switched away from
+    bool isModified(int index) const
+    {
+      if (index == _documents->current())
+        return _editor->send(SCI_GETMODIFY);
+      return _documents->at(index).modified;
+    }
+
+    void closeTab(int index)
+    {
+      if (!isModified(index)) {
+        dropTab(index);
+        return;
+      }
+
+      const QString filePath = _documents->at(index).path;
+      auto answer = QMessageBox::question(this, tr("Unsaved changes"),
+                                          tr("Save the changes to %1 before closing it?").arg(QFileInfo(filePath).fileName()),
+                                          QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel,
+                                          QMessageBox::Save);
+      if (answer == QMessageBox::Cancel)
+        return;
+
+      if (answer == QMessageBox::Discard) {
+        dropTab(index);
+        return;
+      }
+
+      // the tab goes away once the file is on disk, a failed save leaves it open and modified
+      _tabs->setCurrentIndex(index);
+      QPointer<CodeEditor> self(this);
+      saveCurrentFile([self, filePath](){
+        if (!self)
+          return;
+        int savedIndex = self->_documents->indexOf(filePath);
+        if (savedIndex >= 0)
+          self->dropTab(savedIndex);
+      });
+    }
+
+    void dropTab(int index)
+    {
+      if (index == _documents->current())
+        _loader->cancel();
+
+      // the manager goes first, removeTab reports the new current tab right away
+      _documents->close(index);
+      _tabs->removeTab(index);
+    }
+
+    void updateTabTitle(bool modified)
+    {
+      int index = _documents->current();
+      if (index < 0)
+        return;
+
+      QString name = QFileInfo(_documents->at(index).path).fileName();
+      _tabs->setTabText(index, modified ? name + " ●" : name);
+    }
+
+    void onFileLoadFailed(const QString& filePath, const QString& error)
+    {
+      _loadProgress->hide();
+      _filePathLabel->setText(tr("Could not open %1: %2").arg(filePath, error));
+    }
+
+    void updateFileInfo(const QString& filePath)
+    {
+      // Update file info in the header
+      QFileInfo fileInfo(filePath);
+      _fileNameLabel->setText(fileInfo.fileName());
+      _filePathLabel->setText(fileInfo.absolutePath());
+    }
+
     void setupUI() {
       // Set background color for the main widget
       setStyleSheet(QString("CodeEditor { background-color: #%1; }")
@@ -96,6 +329,16 @@ namespace aic
       
       headerLayout->addWidget(fileInfoWidget);
       headerLayout->addStretch();
+
+      _loadProgress = new QProgressBar(headerWidget);
+      _loadProgress->setRange(0, 100);
+      _loadProgress->setMaximumWidth(160);
+      _loadProgress->setTextVisible(false);
+      _loadProgress->hide();
+      headerLayout->addWidget(_loadProgress);
+
+      setupLargeFileIndicator(headerWidget);
+      headerLayout->addWidget(_largeFileButton);
       
       // Action buttons
       auto runButton = new QPushButton("▶ Run", headerWidget);
@@ -116,6 +359,11 @@ namespace aic
                   .arg(mg::theme::Colors::ACTIVE_ITEM, 6, 16, QChar('0'))
       );
       
+      connect(saveButton, &QPushButton::clicked, this, [this](){ saveCurrentFile(); });
+      auto saveShortcut = new QShortcut(QKeySequence::Save, _centralWidget);
+      saveShortcut->setContext(Qt::WidgetWithChildrenShortcut);
+      connect(saveShortcut, &QShortcut::activated, this, [this](){ saveCurrentFile(); });
+
       headerLayout->addWidget(saveButton);
       headerLayout->addWidget(runButton);
       
@@ -129,10 +377,44 @@ namespace aic
                              .arg(mg::theme::Colors::BORDER, 6, 16, QChar('0')));
       mainLayout->addWidget(separator);
       
+      _tabs = new QTabBar(_centralWidget);
+      _tabs->setTabsClosable(true);
+      _tabs->setDocumentMode(true);
+      _tabs->setExpanding(false);
+      _tabs->setElideMode(Qt::ElideMiddle);
+      _tabs->setStyleSheet(QString("QTabBar::tab { background-color: #%1; color: #%2; padding: 6px 12px; border: none; }"
+                                   "QTabBar::tab:selected { background-color: #%3; }")
+                           .arg(mg::theme::Colors::SIDEBAR_BG, 6, 16, QChar('0'))
+                           .arg(mg::theme::Colors::DEFAULT_TEXT, 6, 16, QChar('0'))
+                           .arg(mg::theme::Colors::CODE_BG, 6, 16, QChar('0')));
+      mainLayout->addWidget(_tabs);
+
       // Create editor
       _editor = new GenericEditor(_centralWidget);
       _editor->setup();
+
+      _findBar = new FindBar(_editor, _centralWidget);
+      mainLayout->addWidget(_findBar);
       mainLayout->addWidget(_editor);
+      setupFindShortcuts();
+
+      _documents = new DocumentManager(_editor, this);
+      connect(_tabs, &QTabBar::currentChanged, this, &CodeEditor::showDocument);
+      connect(_tabs, &QTabBar::tabCloseRequested, this, &CodeEditor::closeTab);
+      connect(_editor, &ScintillaEditBase::savePointChanged, this, &CodeEditor::updateTabTitle);
+      connect(_editor, &ScintillaEdit::modified, this, [this](Scintilla::ModificationFlags type){
+        if (static_cast<int>(type) & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))
+          _documents->edited();
+      });
+
+      connect(_editor, &GenericEditor::largeFileModeChanged, _largeFileButton, &QToolButton::setVisible);
+
+      _loader = new FileLoader(this);
+      connect(_loader, &FileLoader::loaded, this, &CodeEditor::onFileLoaded);
+      connect(_loader, &FileLoader::failed, this, &CodeEditor::onFileLoadFailed);
+      connect(_loader, &FileLoader::progress, this, [this](const QString&, qint64 loaded, qint64 total){
+        _loadProgress->setValue(static_cast<int>(loaded * 100 / std::max<qint64>(1, total)));
+      });
       
       // Connect actions
       connectActions();
@@ -140,6 +422,62 @@ namespace aic
       _centralWidget->setLayout(mainLayout);
     }
     
+    // Shown in large-file mode, its menu turns the degraded features back on one by one
+    void setupLargeFileIndicator(QWidget* parent)
+    {
+      _largeFileButton = new QToolButton(parent);
+      _largeFileButton->setText(tr("Large file mode"));
+      _largeFileButton->setToolTip(tr("Some features are off to keep this file responsive"));
+      _largeFileButton->setPopupMode(QToolButton::InstantPopup);
+      _largeFileButton->setStyleSheet(QString("QToolButton { color: #%1; border: 1px solid #%1; border-radius: 4px; padding: 3px 8px; }")
+                                      .arg(mg::theme::Colors::WARNING, 6, 16, QChar('0')));
+
+      auto menu = new QMenu(_largeFileButton);
+      const std::pair<GenericEditor::Feature, QString> features[] = {
+        {GenericEditor::Feature::Highlighting, tr("Syntax highlighting")},
+        {GenericEditor::Feature::Wrap, tr("Word wrap")},
+        {GenericEditor::Feature::IndentationGuides, tr("Indentation guides")},
+        {GenericEditor::Feature::CaretLine, tr("Caret line highlight")},
+        {GenericEditor::Feature::Folding, tr("Folding")},
+      };
+
+      for (const auto& [feature, name] : features) {
+        auto action = menu->addAction(name);
+        action->setCheckable(true);
+        connect(action, &QAction::toggled, this, [this, feature = feature](bool enabled){
+          _editor->setFeatureEnabled(feature, enabled);
+        });
+      }
+
+      // the menu reflects the features of the file shown when it opens
+      connect(menu, &QMenu::aboutToShow, this, [this, menu, features](){
+        auto actions = menu->actions();
+        for (int i = 0; i < actions.size(); ++i) {
+          QSignalBlocker blocker(actions[i]);
+          actions[i]->setChecked(_editor->isFeatureEnabled(features[i].first));
+        }
+      });
+
+      _largeFileButton->setMenu(menu);
+      _largeFileButton->hide();
+    }
+
+    void setupFindShortcuts()
+    {
+      const std::pair<QKeySequence, std::function<void()>> shortcuts[] = {
+        {QKeySequence::Find, [this](){ _findBar->showFind(false); }},
+        {QKeySequence::Replace, [this](){ _findBar->showFind(true); }},
+        {QKeySequence::FindNext, [this](){ _findBar->findNext(); }},
+        {QKeySequence::FindPrevious, [this](){ _findBar->findPrevious(); }},
+      };
+
+      for (const auto& [keys, action] : shortcuts) {
+        auto shortcut = new QShortcut(keys, _centralWidget);
+        shortcut->setContext(Qt::WidgetWithChildrenShortcut);
+        connect(shortcut, &QShortcut::activated, this, action);
+      }
+    }
+
     void updateActions() {}
 
     void setupActions()
@@ -150,6 +488,14 @@ namespace aic
     void connectActions(){}
 
     GenericEditor* _editor{nullptr};
+    QTabBar* _tabs{nullptr};
+    DocumentManager* _documents{nullptr};
+    FileLoader* _loader{nullptr};
+    FindBar* _findBar{nullptr};
+    SaveService* _saveService{nullptr};
+    std::pair<QString, int> _pendingLine{QString(), -1};
+    QProgressBar* _loadProgress{nullptr};
+    QToolButton* _largeFileButton{nullptr};
     QWidget* _centralWidget{nullptr};
     QString _currentFilePath;
     QLabel* _fileNameLabel{nullptr};
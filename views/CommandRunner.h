@@ -0,0 +1,318 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_COMMANDRUNNER_H
+#define QWIDGET_LUA_EDITOR_COMMANDRUNNER_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QPointer>
+#include <QProcess>
+#include <QString>
+#include <QTimer>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <map>
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <unistd.h>
+#endif
+
+namespace aic
+{
+
+  // Keeps the first and the last bytes of an output that can grow without bound, what
+  // falls in between is only counted
+  class HeadTailBuffer
+  {
+  public:
+    explicit HeadTailBuffer(int headBytes = 16 * 1024, int tailBytes = 16 * 1024)
+        : _headBytes(headBytes), _tailBytes(tailBytes){}
+
+    void append(const QByteArray& data)
+    {
+      _total += data.size();
+
+      int taken = 0;
+      if (_head.size() < _headBytes) {
+        taken = std::min(static_cast<int>(data.size()), _headBytes - static_cast<int>(_head.size()));
+        _head.append(data.constData(), taken);
+      }
+
+      // trimmed in batches, not on every chunk
+      _tail.append(data.constData() + taken, data.size() - taken);
+      if (_tail.size() > 2 * _tailBytes)
+        _tail.remove(0, _tail.size() - _tailBytes);
+    }
+
+    qint64 totalBytes() const
+    {
+      return _total;
+    }
+
+    QString text() const
+    {
+      const QByteArray tail = _tail.size() > _tailBytes ? _tail.right(_tailBytes) : _tail;
+      const qint64 omitted = _total - _head.size() - tail.size();
+      if (omitted <= 0)
+        return QString::fromUtf8(_head + tail);
+
+      return QString::fromUtf8(_head) + QString("\n... [%1 bytes omitted] ...\n").arg(omitted) + QString::fromUtf8(tail);
+    }
+
+  private:
+    int _headBytes;
+    int _tailBytes;
+    QByteArray _head;
+    QByteArray _tail;
+    qint64 _total{0};
+  };
+
+  // Runs shell commands for the agent without blocking the GUI thread: output is read as it
+  // arrives (and streamed through output()), several commands run at once, each one is
+  // killed when it outlives its timeout. What is kept of stdout and stderr is capped by a
+  // HeadTailBuffer, so a command printing gigabytes ends as a short observation.
+  class CommandRunner : public QObject
+  {
+  Q_OBJECT
+
+  public:
+    static constexpr int MaxRunning = 4;
+
+    struct Options
+    {
+      QString workingDirectory;
+      int timeoutMs{120000};
+    };
+
+    struct Result
+    {
+      int id{0};
+      QString command;
+      int exitCode{-1};
+      bool timedOut{false};
+      bool killed{false};
+      bool failedToStart{false};
+      QString output;         // stdout, head and tail
+      QString errorOutput;    // stderr, head and tail
+      qint64 outputBytes{0};
+      qint64 errorBytes{0};
+    };
+
+    // Called on the GUI thread once the command is over, whatever the reason
+    using Callback = std::function<void(const Result& result)>;
+
+    explicit CommandRunner(QObject* parent = nullptr): QObject(parent){}
+
+    ~CommandRunner() override
+    {
+      _queue.clear();
+      for (auto& [id, command] : _running) {
+        command.process->disconnect(this);
+        sendSignal(command.process, true);
+        command.process->waitForFinished(1000);
+      }
+    }
+
+    // Returns the id of the command, it waits for a slot when MaxRunning are running
+    int run(const QString& command, const Options& options, Callback done)
+    {
+      const int id = ++_lastId;
+      _queue.push_back({id, command, options, std::move(done)});
+      startQueued();
+      return id;
+    }
+
+    // Terminates the command, and kills it if it does not exit within a couple of seconds
+    void kill(int id)
+    {
+      for (auto it = _queue.begin(); it != _queue.end(); ++it) {
+        if (it->id == id) {
+          Result result;
+          result.id = id;
+          result.command = it->command;
+          result.killed = true;
+          auto done = std::move(it->done);
+          _queue.erase(it);
+          if (done)
+            done(result);
+          return;
+        }
+      }
+
+      auto it = _running.find(id);
+      if (it == _running.end())
+        return;
+
+      it->second.result.killed = true;
+      stop(it->second.process);
+    }
+
+    void killAll()
+    {
+      while (!_queue.empty())
+        kill(_queue.front().id);
+      for (auto& [id, command] : _running)
+        kill(id);
+    }
+
+    bool isRunning(int id) const
+    {
+      return _running.count(id) > 0;
+    }
+
+  signals:
+    void started(int id, const QString& command);
+
+    // A chunk of output as it arrives, isError for stderr
+    void output(int id, const QByteArray& chunk, bool isError);
+
+    void finished(int id, int exitCode);
+
+  private:
+    struct Queued
+    {
+      int id;
+      QString command;
+      Options options;
+      Callback done;
+    };
+
+    struct Running
+    {
+      QProcess* process{nullptr};
+      QTimer* timer{nullptr};
+      HeadTailBuffer output;
+      HeadTailBuffer errorOutput;
+      Result result;
+      Callback done;
+    };
+
+    void startQueued()
+    {
+      while (!_queue.empty() && static_cast<int>(_running.size()) < MaxRunning) {
+        Queued next = std::move(_queue.front());
+        _queue.pop_front();
+        start(std::move(next));
+      }
+    }
+
+    void start(Queued queued)
+    {
+      const int id = queued.id;
+      auto process = new QProcess(this);
+      if (!queued.options.workingDirectory.isEmpty())
+        process->setWorkingDirectory(queued.options.workingDirectory);
+
+#ifdef Q_OS_UNIX
+      // its own process group, so what the shell spawned dies with it
+      process->setChildProcessModifier([](){ ::setpgid(0, 0); });
+#endif
+
+      auto& running = _running[id];
+      running.process = process;
+      running.result.id = id;
+      running.result.command = queued.command;
+      running.done = std::move(queued.done);
+
+      connect(process, &QProcess::readyReadStandardOutput, this, [this, id, process](){
+        QByteArray chunk = process->readAllStandardOutput();
+        _running[id].output.append(chunk);
+        emit output(id, chunk, false);
+      });
+      connect(process, &QProcess::readyReadStandardError, this, [this, id, process](){
+        QByteArray chunk = process->readAllStandardError();
+        _running[id].errorOutput.append(chunk);
+        emit output(id, chunk, true);
+      });
+      connect(process, &QProcess::finished, this, [this, id](int exitCode, QProcess::ExitStatus){
+        complete(id, exitCode);
+      });
+      connect(process, &QProcess::errorOccurred, this, [this, id](QProcess::ProcessError error){
+        if (error == QProcess::FailedToStart) {
+          _running[id].result.failedToStart = true;
+          complete(id, -1);
+        }
+      });
+
+      if (queued.options.timeoutMs > 0) {
+        running.timer = new QTimer(process);
+        running.timer->setSingleShot(true);
+        connect(running.timer, &QTimer::timeout, this, [this, id](){
+          auto it = _running.find(id);
+          if (it == _running.end())
+            return;
+          it->second.result.timedOut = true;
+          stop(it->second.process);
+        });
+        running.timer->start(queued.options.timeoutMs);
+      }
+
+      emit started(id, queued.command);
+      process->start("bash", QStringList() << "-c" << queued.command);
+    }
+
+    // SIGTERM first, SIGKILL when it is ignored
+    void stop(QProcess* process)
+    {
+      sendSignal(process, false);
+      QPointer<QProcess> guard(process);
+      QTimer::singleShot(2000, this, [guard](){
+        if (guard && guard->state() != QProcess::NotRunning)
+          sendSignal(guard, true);
+      });
+    }
+
+    static void sendSignal(QProcess* process, bool force)
+    {
+#ifdef Q_OS_UNIX
+      if (process->processId() > 0) {
+        ::kill(-static_cast<pid_t>(process->processId()), force ? SIGKILL : SIGTERM);
+        return;
+      }
+#endif
+      if (force)
+        process->kill();
+      else
+        process->terminate();
+    }
+
+    void complete(int id, int exitCode)
+    {
+      auto it = _running.find(id);
+      if (it == _running.end())
+        return;
+
+      Running running = std::move(it->second);
+      _running.erase(it);
+
+      // what is left in the pipes
+      running.output.append(running.process->readAllStandardOutput());
+      running.errorOutput.append(running.process->readAllStandardError());
+
+      Result result = std::move(running.result);
+      result.exitCode = exitCode;
+      result.output = running.output.text();
+      result.errorOutput = running.errorOutput.text();
+      result.outputBytes = running.output.totalBytes();
+      result.errorBytes = running.errorOutput.totalBytes();
+
+      running.process->disconnect(this);
+      running.process->deleteLater();
+
+      emit finished(id, exitCode);
+      if (running.done)
+        running.done(result);
+
+      startQueued();
+    }
+
+    int _lastId{0};
+    std::deque<Queued> _queue;
+    std::map<int, Running> _running;
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_COMMANDRUNNER_H
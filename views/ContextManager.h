@@ -0,0 +1,276 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_CONTEXTMANAGER_H
+#define QWIDGET_LUA_EDITOR_CONTEXTMANAGER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace aic
+{
+
+  // The conversation sent to the model, kept within a token budget. A request over the budget
+  // has its history compacted, in this order and each step only while it is still over:
+  //   1. observations above a size, oldest first, are cut to their head and tail with a note
+  //      saying so; the observations of the latest turn are never cut;
+  //   2. a file viewed again replaces its earlier views, which become a one-line note;
+  //   3. the oldest turns are folded into a short summary.
+  // Compaction edits the history itself, so what was sent once is sent the same way next
+  // time and only new messages change the request.
+  class ContextManager
+  {
+  public:
+    enum class Role { User, Assistant, Observation };
+
+    struct Message
+    {
+      Role role;
+      std::string text;
+      int turn;               // one turn per model answer
+      int tokens;
+    };
+
+    struct Options
+    {
+      int budgetTokens{32000};
+      int maxObservationTokens{2000};
+      int keepRecentTurns{3};        // never summarised
+    };
+
+    void setOptions(const Options& options)
+    {
+      _options = options;
+    }
+
+    const Options& options() const
+    {
+      return _options;
+    }
+
+    void addUser(std::string text)
+    {
+      add(Role::User, std::move(text));
+    }
+
+    // Ends the turn, what follows belongs to the next answer
+    void addAssistant(std::string text)
+    {
+      add(Role::Assistant, std::move(text));
+      ++_turn;
+    }
+
+    void addObservation(std::string text)
+    {
+      add(Role::Observation, std::move(text));
+    }
+
+    // Rough count, close enough for a budget: a token is about four bytes of text
+    static int estimateTokens(std::string_view text)
+    {
+      return static_cast<int>((text.size() + 3) / 4) + 4;
+    }
+
+    int totalTokens() const
+    {
+      int total = 0;
+      for (const auto& message : _messages)
+        total += message.tokens;
+      return total;
+    }
+
+    // Compacts the history for the next request if it is over the budget, and returns it
+    const std::vector<Message>& compacted()
+    {
+      if (totalTokens() > _options.budgetTokens)
+        truncateObservations();
+      if (totalTokens() > _options.budgetTokens)
+        dedupeFileViews();
+      if (totalTokens() > _options.budgetTokens)
+        summariseOldTurns();
+      return _messages;
+    }
+
+    void clear()
+    {
+      _messages.clear();
+      _turn = 0;
+    }
+
+  private:
+    void add(Role role, std::string text)
+    {
+      const int tokens = estimateTokens(text);
+      _messages.push_back({role, std::move(text), _turn, tokens});
+    }
+
+    void setText(Message& message, std::string text)
+    {
+      message.text = std::move(text);
+      message.tokens = estimateTokens(message.text);
+    }
+
+    // What is between <tag> and </tag>, empty if it is not there
+    static std::string_view tagged(std::string_view text, std::string_view tag)
+    {
+      const std::string open = "<" + std::string(tag) + ">";
+      const std::string close = "</" + std::string(tag) + ">";
+      const auto begin = text.find(open);
+      if (begin == std::string_view::npos)
+        return {};
+      const auto end = text.find(close, begin + open.size());
+      if (end == std::string_view::npos)
+        return {};
+      return text.substr(begin + open.size(), end - begin - open.size());
+    }
+
+    // The file of a view_file observation, empty for anything else
+    static std::string_view viewedFile(std::string_view text)
+    {
+      if (tagged(text, "action") != "view_file")
+        return {};
+
+      const std::string_view marker = "Conteúdo do arquivo: ";
+      const auto begin = text.find(marker);
+      if (begin == std::string_view::npos)
+        return {};
+      const auto end = text.find('\n', begin);
+      if (end == std::string_view::npos)
+        return {};
+      return text.substr(begin + marker.size(), end - begin - marker.size());
+    }
+
+    // Moves back to the start of a UTF-8 sequence
+    static size_t boundary(std::string_view text, size_t at)
+    {
+      while (at > 0 && at < text.size() && (static_cast<unsigned char>(text[at]) & 0xC0) == 0x80)
+        --at;
+      return at;
+    }
+
+    // The model must know a cut result is not the file: edit_file writes what it is given
+    // as the whole content
+    void truncateObservations()
+    {
+      const size_t maxBytes = static_cast<size_t>(_options.maxObservationTokens) * 4;
+      int total = totalTokens();
+      for (auto& message : _messages) {
+        if (total <= _options.budgetTokens)
+          return;
+        if (message.role != Role::Observation || message.turn >= _turn || message.text.size() <= maxBytes)
+          continue;
+
+        // the tail keeps the closing tags and, for commands, how they ended
+        const std::string_view text = message.text;
+        const size_t head = boundary(text, maxBytes * 2 / 3);
+        const size_t tail = boundary(text, text.size() - maxBytes / 3);
+        total -= message.tokens;
+        setText(message, std::string(text.substr(0, head)) + "\n... [" + std::to_string(tail - head) +
+                         " bytes omitted to save context. This result is incomplete: run the action again to see"
+                         " all of it, and view a file again before rewriting it.] ...\n" + std::string(text.substr(tail)));
+        total += message.tokens;
+      }
+    }
+
+    void dedupeFileViews()
+    {
+      std::unordered_map<std::string, size_t> latest;
+      for (size_t i = 0; i < _messages.size(); ++i) {
+        if (_messages[i].role != Role::Observation)
+          continue;
+
+        const auto file = viewedFile(_messages[i].text);
+        if (file.empty())
+          continue;
+
+        auto [it, inserted] = latest.try_emplace(std::string(file), i);
+        if (!inserted) {
+          setText(_messages[it->second], "<observation><action>view_file</action><result>" + it->first +
+                                         ": viewed again later, see the latest view.</result></observation>");
+          it->second = i;
+        }
+      }
+    }
+
+    // One line for the turn: what was asked, what the answer started with and the actions
+    // it ran
+    std::string summarise(size_t begin, size_t end) const
+    {
+      auto firstLine = [](std::string_view text, size_t limit){
+        const auto newline = text.find('\n');
+        std::string line(text.substr(0, std::min(newline, limit)));
+        if (line.size() < text.size())
+          line += "...";
+        return line;
+      };
+
+      std::string request;
+      std::string answer;
+      std::vector<std::string> actions;
+      for (size_t i = begin; i < end; ++i) {
+        const auto& message = _messages[i];
+        if (message.role == Role::User && request.empty())
+          request = firstLine(message.text, 200);
+        else if (message.role == Role::Assistant && answer.empty())
+          answer = firstLine(message.text, 200);
+        else if (message.role == Role::Observation) {
+          const auto action = tagged(message.text, "action");
+          if (!action.empty() && std::find(actions.begin(), actions.end(), action) == actions.end())
+            actions.emplace_back(action);
+        }
+      }
+
+      std::string summary = "[Earlier turn, summarised]";
+      if (!request.empty())
+        summary += " Request: " + request;
+      if (!answer.empty())
+        summary += " Answer: " + answer;
+      if (!actions.empty()) {
+        summary += " Actions:";
+        for (const auto& action : actions)
+          summary += " " + action;
+      }
+      return summary;
+    }
+
+    // Folds the oldest turns, one at a time, into an assistant message each. The first user
+    // message is the task and stays as it was.
+    void summariseOldTurns()
+    {
+      const int lastSummarised = _turn - _options.keepRecentTurns;
+      size_t begin = !_messages.empty() && _messages.front().role == Role::User ? 1 : 0;
+
+      while (begin < _messages.size() && totalTokens() > _options.budgetTokens) {
+        const int turn = _messages[begin].turn;
+        if (turn >= lastSummarised)
+          break;
+
+        size_t end = begin;
+        while (end < _messages.size() && _messages[end].turn == turn)
+          ++end;
+
+        // a single summary already, nothing left to fold
+        if (end - begin == 1 && _messages[begin].text.rfind("[Earlier turn", 0) == 0) {
+          begin = end;
+          continue;
+        }
+
+        Message summary{Role::Assistant, summarise(begin, end), turn, 0};
+        summary.tokens = estimateTokens(summary.text);
+        _messages.erase(_messages.begin() + static_cast<std::ptrdiff_t>(begin) + 1, _messages.begin() + static_cast<std::ptrdiff_t>(end));
+        _messages[begin] = std::move(summary);
+        ++begin;
+      }
+    }
+
+    Options _options;
+    std::vector<Message> _messages;
+    int _turn{0};
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_CONTEXTMANAGER_H
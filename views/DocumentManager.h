@@ -0,0 +1,242 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_DOCUMENTMANAGER_H
+#define QWIDGET_LUA_EDITOR_DOCUMENTMANAGER_H
+
+#include "ScintillaEdit.h"
+#include "IdentifierIndex.h"
+#include <QObject>
+#include <QString>
+#include <memory>
+#include <vector>
+
+namespace aic
+{
+
+  // Keeps one Scintilla document per open file and switches the view between them with
+  // SCI_SETDOCPOINTER, so text, styling, undo history and read-only state survive a switch.
+  // The manager holds one reference per loaded document, the view holds another on the
+  // one it shows. Documents not shown are released least recently used first once their
+  // size goes over the budget, modified ones are never released.
+  class DocumentManager : public QObject
+  {
+  Q_OBJECT
+
+  public:
+    struct Document
+    {
+      QString path;
+      void* handle{nullptr};   // null until loaded or once released
+      qint64 bytes{0};
+      bool modified{false};
+      quint64 edits{0};              // text changes seen in the view, tells a save it went stale
+      bool savePointPending{false};  // saved while another document was shown
+      quint64 lastUse{0};
+      sptr_t firstLine{0};
+      sptr_t caret{0};
+      std::shared_ptr<mg::IdentifierIndex> identifiers;  // completions, built from the text once loaded
+    };
+
+    inline static qint64 memoryBudget = 512 * 1024 * 1024;
+
+    explicit DocumentManager(ScintillaEdit* view, QObject* parent = nullptr): QObject(parent), _view(view){}
+
+    int count() const
+    {
+      return static_cast<int>(_documents.size());
+    }
+
+    const Document& at(int index) const
+    {
+      return _documents[index];
+    }
+
+    int current() const
+    {
+      return _current;
+    }
+
+    int indexOf(const QString& path) const
+    {
+      for (int i = 0; i < count(); ++i)
+        if (_documents[i].path == path)
+          return i;
+      return -1;
+    }
+
+    int add(const QString& path, qint64 bytes)
+    {
+      Document document;
+      document.path = path;
+      document.bytes = bytes;
+      _documents.push_back(document);
+      return count() - 1;
+    }
+
+    // Shows the document in the view. Returns false when it still has to be loaded, the
+    // view then shows a fresh empty document to receive a preview.
+    bool activate(int index)
+    {
+      remember();
+      _current = index;
+
+      if (index < 0 || index >= count()) {
+        _current = -1;
+        _view->send(SCI_SETDOCPOINTER, 0, 0);
+        return false;
+      }
+
+      auto& document = _documents[index];
+      document.lastUse = ++_clock;
+
+      if (!document.handle) {
+        _view->send(SCI_SETDOCPOINTER, 0, 0);
+        return false;
+      }
+
+      _view->send(SCI_SETDOCPOINTER, 0, reinterpret_cast<sptr_t>(document.handle));
+      if (document.savePointPending) {
+        _view->send(SCI_SETSAVEPOINT);
+        document.savePointPending = false;
+      }
+      _view->send(SCI_GOTOPOS, document.caret);
+      _view->send(SCI_SETFIRSTVISIBLELINE, document.firstLine);
+      release();
+      return true;
+    }
+
+    // Takes the reference of a document loaded for path. Returns true if it is the current
+    // document and went to the view.
+    bool attach(const QString& path, void* handle, qint64 bytes)
+    {
+      int index = indexOf(path);
+      if (index < 0 || _documents[index].handle) {
+        // closed while loading
+        _view->send(SCI_RELEASEDOCUMENT, 0, reinterpret_cast<sptr_t>(handle));
+        return false;
+      }
+
+      auto& document = _documents[index];
+      document.handle = handle;
+      document.bytes = bytes;
+      document.modified = false;
+      document.identifiers = std::make_shared<mg::IdentifierIndex>();
+
+      bool shown = index == _current;
+      if (shown)
+        _view->send(SCI_SETDOCPOINTER, 0, reinterpret_cast<sptr_t>(handle));
+
+      release();
+      return shown;
+    }
+
+    // Counts a text change of the current document
+    void edited()
+    {
+      if (_current >= 0 && _current < count())
+        ++_documents[_current].edits;
+    }
+
+    // A snapshot taken when the document had seen edits changes reached the disk. Marks the
+    // document unmodified unless it was edited since, returns whether it did.
+    bool saved(int index, quint64 edits)
+    {
+      if (index < 0 || index >= count() || _documents[index].edits != edits)
+        return false;
+
+      auto& document = _documents[index];
+      if (index == _current) {
+        _view->send(SCI_SETSAVEPOINT);
+      }
+      else {
+        // the view only reaches the document it shows, the save point is set when it comes back
+        document.modified = false;
+        document.savePointPending = document.handle != nullptr;
+      }
+      return true;
+    }
+
+    // Drops the document, the caller activates another one afterwards
+    void close(int index)
+    {
+      if (index < 0 || index >= count())
+        return;
+
+      if (index == _current) {
+        _view->send(SCI_SETDOCPOINTER, 0, 0);
+        _current = -1;
+      }
+      else if (index < _current) {
+        --_current;
+      }
+
+      if (_documents[index].handle)
+        _view->send(SCI_RELEASEDOCUMENT, 0, reinterpret_cast<sptr_t>(_documents[index].handle));
+
+      _documents.erase(_documents.begin() + index);
+    }
+
+    // Must run while the view is still alive, the references can only be dropped through it
+    void closeAll()
+    {
+      _view->send(SCI_SETDOCPOINTER, 0, 0);
+      for (auto& document : _documents)
+        if (document.handle)
+          _view->send(SCI_RELEASEDOCUMENT, 0, reinterpret_cast<sptr_t>(document.handle));
+
+      _documents.clear();
+      _current = -1;
+    }
+
+  private:
+    // Saves what the view knows about the current document before it goes away
+    void remember()
+    {
+      if (_current < 0 || _current >= count() || !_documents[_current].handle)
+        return;
+
+      auto& document = _documents[_current];
+      document.firstLine = _view->send(SCI_GETFIRSTVISIBLELINE);
+      document.caret = _view->send(SCI_GETCURRENTPOS);
+      document.modified = _view->send(SCI_GETMODIFY);
+      document.bytes = _view->send(SCI_GETLENGTH);
+    }
+
+    void release()
+    {
+      qint64 total = 0;
+      for (const auto& document : _documents)
+        if (document.handle)
+          total += document.bytes;
+
+      while (total > memoryBudget) {
+        Document* oldest = nullptr;
+        for (int i = 0; i < count(); ++i) {
+          auto& document = _documents[i];
+          if (i == _current || !document.handle || document.modified)
+            continue;
+          if (!oldest || document.lastUse < oldest->lastUse)
+            oldest = &document;
+        }
+
+        if (!oldest)
+          return;
+
+        // reloaded from disk when its tab is shown again
+        _view->send(SCI_RELEASEDOCUMENT, 0, reinterpret_cast<sptr_t>(oldest->handle));
+        oldest->handle = nullptr;
+        oldest->savePointPending = false;
+        oldest->identifiers.reset();
+        total -= oldest->bytes;
+      }
+    }
+
+    ScintillaEdit* _view{nullptr};
+    std::vector<Document> _documents;
+    int _current{-1};
+    quint64 _clock{0};
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_DOCUMENTMANAGER_H
@@ -17,7 +17,11 @@
 #include <QFileInfo>
 #include <QLineEdit>
 #include <QProcess>
+#include <QListWidget>
+#include <QTimer>
 #include "MgStyles.h"
+#include "TrigramIndex.h"
+#include "WorkspaceSearch.h"
 #include "MagiaTheme.h"
 
 class FileExplorerWidget : public QWidget
@@ -37,6 +41,15 @@ public:
       _treeView->setRootIndex(index);
       _currentPath = path;
     }
+
+    if (_trigramIndex)
+      _trigramIndex->open(path);
+  }
+
+  // Answers the search box from the index of the root, when it is built already
+  void setTrigramIndex(aic::TrigramIndex* index)
+  {
+    _trigramIndex = index;
   }
 
 private:
@@ -124,6 +137,7 @@ private:
                                     .arg(mg::theme::Colors::DEFAULT_TEXT, 6, 16, QChar('0'))
                                     .arg(mg::theme::Colors::COMMENT, 6, 16, QChar('0')));
     searchLayout->addWidget(searchInput);
+    _searchInput = searchInput;
     
     headerLayout->addWidget(searchContainer);
     
@@ -175,6 +189,8 @@ private:
 
     mainLayout->addWidget(_treeView);
 
+    setupSearch(mainLayout);
+
     // Conexões de sinais
     connect(_treeView, &QTreeView::doubleClicked,
             this, &FileExplorerWidget::onItemDoubleClicked);
@@ -182,6 +198,102 @@ private:
     setLayout(mainLayout);
   }
 
+  // Typing in the search box searches the contents of every file under the root, the
+  // results replace the tree while there is a query
+  void setupSearch(QVBoxLayout* layout)
+  {
+    _searchResults = new QListWidget(this);
+    _searchResults->setStyleSheet(
+        QString("QListWidget { background-color: #%1; color: #%2; border: none; font-family: 'JetBrains Mono', monospace; padding: 8px; }"
+                "QListWidget::item:hover { background: #%3; border-radius: 4px; }"
+                "QListWidget::item:selected { background: #%4; border-radius: 4px; }")
+                .arg(mg::theme::Colors::BACKGROUND, 6, 16, QChar('0'))
+                .arg(mg::theme::Colors::DEFAULT_TEXT, 6, 16, QChar('0'))
+                .arg(mg::theme::Colors::ACTIVE_ITEM, 6, 16, QChar('0'))
+                .arg(mg::theme::Colors::PRIMARY, 6, 16, QChar('0')));
+    _searchResults->setUniformItemSizes(true);
+    _searchResults->hide();
+    layout->addWidget(_searchResults);
+
+    _searchStatus = new QLabel(this);
+    _searchStatus->setStyleSheet(QString("QLabel { color: #%1; padding: 4px 12px; }")
+                                 .arg(mg::theme::Colors::COMMENT, 6, 16, QChar('0')));
+    _searchStatus->hide();
+    layout->addWidget(_searchStatus);
+
+    _search = new aic::WorkspaceSearch(this);
+
+    // waits for the typing to pause, every search starts over the whole tree
+    _searchTimer = new QTimer(this);
+    _searchTimer->setSingleShot(true);
+    _searchTimer->setInterval(300);
+
+    connect(_searchInput, &QLineEdit::textChanged, this, [this](const QString& text) {
+      const bool searching = !text.isEmpty();
+      _treeView->setVisible(!searching);
+      _searchResults->setVisible(searching);
+      _searchStatus->setVisible(searching);
+
+      if (!searching) {
+        _searchTimer->stop();
+        _search->cancel();
+        _searchResults->clear();
+        return;
+      }
+      _searchTimer->start();
+    });
+    connect(_searchInput, &QLineEdit::returnPressed, this, &FileExplorerWidget::runSearch);
+    connect(_searchTimer, &QTimer::timeout, this, &FileExplorerWidget::runSearch);
+
+    connect(_search, &aic::WorkspaceSearch::matchesFound, this, [this](const QVector<aic::SearchMatch>& matches) {
+      const QDir root(_currentPath);
+      for (const auto& match : matches) {
+        auto item = new QListWidgetItem(QString("%1:%2  %3")
+                                        .arg(root.relativeFilePath(match.path))
+                                        .arg(match.line)
+                                        .arg(match.text), _searchResults);
+        item->setData(Qt::UserRole, match.path);
+        item->setData(Qt::UserRole + 1, match.line);
+        item->setToolTip(match.path);
+      }
+      _searchStatus->setText(QString("%1 results...").arg(_searchResults->count()));
+    });
+    connect(_search, &aic::WorkspaceSearch::finished, this, [this](int files, int matches, bool truncated) {
+      _searchStatus->setText(QString("%1%2 results in %3 files")
+                             .arg(matches)
+                             .arg(truncated ? "+" : "")
+                             .arg(files));
+    });
+
+    connect(_searchResults, &QListWidget::itemActivated, this, &FileExplorerWidget::onSearchResultActivated);
+    connect(_searchResults, &QListWidget::itemClicked, this, &FileExplorerWidget::onSearchResultActivated);
+  }
+
+  void runSearch()
+  {
+    _searchTimer->stop();
+    _searchResults->clear();
+
+    const QString text = _searchInput->text();
+    if (text.size() < 2) {
+      _search->cancel();
+      _searchStatus->setText("Type at least 2 characters");
+      return;
+    }
+
+    aic::WorkspaceSearch::Query query;
+    query.text = text;
+    _searchStatus->setText("Searching...");
+
+    // the index narrows the search to the files holding every trigram of the text
+    auto candidates = _trigramIndex ? _trigramIndex->candidates(QByteArray::fromStdString(aic::WorkspaceSearch::prefilterLiteral(query)))
+                                    : std::nullopt;
+    if (candidates)
+      _search->start(*candidates, query);
+    else
+      _search->start(_currentPath, query);
+  }
+
   QString getCurrentPath() const
   {
     QModelIndex index = _treeView->currentIndex();
@@ -279,6 +391,11 @@ private:
   }
 
 private slots:
+  void onSearchResultActivated(QListWidgetItem* item)
+  {
+    emit searchResultSelected(item->data(Qt::UserRole).toString(), item->data(Qt::UserRole + 1).toInt());
+  }
+
   void onItemDoubleClicked(const QModelIndex &index)
   {
     QString filePath = _fileModel->filePath(index);
@@ -369,11 +486,18 @@ private slots:
 signals:
   void fileSelected(const QString &filePath);
   void fileCreated(const QString &filePath);
+  void searchResultSelected(const QString &filePath, int line);
 
 private:
   QTreeView *_treeView{nullptr};
   QFileSystemModel *_fileModel{nullptr};
   QString _currentPath;
+  QLineEdit *_searchInput{nullptr};
+  QListWidget *_searchResults{nullptr};
+  QLabel *_searchStatus{nullptr};
+  QTimer *_searchTimer{nullptr};
+  aic::WorkspaceSearch *_search{nullptr};
+  aic::TrigramIndex *_trigramIndex{nullptr};
   QAction* _newFile;
   QAction* _newFolder;
   QAction* _deleteItem;
@@ -0,0 +1,226 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_FILELOADER_H
+#define QWIDGET_LUA_EDITOR_FILELOADER_H
+
+#include "ScintillaEdit.h"
+#include "ILoader.h"
+#include <QFile>
+#include <QObject>
+#include <QMetaObject>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace aic
+{
+
+  // Loads a file into a new Scintilla document without going through QString. The file is
+  // memory mapped and fed to an ILoader (SCI_CREATELOADER) in chunks from a background
+  // thread, the document only reaches the view once it is complete. Small files are loaded
+  // right away on the calling thread.
+  class FileLoader : public QObject
+  {
+  Q_OBJECT
+
+  public:
+    // Bytes shown by preview() while the rest loads
+    static constexpr qint64 PreviewBytes = 64 * 1024;
+
+    explicit FileLoader(QObject* parent = nullptr): QObject(parent){}
+
+    ~FileLoader() override
+    {
+      cancel();
+    }
+
+    // Starts loading, a load still running is cancelled. Returns false if the file cannot
+    // be mapped, loaded() or failed() follow otherwise.
+    bool load(ScintillaEdit* sci, const QString& filePath, int documentOptions = SC_DOCUMENTOPTION_DEFAULT)
+    {
+      cancel();
+
+      auto job = std::make_shared<Job>();
+      job->path = filePath;
+      job->file.setFileName(filePath);
+
+      if (!job->file.open(QIODevice::ReadOnly)) {
+        emit failed(filePath, job->file.errorString());
+        return false;
+      }
+
+      job->size = job->file.size();
+      if (job->size > 0) {
+        job->data = reinterpret_cast<const char*>(job->file.map(0, job->size));
+        if (!job->data) {
+          emit failed(filePath, job->file.errorString());
+          return false;
+        }
+      }
+
+      // the UTF-8 BOM is not part of the text
+      if (job->size >= 3 && memcmp(job->data, "\xEF\xBB\xBF", 3) == 0)
+        job->offset = 3;
+
+      if (job->size > INT_MAX)
+        documentOptions |= SC_DOCUMENTOPTION_TEXT_LARGE;
+
+      job->loader = reinterpret_cast<Scintilla::ILoader*>(sci->send(SCI_CREATELOADER, job->size, documentOptions));
+      if (!job->loader) {
+        emit failed(filePath, tr("Not enough memory to load the file"));
+        return false;
+      }
+
+      _job = job;
+
+      if (job->size <= SynchronousBytes) {
+        feed(*job);
+        finish(job);
+        return true;
+      }
+
+      // the job is shared with the thread, a cancelled load cleans itself up
+      _thread = std::thread([this, job](){
+        feed(*job);
+        QMetaObject::invokeMethod(this, [this, job](){ finish(job); }, Qt::QueuedConnection);
+      });
+
+      return true;
+    }
+
+    // Stops at the next chunk and waits for the thread, so it never outlives this object
+    void cancel()
+    {
+      if (_job)
+        _job->cancelled = true;
+      _job.reset();
+
+      if (_thread.joinable())
+        _thread.join();
+    }
+
+    bool isLoading() const
+    {
+      return _job != nullptr;
+    }
+
+    // Start of the file cut at the last complete line, shown read only until the load ends
+    static QByteArray preview(const QString& filePath)
+    {
+      QFile file(filePath);
+      if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+      QByteArray head = file.read(PreviewBytes);
+      if (head.startsWith("\xEF\xBB\xBF"))
+        head.remove(0, 3);
+
+      if (file.size() > PreviewBytes) {
+        auto newline = head.lastIndexOf('\n');
+        if (newline >= 0)
+          head.truncate(newline + 1);
+      }
+
+      return head;
+    }
+
+    // SC_EOL_* of the first line ending of the text, LF when there is none
+    static int detectEolMode(const char* data, qint64 size)
+    {
+      if (!data || size <= 0)
+        return SC_EOL_LF;
+
+      auto* newline = static_cast<const char*>(memchr(data, '\n', static_cast<size_t>(std::min<qint64>(size, PreviewBytes))));
+      if (newline)
+        return newline > data && newline[-1] == '\r' ? SC_EOL_CRLF : SC_EOL_LF;
+
+      return memchr(data, '\r', static_cast<size_t>(std::min<qint64>(size, PreviewBytes))) ? SC_EOL_CR : SC_EOL_LF;
+    }
+
+  signals:
+    void progress(const QString& filePath, qint64 loaded, qint64 total);
+
+    // The document has a reference count of one that the receiver owns: set it with
+    // SCI_SETDOCPOINTER and release it with SCI_RELEASEDOCUMENT
+    void loaded(const QString& filePath, void* document, int eolMode);
+
+    void failed(const QString& filePath, const QString& error);
+
+  private:
+    static constexpr qint64 SynchronousBytes = 1024 * 1024;
+    static constexpr qint64 ChunkBytes = 4 * 1024 * 1024;
+
+    struct Job
+    {
+      QString path;
+      QFile file;
+      const char* data{nullptr};
+      qint64 size{0};
+      qint64 offset{0};
+      int status{SC_STATUS_OK};
+      int eolMode{SC_EOL_LF};
+      Scintilla::ILoader* loader{nullptr};
+      std::atomic<bool> cancelled{false};
+
+      ~Job()
+      {
+        // never reached the view, the document is only referenced by the loader
+        if (loader)
+          loader->Release();
+      }
+    };
+
+    // Runs on the loading thread, the ILoader is not attached to any view yet
+    void feed(Job& job)
+    {
+      job.eolMode = detectEolMode(job.data + job.offset, job.size - job.offset);
+
+      int lastPercent = -1;
+      for (qint64 position = job.offset; position < job.size && !job.cancelled; position += ChunkBytes) {
+        qint64 length = std::min(ChunkBytes, job.size - position);
+        job.status = job.loader->AddData(job.data + position, length);
+        if (job.status != SC_STATUS_OK)
+          return;
+
+        int percent = static_cast<int>((position + length) * 100 / job.size);
+        if (percent != lastPercent && job.size > SynchronousBytes) {
+          lastPercent = percent;
+          QMetaObject::invokeMethod(this, [this, path = job.path, loaded = position + length, total = job.size](){
+            emit progress(path, loaded, total);
+          }, Qt::QueuedConnection);
+        }
+      }
+    }
+
+    void finish(const std::shared_ptr<Job>& job)
+    {
+      // superseded by another load, the job releases its loader
+      if (job->cancelled || job != _job)
+        return;
+
+      _job.reset();
+
+      // the thread posted this as its last step
+      if (_thread.joinable())
+        _thread.join();
+
+      if (job->status != SC_STATUS_OK) {
+        emit failed(job->path, tr("Not enough memory to load the file"));
+        return;
+      }
+
+      void* document = job->loader->ConvertToDocument();
+      job->loader = nullptr;
+      emit loaded(job->path, document, job->eolMode);
+    }
+
+    std::shared_ptr<Job> _job;
+    std::thread _thread;
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_FILELOADER_H
@@ -0,0 +1,231 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_FINDBAR_H
+#define QWIDGET_LUA_EDITOR_FINDBAR_H
+
+#include "SearchEngine.h"
+#include "MagiaTheme.h"
+#include <QApplication>
+#include <QHBoxLayout>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QLineEdit>
+#include <QToolButton>
+#include <QVBoxLayout>
+#include <QWidget>
+
+namespace aic
+{
+
+  // Find and replace bar shown above the editor (Ctrl+F, Ctrl+H), all the work is done by
+  // its SearchEngine
+  class FindBar : public QWidget
+  {
+  Q_OBJECT
+
+  public:
+    explicit FindBar(ScintillaEdit* view, QWidget* parent = nullptr): QWidget(parent), _view(view)
+    {
+      _engine = new SearchEngine(view, this);
+      setupUI();
+      hide();
+    }
+
+    SearchEngine* engine() const
+    {
+      return _engine;
+    }
+
+    void showFind(bool withReplace)
+    {
+      _replaceRow->setVisible(withReplace);
+
+      // the selection is the natural query when it fits on one line
+      auto selection = QString::fromUtf8(_view->getSelText());
+      if (!selection.isEmpty() && !selection.contains('\n'))
+        _findEdit->setText(selection);
+
+      show();
+      _findEdit->setFocus();
+      _findEdit->selectAll();
+      updateQuery(false);
+    }
+
+    // The view switched documents, the count belongs to the old one
+    void documentChanged()
+    {
+      if (isVisible())
+        _engine->restart();
+    }
+
+    void findNext()
+    {
+      _engine->findNext(true);
+      updateCount();
+    }
+
+    void findPrevious()
+    {
+      _engine->findNext(false);
+      updateCount();
+    }
+
+  protected:
+    void keyPressEvent(QKeyEvent* event) override
+    {
+      if (event->key() == Qt::Key_Escape) {
+        closeBar();
+        return;
+      }
+
+      QWidget::keyPressEvent(event);
+    }
+
+  private:
+    void closeBar()
+    {
+      hide();
+
+      // clears the highlights
+      _engine->setQuery({});
+      _view->setFocus();
+    }
+
+    void updateQuery(bool jump)
+    {
+      SearchEngine::Query query;
+      query.text = _findEdit->text().toUtf8();
+      query.matchCase = _matchCase->isChecked();
+      query.wholeWord = _wholeWord->isChecked();
+      query.regex = _regex->isChecked();
+      _engine->setQuery(query);
+
+      // follows the typing from where the match started, without reading the whole
+      // document while the count is still going
+      if (jump)
+        _engine->findAsTyped();
+
+      updateCount();
+    }
+
+    void updateCount()
+    {
+      if (_engine->query().text.isEmpty()) {
+        _countLabel->clear();
+        return;
+      }
+
+      const qint64 count = _engine->count();
+      const QString total = _engine->isComplete() ? QString::number(count) : tr("%1+").arg(count);
+      const qint64 current = _engine->currentMatch();
+
+      if (count == 0 && _engine->isComplete())
+        _countLabel->setText(tr("No results"));
+      else if (current >= 0)
+        _countLabel->setText(tr("%1 of %2").arg(current + 1).arg(total));
+      else
+        _countLabel->setText(tr("%1 results").arg(total));
+    }
+
+    QToolButton* addButton(QHBoxLayout* layout, const QString& text, const QString& toolTip, bool checkable = false)
+    {
+      auto button = new QToolButton(this);
+      button->setText(text);
+      button->setToolTip(toolTip);
+      button->setCheckable(checkable);
+      button->setAutoRaise(true);
+      layout->addWidget(button);
+      return button;
+    }
+
+    void setupUI()
+    {
+      setStyleSheet(QString("QWidget { background-color: #%1; color: #%2; }"
+                            "QLineEdit { background-color: #%3; border: 1px solid #%4; border-radius: 3px; padding: 2px 4px; }"
+                            "QToolButton:checked { background-color: #%4; }")
+                    .arg(mg::theme::Colors::SIDEBAR_BG, 6, 16, QChar('0'))
+                    .arg(mg::theme::Colors::DEFAULT_TEXT, 6, 16, QChar('0'))
+                    .arg(mg::theme::Colors::CODE_BG, 6, 16, QChar('0'))
+                    .arg(mg::theme::Colors::BORDER, 6, 16, QChar('0')));
+
+      auto layout = new QVBoxLayout(this);
+      layout->setContentsMargins(8, 4, 8, 4);
+      layout->setSpacing(4);
+
+      auto findRow = new QHBoxLayout();
+      _findEdit = new QLineEdit(this);
+      _findEdit->setPlaceholderText(tr("Find"));
+      findRow->addWidget(_findEdit, 1);
+
+      _matchCase = addButton(findRow, "Aa", tr("Match case"), true);
+      _wholeWord = addButton(findRow, "W", tr("Whole word"), true);
+      _regex = addButton(findRow, ".*", tr("Regular expression"), true);
+
+      _countLabel = new QLabel(this);
+      _countLabel->setMinimumWidth(90);
+      findRow->addWidget(_countLabel);
+
+      auto previous = addButton(findRow, "↑", tr("Previous match (Shift+F3)"));
+      auto next = addButton(findRow, "↓", tr("Next match (F3)"));
+      auto close = addButton(findRow, "✕", tr("Close (Esc)"));
+      layout->addLayout(findRow);
+
+      _replaceRow = new QWidget(this);
+      auto replaceRow = new QHBoxLayout(_replaceRow);
+      replaceRow->setContentsMargins(0, 0, 0, 0);
+      _replaceEdit = new QLineEdit(_replaceRow);
+      _replaceEdit->setPlaceholderText(tr("Replace"));
+      replaceRow->addWidget(_replaceEdit, 1);
+
+      auto replace = new QToolButton(_replaceRow);
+      replace->setText(tr("Replace"));
+      replaceRow->addWidget(replace);
+
+      auto replaceAll = new QToolButton(_replaceRow);
+      replaceAll->setText(tr("Replace all"));
+      replaceRow->addWidget(replaceAll);
+      layout->addWidget(_replaceRow);
+
+      connect(_findEdit, &QLineEdit::textEdited, this, [this](){ updateQuery(true); });
+      connect(_findEdit, &QLineEdit::returnPressed, this, [this](){
+        if (QApplication::keyboardModifiers() & Qt::ShiftModifier)
+          findPrevious();
+        else
+          findNext();
+      });
+
+      for (auto option : {_matchCase, _wholeWord, _regex})
+        connect(option, &QToolButton::toggled, this, [this](){ updateQuery(false); });
+
+      connect(previous, &QToolButton::clicked, this, &FindBar::findPrevious);
+      connect(next, &QToolButton::clicked, this, &FindBar::findNext);
+      connect(close, &QToolButton::clicked, this, &FindBar::closeBar);
+
+      connect(replace, &QToolButton::clicked, this, [this](){
+        _engine->replaceCurrent(_replaceEdit->text().toUtf8());
+        updateCount();
+      });
+      connect(_replaceEdit, &QLineEdit::returnPressed, replace, &QToolButton::click);
+
+      connect(replaceAll, &QToolButton::clicked, this, [this](){
+        qint64 replaced = _engine->replaceAll(_replaceEdit->text().toUtf8());
+        _countLabel->setText(tr("%1 replaced").arg(replaced));
+      });
+
+      connect(_engine, &SearchEngine::countChanged, this, [this](){ updateCount(); });
+    }
+
+    ScintillaEdit* _view{nullptr};
+    SearchEngine* _engine{nullptr};
+    QLineEdit* _findEdit{nullptr};
+    QLineEdit* _replaceEdit{nullptr};
+    QWidget* _replaceRow{nullptr};
+    QToolButton* _matchCase{nullptr};
+    QToolButton* _wholeWord{nullptr};
+    QToolButton* _regex{nullptr};
+    QLabel* _countLabel{nullptr};
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_FINDBAR_H
@@ -0,0 +1,342 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_FUZZYFINDER_H
+#define QWIDGET_LUA_EDITOR_FUZZYFINDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace aic
+{
+
+  // Fuzzy matching of a query against the relative paths of a workspace, for the quick open
+  // palette. The paths sit one after the other in a single buffer with a mask of the
+  // characters each one holds, so most of them are rejected with one AND before their bytes
+  // are looked at. Big lists are split across threads. Typing more of the same query only
+  // rescans what matched the shorter one.
+  class FuzzyFinder
+  {
+  public:
+    struct Result
+    {
+      uint32_t id;
+      int score;
+    };
+
+    // Above this the scan is split across threads
+    static constexpr size_t ParallelThreshold = 20000;
+
+    void assign(const std::vector<std::string>& paths)
+    {
+      _storage.clear();
+      _items.clear();
+      _lookup.clear();
+      _removed = 0;
+
+      size_t bytes = 0;
+      for (const auto& path : paths)
+        bytes += path.size();
+      _storage.reserve(bytes);
+      _items.reserve(paths.size());
+
+      for (const auto& path : paths)
+        append(path);
+      invalidate();
+    }
+
+    // Adds path unless it is listed already
+    void add(std::string_view path)
+    {
+      Item* item = locate(path);
+      if (item) {
+        if (item->removed) {
+          item->removed = false;
+          --_removed;
+          invalidate();
+        }
+        return;
+      }
+
+      append(path);
+      invalidate();
+    }
+
+    void remove(std::string_view path)
+    {
+      Item* item = locate(path);
+      if (!item || item->removed)
+        return;
+
+      item->removed = true;
+      ++_removed;
+      invalidate();
+    }
+
+    size_t size() const
+    {
+      return _items.size() - _removed;
+    }
+
+    std::string_view path(uint32_t id) const
+    {
+      return {_storage.data() + _items[id].offset, _items[id].length};
+    }
+
+    // The limit best matches of query, best first. Letters match either case, the characters
+    // of query must show up in order but not next to each other.
+    std::vector<Result> find(std::string_view query, size_t limit)
+    {
+      std::string folded(query.size(), '\0');
+      std::transform(query.begin(), query.end(), folded.begin(), [](char c){ return static_cast<char>(fold(c)); });
+      folded.erase(std::remove(folded.begin(), folded.end(), ' '), folded.end());
+
+      if (folded.empty())
+        return firstFiles(limit);
+
+      // what matched a prefix of the query is all that can match the query
+      const bool narrowing = _cacheValid && !_lastQuery.empty() && folded.compare(0, _lastQuery.size(), _lastQuery) == 0;
+      const size_t count = narrowing ? _lastMatches.size() : _items.size();
+      auto idAt = [&](size_t i){ return narrowing ? _lastMatches[i] : static_cast<uint32_t>(i); };
+
+      const uint64_t wanted = maskOf(folded);
+      const size_t threads = count < ParallelThreshold ? 1 : std::min<size_t>(8, std::max(2u, std::thread::hardware_concurrency()));
+      const size_t chunk = (count + threads - 1) / threads;
+
+      std::vector<std::vector<uint32_t>> matches(threads);
+      std::vector<std::vector<Result>> best(threads);
+      auto scan = [&](size_t part){
+        auto& matched = matches[part];
+        auto& top = best[part];
+        const size_t end = std::min(count, (part + 1) * chunk);
+        for (size_t i = part * chunk; i < end; ++i) {
+          const uint32_t id = idAt(i);
+          const Item& item = _items[id];
+          if (item.removed || (item.mask & wanted) != wanted)
+            continue;
+
+          const int value = score(item, folded);
+          if (value == NoMatch)
+            continue;
+
+          matched.push_back(id);
+          pushTop(top, {id, value}, limit);
+        }
+      };
+
+      if (threads == 1) {
+        scan(0);
+      }
+      else {
+        std::vector<std::thread> workers;
+        for (size_t part = 1; part < threads; ++part)
+          workers.emplace_back(scan, part);
+        scan(0);
+        for (auto& worker : workers)
+          worker.join();
+      }
+
+      // chunks were in id order, the concatenation is too
+      _lastMatches.clear();
+      for (const auto& part : matches)
+        _lastMatches.insert(_lastMatches.end(), part.begin(), part.end());
+      _lastQuery = folded;
+      _cacheValid = true;
+
+      std::vector<Result> results;
+      for (const auto& part : best)
+        results.insert(results.end(), part.begin(), part.end());
+      std::sort(results.begin(), results.end(), [this](const Result& a, const Result& b){ return better(a, b); });
+      if (results.size() > limit)
+        results.resize(limit);
+
+      return results;
+    }
+
+  private:
+    static constexpr int NoMatch = INT32_MIN;
+
+    struct Item
+    {
+      uint32_t offset;
+      uint32_t length;
+      uint32_t name;        // where the file name starts, within the path
+      uint64_t mask;
+      bool removed{false};
+    };
+
+    static unsigned char fold(char c)
+    {
+      return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c + 32) : static_cast<unsigned char>(c);
+    }
+
+    // One bit per letter and digit, and one for anything else
+    static uint64_t bitOf(unsigned char c)
+    {
+      if (c >= 'a' && c <= 'z')
+        return uint64_t(1) << (c - 'a');
+      if (c >= '0' && c <= '9')
+        return uint64_t(1) << (26 + c - '0');
+      return uint64_t(1) << 63;
+    }
+
+    static uint64_t maskOf(std::string_view text)
+    {
+      uint64_t mask = 0;
+      for (char c : text)
+        mask |= bitOf(fold(c));
+      return mask;
+    }
+
+    static bool isSeparator(char c)
+    {
+      return c == '/' || c == '_' || c == '-' || c == '.' || c == ' ';
+    }
+
+    void append(std::string_view path)
+    {
+      Item item;
+      item.offset = static_cast<uint32_t>(_storage.size());
+      item.length = static_cast<uint32_t>(path.size());
+      auto slash = path.rfind('/');
+      item.name = slash == std::string_view::npos ? 0 : static_cast<uint32_t>(slash + 1);
+      item.mask = maskOf(path);
+
+      _storage.append(path.data(), path.size());
+      if (!_lookup.empty())
+        _lookup.emplace(std::hash<std::string_view>()(path), static_cast<uint32_t>(_items.size()));
+      _items.push_back(item);
+    }
+
+    // Built on the first update, a list that is only searched never needs it
+    Item* locate(std::string_view path)
+    {
+      if (_lookup.empty() && !_items.empty()) {
+        _lookup.reserve(_items.size());
+        for (uint32_t id = 0; id < _items.size(); ++id)
+          _lookup.emplace(std::hash<std::string_view>()(this->path(id)), id);
+      }
+
+      auto range = _lookup.equal_range(std::hash<std::string_view>()(path));
+      for (auto it = range.first; it != range.second; ++it)
+        if (this->path(it->second) == path)
+          return &_items[it->second];
+      return nullptr;
+    }
+
+    void invalidate()
+    {
+      _cacheValid = false;
+    }
+
+    std::vector<Result> firstFiles(size_t limit) const
+    {
+      std::vector<Result> results;
+      for (uint32_t id = 0; id < _items.size() && results.size() < limit; ++id)
+        if (!_items[id].removed)
+          results.push_back({id, 0});
+      return results;
+    }
+
+    bool better(const Result& a, const Result& b) const
+    {
+      if (a.score != b.score)
+        return a.score > b.score;
+      if (_items[a.id].length != _items[b.id].length)
+        return _items[a.id].length < _items[b.id].length;
+      return path(a.id) < path(b.id);
+    }
+
+    // Keeps the limit best results as a min heap, the worst one on top
+    void pushTop(std::vector<Result>& top, const Result& result, size_t limit) const
+    {
+      auto worse = [this](const Result& a, const Result& b){ return better(a, b); };
+      if (top.size() < limit) {
+        top.push_back(result);
+        std::push_heap(top.begin(), top.end(), worse);
+      }
+      else if (limit > 0 && better(result, top.front())) {
+        std::pop_heap(top.begin(), top.end(), worse);
+        top.back() = result;
+        std::push_heap(top.begin(), top.end(), worse);
+      }
+    }
+
+    // Finds the shortest window holding query in order (forward to its first complete match,
+    // back from there), then scores that window: matches at the start of a path component
+    // or a camelCase hump, runs of matches and matches in the file name earn points, gaps
+    // and long paths cost some.
+    int score(const Item& item, const std::string& query) const
+    {
+      const char* text = _storage.data() + item.offset;
+      const size_t length = item.length;
+
+      size_t q = 0;
+      size_t end = 0;
+      for (size_t i = 0; i < length; ++i) {
+        if (fold(text[i]) == static_cast<unsigned char>(query[q]) && ++q == query.size()) {
+          end = i;
+          break;
+        }
+      }
+      if (q < query.size())
+        return NoMatch;
+
+      size_t start = end;
+      q = query.size();
+      for (size_t i = end + 1; i-- > 0;) {
+        if (fold(text[i]) == static_cast<unsigned char>(query[q - 1]) && --q == 0) {
+          start = i;
+          break;
+        }
+      }
+
+      int value = 0;
+      size_t previous = SIZE_MAX;
+      q = 0;
+      for (size_t i = start; i <= end && q < query.size(); ++i) {
+        if (fold(text[i]) != static_cast<unsigned char>(query[q])) {
+          value -= 1;
+          continue;
+        }
+
+        int points = 16;
+        if (previous != SIZE_MAX && i == previous + 1)
+          points += 24;
+        if (i == 0 || isSeparator(text[i - 1]))
+          points += 30;
+        else if (text[i - 1] >= 'a' && text[i - 1] <= 'z' && text[i] >= 'A' && text[i] <= 'Z')
+          points += 20;
+        if (i >= item.name)
+          points += 10;
+
+        value += points;
+        previous = i;
+        ++q;
+      }
+
+      // the query is where the file name begins
+      if (start == item.name)
+        value += 50;
+
+      return value - static_cast<int>(length / 8);
+    }
+
+    std::string _storage;
+    std::vector<Item> _items;
+    std::unordered_multimap<size_t, uint32_t> _lookup;   // hash of the path, id
+    size_t _removed{0};
+
+    std::string _lastQuery;
+    std::vector<uint32_t> _lastMatches;
+    bool _cacheValid{false};
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_FUZZYFINDER_H
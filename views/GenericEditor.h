@@ -8,6 +8,7 @@
 #include "ScintillaEdit.h"
 #include "MgStyles.h"
 #include "MagiaTheme.h"
+#include "LanguageRegistry.h"
 #include "SciLexer.h"
 #include "ILexer.h"
 #include "Lexilla.h"
@@ -15,9 +16,14 @@
 #include <QTimer>
 #include <regex>
 #include "MagiaDebugger.h"
+#include "IdentifierIndex.h"
 #include "lua.hpp"
 #include <QFileInfo>
 #include <QFontDatabase>
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <memory>
 
 namespace aic
 {
@@ -29,12 +35,23 @@ namespace aic
   public:
     using ScriptExecutionCallback = std::function<void(bool, const std::string &msg)>;
 
+    // Features that cost layout or styling time proportional to the file size
+    enum class Feature {
+      Wrap = 1 << 0,
+      IndentationGuides = 1 << 1,
+      CaretLine = 1 << 2,
+      Folding = 1 << 3,
+      Highlighting = 1 << 4,
+    };
+
+    // Files from this size on open in large-file mode
+    inline static qint64 largeFileThreshold = 32 * 1024 * 1024;
+
     GenericEditor(QWidget *parent = 0): ScintillaEdit(parent){}
 
     void setup()
     {
       this->resize(QSize(this->width(), this->height()));
-      this->setWrapMode(SC_WRAP_WORD);
       setupModernTheme();
 
       auto lexNum = GetLexerCount();
@@ -55,10 +72,90 @@ namespace aic
 
       this->setMouseDwellTime(500);
 
-      setupSyntaxHighlighting();
-
       this->autoCSetMaxWidth(50);
       this->autoCSetMaxHeight(10);
+
+      // completions come ranked, Scintilla must not sort them again
+      send(SCI_AUTOCSETORDER, SC_ORDER_CUSTOM);
+
+      // big documents are indexed a slice at a time while the user is idle
+      _indexTimer = new QTimer(this);
+      _indexTimer->setInterval(500);
+      _indexTimer->setSingleShot(true);
+      connect(_indexTimer, &QTimer::timeout, this, [this](){
+        if (!refreshIdentifiers(IndexLinesPerTick))
+          _indexTimer->start();
+      });
+
+      applyFeatures();
+    }
+
+    // Switches large-file mode on or off for the file about to be shown. Every file starts
+    // from the defaults of its mode, features turned back on for one file do not follow the
+    // next one.
+    void setFileSize(qint64 bytes)
+    {
+      bool large = bytes >= largeFileThreshold;
+      const bool changed = large != _largeFile;
+
+      _largeFile = large;
+      _features = large ? LargeFileFeatures : NormalFeatures;
+      applyFeatures();
+      if (changed)
+        emit largeFileModeChanged(large);
+    }
+
+    // The view switched to an existing document, its lexer came along with it but the
+    // styles belong to the view
+    void documentChanged(const QString& filePath)
+    {
+      _lexerFile = filePath;
+      applyStyles(isFeatureEnabled(Feature::Highlighting) ? LanguageRegistry::instance().forFile(filePath) : nullptr);
+      applyCompletionLanguage(filePath);
+      applyFeatures();
+    }
+
+    // Identifiers of the document shown, kept by whoever owns the document so they survive a
+    // switch. Null while the document has none (a preview), only keywords are offered then.
+    // Large files are not indexed, one entry per occurrence would cost more than the text.
+    void setIdentifierIndex(std::shared_ptr<mg::IdentifierIndex> index)
+    {
+      if (index && _largeFile)
+        index->reset(0);
+
+      _identifiers = _largeFile ? nullptr : std::move(index);
+      if (!_identifiers)
+        return;
+
+      // a new index, or one that missed edits, is rebuilt from scratch
+      if (_identifiers->lineCount() != lineCount())
+        _identifiers->reset(lineCount());
+
+      applyCompletionLanguage(_lexerFile);
+      _indexTimer->start();
+    }
+
+    bool isLargeFile() const
+    {
+      return _largeFile;
+    }
+
+    bool isFeatureEnabled(Feature feature) const
+    {
+      return _features & static_cast<int>(feature);
+    }
+
+    void setFeatureEnabled(Feature feature, bool enabled)
+    {
+      if (enabled == isFeatureEnabled(feature))
+        return;
+
+      _features = enabled ? (_features | static_cast<int>(feature)) : (_features & ~static_cast<int>(feature));
+
+      if (feature == Feature::Highlighting && !_lexerFile.isEmpty())
+        setLexerForFile(_lexerFile);
+
+      applyFeatures();
     }
 
     void setupModernTheme() 
@@ -125,101 +222,47 @@ namespace aic
       send(SCI_SETFOLDMARGINHICOLOUR, mg::theme::ScintillaColors::MARGIN_BG);
     }
     
-    void setupSyntaxHighlighting()
-    {
-      // Customize syntax highlighting for common elements
-      // These will be applied regardless of the specific lexer
-      send(SCI_STYLESETFORE, SCE_LUA_WORD, mg::theme::ScintillaColors::KEYWORD);      // keywords
-      send(SCI_STYLESETFORE, SCE_LUA_STRING, mg::theme::ScintillaColors::STRING);     // strings
-      send(SCI_STYLESETFORE, SCE_LUA_COMMENTLINE, mg::theme::ScintillaColors::COMMENT); // line comments
-      send(SCI_STYLESETFORE, SCE_LUA_COMMENT, mg::theme::ScintillaColors::COMMENT);   // block comments
-      send(SCI_STYLESETFORE, SCE_LUA_NUMBER, mg::theme::ScintillaColors::NUMBER);     // numbers
-      send(SCI_STYLESETFORE, SCE_LUA_OPERATOR, mg::theme::ScintillaColors::OPERATOR); // operators
-      send(SCI_STYLESETFORE, SCE_LUA_IDENTIFIER, mg::theme::ScintillaColors::DEFAULT_TEXT); // identifiers
-      send(SCI_STYLESETFORE, SCE_LUA_WORD2, mg::theme::ScintillaColors::FUNCTION);    // known functions
-      
-      // Similar for C++ lexer
-      send(SCI_STYLESETFORE, SCE_C_WORD, mg::theme::ScintillaColors::KEYWORD);        // keywords
-      send(SCI_STYLESETFORE, SCE_C_STRING, mg::theme::ScintillaColors::STRING);       // strings
-      send(SCI_STYLESETFORE, SCE_C_COMMENTLINE, mg::theme::ScintillaColors::COMMENT); // line comments
-      send(SCI_STYLESETFORE, SCE_C_COMMENT, mg::theme::ScintillaColors::COMMENT);     // block comments
-      send(SCI_STYLESETFORE, SCE_C_NUMBER, mg::theme::ScintillaColors::NUMBER);       // numbers
-      send(SCI_STYLESETFORE, SCE_C_OPERATOR, mg::theme::ScintillaColors::OPERATOR); // operators
-      send(SCI_STYLESETFORE, SCE_C_IDENTIFIER, mg::theme::ScintillaColors::DEFAULT_TEXT); // identifiers
-      
-      // Python
-      send(SCI_STYLESETFORE, SCE_P_WORD, mg::theme::ScintillaColors::KEYWORD);        // keywords
-      send(SCI_STYLESETFORE, SCE_P_STRING, mg::theme::ScintillaColors::STRING);       // strings
-      send(SCI_STYLESETFORE, SCE_P_COMMENTLINE, mg::theme::ScintillaColors::COMMENT); // line comments
-      send(SCI_STYLESETFORE, SCE_P_NUMBER, mg::theme::ScintillaColors::NUMBER);       // numbers
-      
-      // JavaScript
-      send(SCI_STYLESETFORE, SCE_HJ_WORD, mg::theme::ScintillaColors::KEYWORD);       // keywords
-      send(SCI_STYLESETFORE, SCE_P_STRING, mg::theme::ScintillaColors::STRING);      // strings
-      send(SCI_STYLESETFORE, SCE_HJ_COMMENT, mg::theme::ScintillaColors::COMMENT);    // comments
-      send(SCI_STYLESETFORE, SCE_HJ_NUMBER, mg::theme::ScintillaColors::NUMBER);      // numbers
-    }
-
+    // The lexer belongs to the document: it is created once per document and language,
+    // and Scintilla releases the previous one when another is set
     void setLexerForFile(const QString& filePath) 
     {
-      QString extension = QFileInfo(filePath).suffix().toLower();
-      
-      // Create appropriate lexer based on file extension
-      sptr_t lex = 0;
-      
-      if (extension == "lua") {
-        lex = reinterpret_cast<sptr_t>((void*)CreateLexer("lua"));
-      }
-      else if (extension == "py" || extension == "python") {
-        lex = reinterpret_cast<sptr_t>((void*)CreateLexer("python"));
-      }
-      else if (extension == "cpp" || extension == "h" || extension == "hpp" || extension == "cxx") {
-        lex = reinterpret_cast<sptr_t>((void*)CreateLexer("cpp"));
-      }
-      else if (extension == "js" || extension == "javascript") {
-        lex = reinterpret_cast<sptr_t>((void*)CreateLexer("javascript"));
-      }
-      else if (extension == "html" || extension == "htm") {
-        lex = reinterpret_cast<sptr_t>((void*)CreateLexer("html"));
-      }
-      else if (extension == "css") {
-        lex = reinterpret_cast<sptr_t>((void*)CreateLexer("css"));
-      }
-      else if (extension == "json") {
-        lex = reinterpret_cast<sptr_t>((void*)CreateLexer("json"));
-      }
-      
-      if (lex) {
-        // Set the lexer
-        send(SCI_SETILEXER, 0, lex);
-        
-        // Apply our theme's syntax highlighting
-        setupSyntaxHighlighting();
-        
-        // Set keywords for the lexer
-        if (extension == "lua") {
-          send(SCI_SETKEYWORDS, 0, reinterpret_cast<sptr_t>("and break do else elseif end for function goto if in local not or repeat return then until while"));
-          send(SCI_SETKEYWORDS, 1, reinterpret_cast<sptr_t>("print assert collectgarbage dofile error _G getmetatable ipairs loadfile next pairs pcall print rawequal rawget rawset require select setmetatable tonumber tostring type _VERSION xpcall"));
-          send(SCI_SETKEYWORDS, 2, reinterpret_cast<sptr_t>("false nil true"));
-        }
-        else if (extension == "py" || extension == "python") {
-          send(SCI_SETKEYWORDS, 0, reinterpret_cast<sptr_t>("and as assert break class continue def del elif else except exec finally for from global if import in is lambda not or pass print raise return try while with yield"));
-        }
-        else if (extension == "cpp" || extension == "h" || extension == "hpp" || extension == "cxx") {
-          send(SCI_SETKEYWORDS, 0, reinterpret_cast<sptr_t>("alignas alignof and and_eq asm auto bitand bitor bool break case catch char char16_t char32_t class compl const constexpr const_cast continue decltype default delete do double dynamic_cast else enum explicit export extern false final float for friend goto if inline int long mutable namespace new noexcept not not_eq nullptr operator or or_eq override private protected public register reinterpret_cast return short signed sizeof static static_assert static_cast struct switch template this thread_local throw true try typedef typeid typename union unsigned using virtual void volatile wchar_t while xor xor_eq"));
-        }
+      _lexerFile = filePath;
+
+      auto language = isFeatureEnabled(Feature::Highlighting) ? LanguageRegistry::instance().forFile(filePath) : nullptr;
+      applyStyles(language);
+      applyCompletionLanguage(filePath);
+
+      if (!language) {
+        send(SCI_SETILEXER, 0, 0);
+        return;
       }
+
+      std::string current(static_cast<size_t>(send(SCI_GETLEXERLANGUAGE)), '\0');
+      send(SCI_GETLEXERLANGUAGE, 0, reinterpret_cast<sptr_t>(current.data()));
+
+      if (current != language->lexer)
+        send(SCI_SETILEXER, 0, reinterpret_cast<sptr_t>((void*)CreateLexer(language->lexer.c_str())));
+
+      // lexers ignore a keyword list equal to the one they have, nothing is restyled then
+      for (size_t i = 0; i < language->keywords.size(); ++i)
+        send(SCI_SETKEYWORDS, i, reinterpret_cast<sptr_t>(language->keywords[i].c_str()));
+
+      // the fold property lives in the lexer, it is lost with every new one
+      applyFeatures();
     }
 
     virtual ~GenericEditor(){}
 
+  signals:
+    void largeFileModeChanged(bool enabled);
+
   protected:
     void onCharAdded(int ch)
     {
-      // Implementação de lógica de quando mostrar o autocomplete
-      if (ch == '(' || ch == ' ') {
-        // Exemplo: mostrar autocomplete após '(' ou ' '
-        showAutocomplete();
+      if (ch == '_' || (ch >= 0 && ch < 0x80 && std::isalnum(ch))) {
+        // Scintilla narrows an open list by itself while the word grows
+        if (!autoCActive())
+          showAutocomplete();
       }
       else if(ch == '\n'){
         onNewLine();
@@ -229,11 +272,35 @@ namespace aic
     }
 
     void showAutocomplete() {
-      // Exemplo de fonte de dados para autocomplete (palavras-chave Lua)
-      QStringList luaKeywords = {"function", "end", "if", "then", "else", "for", "while", "do", "repeat", "until"};
-      QString wordList = luaKeywords.join(" ");
-      // Exibir lista de autocomplete
-      this->autoCShow(0,wordList.toUtf8().data());
+      constexpr int MinPrefix = 2;
+
+      auto caret = currentPos();
+      auto start = wordStartPosition(caret, true);
+      if (caret - start < MinPrefix)
+        return;
+
+      std::string prefix = textRange(start, caret).toStdString();
+      std::vector<std::string> completions;
+      if (_identifiers) {
+        if (!refreshIdentifiers(IndexLinesPerTick))
+          _indexTimer->start();
+        completions = _identifiers->complete(prefix, _completionWords);
+      }
+      else {
+        completions = mg::IdentifierIndex().complete(prefix, _completionWords);
+      }
+
+      if (completions.empty())
+        return;
+
+      std::string list;
+      for (const auto& word : completions) {
+        list += word;
+        list += ' ';
+      }
+      list.pop_back();
+
+      this->autoCShow(caret - start, list.c_str());
     }
 
     void onNewLine()
@@ -246,7 +313,25 @@ namespace aic
                         Scintilla::Position linesAdded, const QByteArray &text, Scintilla::Position line,
                         Scintilla::FoldLevel foldNow, Scintilla::FoldLevel foldPrev)
     {
-      qDebug() << "Editing file:";
+      if (!_identifiers)
+        return;
+
+      const auto flags = static_cast<int>(type);
+
+      // a restyled line may have moved in or out of a comment or string
+      if (flags & SC_MOD_CHANGESTYLE) {
+        _identifiers->linesRestyled(lineFromPosition(position), lineFromPosition(position + length));
+        return;
+      }
+
+      if (flags & SC_MOD_INSERTTEXT)
+        _identifiers->linesInserted(lineFromPosition(position), linesAdded);
+      else if (flags & SC_MOD_DELETETEXT)
+        _identifiers->linesRemoved(lineFromPosition(position), -linesAdded);
+      else
+        return;
+
+      _indexTimer->start();
     }
 
     void onMarginClicked(Scintilla::Position position, Scintilla::KeyMod modifiers, int margin)
@@ -284,6 +369,126 @@ namespace aic
 //      qDebug() << "Mouse Idle end!";
 
     }
+
+  private:
+    static constexpr int IndexLinesPerTick = 20000;
+
+    static constexpr int NormalFeatures = static_cast<int>(Feature::Wrap) |
+                                          static_cast<int>(Feature::IndentationGuides) |
+                                          static_cast<int>(Feature::CaretLine) |
+                                          static_cast<int>(Feature::Highlighting);
+
+    // wrapping, guides and folding need the whole file laid out or lexed, highlighting stays
+    // on but only the visible range is styled right away, the rest when the editor is idle
+    static constexpr int LargeFileFeatures = static_cast<int>(Feature::Highlighting);
+
+    // Styles belong to the view, only sent when the language shown changes
+    void applyStyles(const std::shared_ptr<const LanguageProfile>& language)
+    {
+      if (language == _styledLanguage)
+        return;
+
+      if (_styledLanguage)
+        for (const auto& [style, color] : _styledLanguage->styles)
+          send(SCI_STYLESETFORE, style, mg::theme::ScintillaColors::DEFAULT_TEXT);
+
+      if (language)
+        for (const auto& [style, color] : language->styles)
+          send(SCI_STYLESETFORE, style, color);
+
+      _styledLanguage = language;
+    }
+
+    // Keywords of the language are offered with the identifiers, its text styles are not indexed
+    void applyCompletionLanguage(const QString& filePath)
+    {
+      auto language = LanguageRegistry::instance().forFile(filePath);
+      if (language != _completionLanguage) {
+        _completionLanguage = language;
+        _completionWords.clear();
+
+        if (language)
+          for (const auto& keywords : language->keywords) {
+            auto words = QString::fromStdString(keywords).split(' ', Qt::SkipEmptyParts);
+            for (const auto& word : words)
+              _completionWords.push_back(word.toStdString());
+          }
+
+        std::sort(_completionWords.begin(), _completionWords.end());
+        _completionWords.erase(std::unique(_completionWords.begin(), _completionWords.end()), _completionWords.end());
+      }
+
+      if (!_identifiers)
+        return;
+
+      std::bitset<256> textStyles;
+      if (language)
+        for (int style : language->textStyles)
+          textStyles.set(style);
+      _identifiers->setIgnoredStyles(textStyles);
+    }
+
+    // Returns true once the index is up to date
+    bool refreshIdentifiers(int maxLines = INT_MAX)
+    {
+      if (!_identifiers)
+        return true;
+
+      int firstLine = _identifiers->firstDirtyLine();
+      int lastLine = std::min(_identifiers->lastDirtyLine(), static_cast<int>(lineCount()) - 1);
+      if (firstLine < 0 || lastLine < 0)
+        return true;
+
+      // the lexer may still be behind the edit, the styles decide what is an identifier. Only
+      // the slice indexed now is styled, the rest is left to idle styling and the next ticks.
+      if (maxLines <= lastLine - firstLine)
+        lastLine = firstLine + maxLines - 1;
+      auto end = lastLine + 1 < lineCount() ? send(SCI_POSITIONFROMLINE, lastLine + 1) : send(SCI_GETLENGTH);
+      if (send(SCI_GETENDSTYLED) < end)
+        send(SCI_COLOURISE, send(SCI_GETENDSTYLED), end);
+
+      return _identifiers->refresh(
+        [this](int line) {
+          auto start = send(SCI_POSITIONFROMLINE, line);
+          auto end = send(SCI_GETLINEENDPOSITION, line);
+          if (start < 0 || end <= start)
+            return std::string_view();
+
+          // points straight into the document buffer, valid until the next modification
+          auto* text = reinterpret_cast<const char*>(send(SCI_GETRANGEPOINTER, start, end - start));
+          return std::string_view(text, static_cast<size_t>(end - start));
+        },
+        [this](int line, int column) {
+          return static_cast<int>(send(SCI_GETSTYLEAT, send(SCI_POSITIONFROMLINE, line) + column));
+        },
+        maxLines);
+    }
+
+    void applyFeatures()
+    {
+      this->setWrapMode(isFeatureEnabled(Feature::Wrap) ? SC_WRAP_WORD : SC_WRAP_NONE);
+      send(SCI_SETINDENTATIONGUIDES, isFeatureEnabled(Feature::IndentationGuides) ? SC_IV_LOOKBOTH : SC_IV_NONE);
+      send(SCI_SETCARETLINEVISIBLE, isFeatureEnabled(Feature::CaretLine));
+
+      bool folding = isFeatureEnabled(Feature::Folding);
+      send(SCI_SETPROPERTY, reinterpret_cast<uptr_t>("fold"), reinterpret_cast<sptr_t>(folding ? "1" : "0"));
+      if (folding)
+        mg::styles::editor::setupFolding(this);
+      else
+        send(SCI_SETMARGINWIDTHN, mg::styles::Margins::FOLDING, 0);
+
+      send(SCI_SETIDLESTYLING, _largeFile ? SC_IDLESTYLING_ALL : SC_IDLESTYLING_NONE);
+      send(SCI_SETLAYOUTCACHE, _largeFile ? SC_CACHE_PAGE : SC_CACHE_CARET);
+    }
+
+    bool _largeFile{false};
+    int _features{NormalFeatures};
+    QString _lexerFile;
+    std::shared_ptr<const LanguageProfile> _styledLanguage;
+    std::shared_ptr<mg::IdentifierIndex> _identifiers;
+    std::shared_ptr<const LanguageProfile> _completionLanguage;
+    std::vector<std::string> _completionWords;
+    QTimer* _indexTimer{nullptr};
   };
 }
 #endif //QWIDGET_LUA_EDITOR_GENERICEDITOR_H
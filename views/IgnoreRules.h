@@ -0,0 +1,105 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_IGNORERULES_H
+#define QWIDGET_LUA_EDITOR_IGNORERULES_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <fnmatch.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace aic
+{
+
+  // .gitignore patterns of one directory, chained to the ones of its parents. Shared by the
+  // walks over the workspace (search, trigram index).
+  struct IgnoreRules
+  {
+    struct Rule
+    {
+      std::string pattern;
+      bool negate{false};
+      bool directoryOnly{false};
+      bool anchored{false};   // matched against the path relative to base, not the name
+    };
+
+    QString base;
+    std::vector<Rule> rules;
+    std::shared_ptr<const IgnoreRules> parent;
+
+    bool ignored(const QString& path, const QString& name, bool directory) const
+    {
+      bool result = parent && parent->ignored(path, name, directory);
+
+      const std::string relative = path.mid(base.size() + 1).toStdString();
+      const std::string fileName = name.toStdString();
+      for (const auto& rule : rules) {
+        if (rule.directoryOnly && !directory)
+          continue;
+
+        const std::string& subject = rule.anchored ? relative : fileName;
+        if (fnmatch(rule.pattern.c_str(), subject.c_str(), rule.anchored ? FNM_PATHNAME : 0) == 0)
+          result = !rule.negate;
+      }
+
+      return result;
+    }
+
+    // Version control and dependency directories, never worth a look
+    static bool ignoredByDefault(const QString& name, bool directory)
+    {
+      if (!directory)
+        return false;
+
+      return name == ".git" || name == ".hg" || name == ".svn" || name == "node_modules" ||
+             name == "__pycache__" || name.startsWith("cmake-build-");
+    }
+
+    // The rules of directory on top of parent, parent itself when it has no .gitignore
+    static std::shared_ptr<const IgnoreRules> load(const QString& directory, std::shared_ptr<const IgnoreRules> parent)
+    {
+      QFile file(directory + "/.gitignore");
+      if (!file.open(QIODevice::ReadOnly))
+        return parent;
+
+      auto rules = std::make_shared<IgnoreRules>();
+      rules->base = directory;
+      rules->parent = std::move(parent);
+
+      while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+          continue;
+
+        Rule rule;
+        if (line.startsWith('!')) {
+          rule.negate = true;
+          line.remove(0, 1);
+        }
+        if (line.endsWith('/')) {
+          rule.directoryOnly = true;
+          line.chop(1);
+        }
+        if (line.startsWith("**/"))
+          line.remove(0, 3);
+
+        // a slash anywhere but at the end ties the pattern to this directory
+        rule.anchored = line.contains('/');
+        if (line.startsWith('/'))
+          line.remove(0, 1);
+
+        rule.pattern = line.toStdString();
+        if (!rule.pattern.empty())
+          rules->rules.push_back(std::move(rule));
+      }
+
+      return rules;
+    }
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_IGNORERULES_H
@@ -0,0 +1,164 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_LANGUAGEREGISTRY_H
+#define QWIDGET_LUA_EDITOR_LANGUAGEREGISTRY_H
+
+#include "SciLexer.h"
+#include "MagiaTheme.h"
+#include <QFileInfo>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace aic
+{
+
+  // Everything an editor needs to highlight a language, built once
+  struct LanguageProfile
+  {
+    QString name;
+    std::string lexer;                        // Lexilla name given to CreateLexer
+    std::vector<std::string> keywords;        // keyword set i goes to SCI_SETKEYWORDS i
+    std::vector<std::pair<int, int>> styles;  // style number and BGR foreground
+    std::vector<int> textStyles;              // comments, strings and numbers, no identifiers there
+  };
+
+  // Maps file extensions to language profiles with one hash lookup. Languages can be added
+  // or replaced at runtime, from the GUI thread.
+  class LanguageRegistry
+  {
+  public:
+    static LanguageRegistry& instance()
+    {
+      static LanguageRegistry registry;
+      return registry;
+    }
+
+    void registerLanguage(const LanguageProfile& profile, const QStringList& extensions)
+    {
+      auto shared = std::make_shared<const LanguageProfile>(profile);
+      _byName.insert(profile.name, shared);
+      for (const auto& extension : extensions)
+        _byExtension.insert(extension.toLower(), shared);
+    }
+
+    // Null when the extension is unknown. Shared, so a profile replaced at runtime stays
+    // valid for the editors still using it.
+    std::shared_ptr<const LanguageProfile> forFile(const QString& filePath) const
+    {
+      return _byExtension.value(QFileInfo(filePath).suffix().toLower());
+    }
+
+    std::shared_ptr<const LanguageProfile> forName(const QString& name) const
+    {
+      return _byName.value(name);
+    }
+
+  private:
+    LanguageRegistry()
+    {
+      using Colors = mg::theme::ScintillaColors;
+
+      registerLanguage({"Lua", "lua",
+                        {"and break do else elseif end for function goto if in local not or repeat return then until while",
+                         "print assert collectgarbage dofile error _G getmetatable ipairs loadfile next pairs pcall print rawequal rawget rawset require select setmetatable tonumber tostring type _VERSION xpcall",
+                         "false nil true"},
+                        {{SCE_LUA_WORD, Colors::KEYWORD},
+                         {SCE_LUA_STRING, Colors::STRING},
+                         {SCE_LUA_COMMENTLINE, Colors::COMMENT},
+                         {SCE_LUA_COMMENT, Colors::COMMENT},
+                         {SCE_LUA_NUMBER, Colors::NUMBER},
+                         {SCE_LUA_OPERATOR, Colors::OPERATOR},
+                         {SCE_LUA_IDENTIFIER, Colors::DEFAULT_TEXT},
+                         {SCE_LUA_WORD2, Colors::FUNCTION}},
+                        {SCE_LUA_COMMENT, SCE_LUA_COMMENTLINE, SCE_LUA_COMMENTDOC, SCE_LUA_NUMBER, SCE_LUA_STRING,
+                         SCE_LUA_CHARACTER, SCE_LUA_LITERALSTRING, SCE_LUA_STRINGEOL}},
+                       {"lua"});
+
+      registerLanguage({"Python", "python",
+                        {"and as assert break class continue def del elif else except exec finally for from global if import in is lambda not or pass print raise return try while with yield"},
+                        {{SCE_P_WORD, Colors::KEYWORD},
+                         {SCE_P_STRING, Colors::STRING},
+                         {SCE_P_CHARACTER, Colors::STRING},
+                         {SCE_P_COMMENTLINE, Colors::COMMENT},
+                         {SCE_P_NUMBER, Colors::NUMBER},
+                         {SCE_P_OPERATOR, Colors::OPERATOR}},
+                        {SCE_P_COMMENTLINE, SCE_P_COMMENTBLOCK, SCE_P_NUMBER, SCE_P_STRING, SCE_P_CHARACTER,
+                         SCE_P_TRIPLE, SCE_P_TRIPLEDOUBLE, SCE_P_STRINGEOL, SCE_P_FSTRING, SCE_P_FCHARACTER,
+                         SCE_P_FTRIPLE, SCE_P_FTRIPLEDOUBLE}},
+                       {"py", "python"});
+
+      const std::vector<std::pair<int, int>> cStyles = {
+        {SCE_C_WORD, Colors::KEYWORD},
+        {SCE_C_STRING, Colors::STRING},
+        {SCE_C_CHARACTER, Colors::STRING},
+        {SCE_C_COMMENTLINE, Colors::COMMENT},
+        {SCE_C_COMMENT, Colors::COMMENT},
+        {SCE_C_NUMBER, Colors::NUMBER},
+        {SCE_C_OPERATOR, Colors::OPERATOR},
+        {SCE_C_IDENTIFIER, Colors::DEFAULT_TEXT}};
+
+      const std::vector<int> cTextStyles = {
+        SCE_C_COMMENT, SCE_C_COMMENTLINE, SCE_C_COMMENTDOC, SCE_C_COMMENTLINEDOC, SCE_C_COMMENTDOCKEYWORD,
+        SCE_C_COMMENTDOCKEYWORDERROR, SCE_C_NUMBER, SCE_C_STRING, SCE_C_CHARACTER, SCE_C_STRINGEOL,
+        SCE_C_VERBATIM, SCE_C_REGEX, SCE_C_STRINGRAW, SCE_C_TRIPLEVERBATIM, SCE_C_HASHQUOTEDSTRING};
+
+      registerLanguage({"C++", "cpp",
+                        {"alignas alignof and and_eq asm auto bitand bitor bool break case catch char char16_t char32_t class compl const constexpr const_cast continue decltype default delete do double dynamic_cast else enum explicit export extern false final float for friend goto if inline int long mutable namespace new noexcept not not_eq nullptr operator or or_eq override private protected public register reinterpret_cast return short signed sizeof static static_assert static_cast struct switch template this thread_local throw true try typedef typeid typename union unsigned using virtual void volatile wchar_t while xor xor_eq"},
+                        cStyles,
+                        cTextStyles},
+                       {"cpp", "h", "hpp", "cxx", "cc", "c"});
+
+      // Lexilla has no JavaScript lexer of its own, the C++ one handles it
+      registerLanguage({"JavaScript", "cpp",
+                        {"async await break case catch class const continue debugger default delete do else export extends false finally for function if import in instanceof let new null of return static super switch this throw true try typeof undefined var void while with yield"},
+                        cStyles,
+                        cTextStyles},
+                       {"js", "javascript", "mjs", "ts"});
+
+      registerLanguage({"HTML", "hypertext",
+                        {},
+                        {{SCE_H_TAG, Colors::KEYWORD},
+                         {SCE_H_ATTRIBUTE, Colors::FUNCTION},
+                         {SCE_H_DOUBLESTRING, Colors::STRING},
+                         {SCE_H_SINGLESTRING, Colors::STRING},
+                         {SCE_H_COMMENT, Colors::COMMENT},
+                         {SCE_H_NUMBER, Colors::NUMBER}},
+                        {SCE_H_COMMENT, SCE_H_NUMBER, SCE_H_DOUBLESTRING, SCE_H_SINGLESTRING}},
+                       {"html", "htm"});
+
+      registerLanguage({"CSS", "css",
+                        {},
+                        {{SCE_CSS_TAG, Colors::KEYWORD},
+                         {SCE_CSS_IDENTIFIER, Colors::FUNCTION},
+                         {SCE_CSS_DOUBLESTRING, Colors::STRING},
+                         {SCE_CSS_SINGLESTRING, Colors::STRING},
+                         {SCE_CSS_COMMENT, Colors::COMMENT},
+                         {SCE_CSS_VALUE, Colors::NUMBER}},
+                        {SCE_CSS_COMMENT, SCE_CSS_DOUBLESTRING, SCE_CSS_SINGLESTRING}},
+                       {"css"});
+
+      registerLanguage({"JSON", "json",
+                        {},
+                        {{SCE_JSON_PROPERTYNAME, Colors::FUNCTION},
+                         {SCE_JSON_STRING, Colors::STRING},
+                         {SCE_JSON_NUMBER, Colors::NUMBER},
+                         {SCE_JSON_KEYWORD, Colors::KEYWORD},
+                         {SCE_JSON_LINECOMMENT, Colors::COMMENT},
+                         {SCE_JSON_BLOCKCOMMENT, Colors::COMMENT},
+                         {SCE_JSON_OPERATOR, Colors::OPERATOR}},
+                        {SCE_JSON_STRING, SCE_JSON_STRINGEOL, SCE_JSON_NUMBER, SCE_JSON_LINECOMMENT, SCE_JSON_BLOCKCOMMENT}},
+                       {"json"});
+    }
+
+    QHash<QString, std::shared_ptr<const LanguageProfile>> _byExtension;
+    QHash<QString, std::shared_ptr<const LanguageProfile>> _byName;
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_LANGUAGEREGISTRY_H
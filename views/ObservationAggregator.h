@@ -0,0 +1,108 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_OBSERVATIONAGGREGATOR_H
+#define QWIDGET_LUA_EDITOR_OBSERVATIONAGGREGATOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <string>
+#include <vector>
+
+namespace aic
+{
+
+  // Collects the observations of one assistant turn and lets the model be called again only
+  // once: after its answer has finished streaming, every tool it asked for is over and no
+  // more observations arrived for the debounce interval. Whatever arrives while the model
+  // is answering waits for the next turn.
+  class ObservationAggregator : public QObject
+  {
+  Q_OBJECT
+
+  public:
+    static constexpr int DefaultDebounceMs = 50;
+
+    explicit ObservationAggregator(QObject* parent = nullptr): QObject(parent)
+    {
+      _timer.setSingleShot(true);
+      _timer.setInterval(DefaultDebounceMs);
+      connect(&_timer, &QTimer::timeout, this, &ObservationAggregator::flush);
+    }
+
+    void setDebounce(int ms)
+    {
+      _timer.setInterval(ms);
+    }
+
+    void add(std::string observation)
+    {
+      _pending.push_back(std::move(observation));
+      schedule();
+    }
+
+    void add(const std::vector<std::string>& observations)
+    {
+      _pending.insert(_pending.end(), observations.begin(), observations.end());
+      schedule();
+    }
+
+    // The model is answering, nothing is sent until turnFinished()
+    void turnStarted()
+    {
+      _answering = true;
+      _timer.stop();
+    }
+
+    void turnFinished()
+    {
+      _answering = false;
+      schedule();
+    }
+
+    // Tools of the turn are still running
+    void setBusy(bool busy)
+    {
+      _busy = busy;
+      if (busy)
+        _timer.stop();
+      else
+        schedule();
+    }
+
+    bool hasPending() const
+    {
+      return !_pending.empty();
+    }
+
+  signals:
+    // Everything collected for the turn, in arrival order. The model is considered answering
+    // again from here on.
+    void ready(const std::vector<std::string>& observations);
+
+  private:
+    void schedule()
+    {
+      if (!_answering && !_busy && !_pending.empty())
+        _timer.start();
+    }
+
+    void flush()
+    {
+      if (_answering || _busy || _pending.empty())
+        return;
+
+      std::vector<std::string> observations;
+      observations.swap(_pending);
+      _answering = true;
+      emit ready(observations);
+    }
+
+    QTimer _timer;
+    std::vector<std::string> _pending;
+    bool _answering{false};
+    bool _busy{false};
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_OBSERVATIONAGGREGATOR_H
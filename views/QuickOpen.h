@@ -0,0 +1,189 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_QUICKOPEN_H
+#define QWIDGET_LUA_EDITOR_QUICKOPEN_H
+
+#include "FuzzyFinder.h"
+#include "MagiaTheme.h"
+#include "TrigramIndex.h"
+#include <QApplication>
+#include <QFrame>
+#include <QKeyEvent>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QVBoxLayout>
+
+namespace aic
+{
+
+  // Quick open palette (Ctrl+P): a few letters of a path jump to the file. The file list
+  // comes from the trigram index of the workspace and follows its updates, so opening the
+  // palette never walks the tree.
+  class QuickOpen : public QFrame
+  {
+  Q_OBJECT
+
+  public:
+    static constexpr int MaxResults = 50;
+
+    explicit QuickOpen(QWidget* parent): QFrame(parent)
+    {
+      setupUI();
+      hide();
+    }
+
+    void setIndex(TrigramIndex* index)
+    {
+      _index = index;
+
+      // the mapped index lists the files right away, the walk of its refresh later. Every
+      // ready replaces the list, it may be the index of another workspace.
+      connect(index, &TrigramIndex::ready, this, [this](){
+        std::vector<std::string> paths;
+        _index->forEachFile([&](std::string_view path){ paths.emplace_back(path); });
+        _finder.assign(paths);
+        refreshIfVisible();
+      });
+      connect(index, &TrigramIndex::filesListed, this, [this](std::shared_ptr<const std::vector<std::string>> paths){
+        _finder.assign(*paths);
+        refreshIfVisible();
+      });
+      connect(index, &TrigramIndex::fileUpdated, this, [this](const QString& relativePath, bool removed){
+        const std::string path = relativePath.toStdString();
+        if (removed)
+          _finder.remove(path);
+        else
+          _finder.add(path);
+      });
+    }
+
+    void popup()
+    {
+      const int width = std::min(600, parentWidget()->width() - 40);
+      setFixedWidth(width);
+      move((parentWidget()->width() - width) / 2, 40);
+
+      show();
+      raise();
+      _input->setFocus();
+      _input->selectAll();
+      refresh();
+    }
+
+  signals:
+    void fileChosen(const QString& filePath);
+
+  protected:
+    bool eventFilter(QObject* watched, QEvent* event) override
+    {
+      if (watched != _input || event->type() != QEvent::KeyPress)
+        return QFrame::eventFilter(watched, event);
+
+      auto key = static_cast<QKeyEvent*>(event)->key();
+      switch (key) {
+        case Qt::Key_Down:
+        case Qt::Key_Up: {
+          int row = _results->currentRow() + (key == Qt::Key_Down ? 1 : -1);
+          if (row >= 0 && row < _results->count())
+            _results->setCurrentRow(row);
+          return true;
+        }
+        case Qt::Key_Return:
+        case Qt::Key_Enter:
+          choose(_results->currentItem());
+          return true;
+        case Qt::Key_Escape:
+          hide();
+          return true;
+        default:
+          return QFrame::eventFilter(watched, event);
+      }
+    }
+
+  private:
+    void refreshIfVisible()
+    {
+      if (isVisible())
+        refresh();
+    }
+
+    void refresh()
+    {
+      _results->clear();
+
+      const auto matches = _finder.find(_input->text().toStdString(), MaxResults);
+      for (const auto& match : matches) {
+        const auto path = _finder.path(match.id);
+        const QString relative = QString::fromUtf8(path.data(), static_cast<int>(path.size()));
+        const int slash = relative.lastIndexOf('/');
+
+        auto item = new QListWidgetItem(slash < 0 ? relative : QString("%1   %2").arg(relative.mid(slash + 1), relative.left(slash)),
+                                        _results);
+        item->setData(Qt::UserRole, relative);
+      }
+
+      if (_results->count() > 0)
+        _results->setCurrentRow(0);
+
+      const int rows = std::min(_results->count(), 12);
+      _results->setFixedHeight(rows * _results->sizeHintForRow(0) + 2 * _results->frameWidth() + 4);
+      _results->setVisible(rows > 0);
+      adjustSize();
+    }
+
+    void choose(QListWidgetItem* item)
+    {
+      if (!item || !_index)
+        return;
+
+      hide();
+      emit fileChosen(_index->root() + "/" + item->data(Qt::UserRole).toString());
+    }
+
+    void setupUI()
+    {
+      setFrameShape(QFrame::StyledPanel);
+      setStyleSheet(QString("QFrame { background-color: #%1; border: 1px solid #%2; border-radius: 6px; }"
+                            "QLineEdit { background-color: #%3; color: #%4; border: 1px solid #%2; border-radius: 4px; padding: 4px 6px; }"
+                            "QListWidget { background-color: #%1; color: #%4; border: none; font-family: 'JetBrains Mono', monospace; }"
+                            "QListWidget::item:selected { background: #%5; }")
+                    .arg(mg::theme::Colors::SIDEBAR_BG, 6, 16, QChar('0'))
+                    .arg(mg::theme::Colors::BORDER, 6, 16, QChar('0'))
+                    .arg(mg::theme::Colors::CODE_BG, 6, 16, QChar('0'))
+                    .arg(mg::theme::Colors::DEFAULT_TEXT, 6, 16, QChar('0'))
+                    .arg(mg::theme::Colors::PRIMARY, 6, 16, QChar('0')));
+
+      auto layout = new QVBoxLayout(this);
+      layout->setContentsMargins(6, 6, 6, 6);
+      layout->setSpacing(4);
+
+      _input = new QLineEdit(this);
+      _input->setPlaceholderText(tr("Go to file"));
+      _input->installEventFilter(this);
+      layout->addWidget(_input);
+
+      _results = new QListWidget(this);
+      _results->setUniformItemSizes(true);
+      _results->setFocusPolicy(Qt::NoFocus);
+      layout->addWidget(_results);
+
+      // every keystroke rescores, the finder keeps it within a frame
+      connect(_input, &QLineEdit::textChanged, this, &QuickOpen::refresh);
+      connect(_results, &QListWidget::itemClicked, this, &QuickOpen::choose);
+
+      // goes away like a popup once the focus leaves it
+      connect(qApp, &QApplication::focusChanged, this, [this](QWidget*, QWidget* now){
+        if (isVisible() && (!now || !isAncestorOf(now)))
+          hide();
+      });
+    }
+
+    TrigramIndex* _index{nullptr};
+    FuzzyFinder _finder;
+    QLineEdit* _input{nullptr};
+    QListWidget* _results{nullptr};
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_QUICKOPEN_H
@@ -0,0 +1,177 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_SAVESERVICE_H
+#define QWIDGET_LUA_EDITOR_SAVESERVICE_H
+
+#include <QByteArray>
+#include <QDir>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QObject>
+#include <QSaveFile>
+#include <QString>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace aic
+{
+
+  // Writes files on its own I/O thread, shared by the editor and the agent. Every write goes
+  // to a temporary file in the same directory, is flushed to disk and renamed over the
+  // target, so a crash leaves either the old or the new content, never a truncated file.
+  // Saves of a path still waiting in the queue are merged: only the last content is
+  // written and every caller is told the result.
+  class SaveService : public QObject
+  {
+  Q_OBJECT
+
+  public:
+    // Called on the thread of the service (the GUI thread)
+    using Callback = std::function<void(bool ok, const QString& error)>;
+
+    explicit SaveService(QObject* parent = nullptr): QObject(parent)
+    {
+      _thread = std::thread([this](){ run(); });
+    }
+
+    // Writes what is still queued before returning
+    ~SaveService() override
+    {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+      }
+
+      _wake.notify_one();
+      if (_thread.joinable())
+        _thread.join();
+    }
+
+    void save(const QString& filePath, QByteArray content, Callback done = nullptr)
+    {
+      const QString path = QFileInfo(filePath).absoluteFilePath();
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _pending.find(path);
+        if (it == _pending.end()) {
+          it = _pending.emplace(path, Pending{}).first;
+          _order.push_back(path);
+        }
+
+        it->second.content = std::move(content);
+        if (done)
+          it->second.callbacks.push_back(std::move(done));
+      }
+
+      _wake.notify_one();
+    }
+
+  signals:
+    // A file reached the disk, whoever wrote it
+    void saved(const QString& filePath);
+
+  private:
+    struct Pending
+    {
+      QByteArray content;
+      std::vector<Callback> callbacks;
+    };
+
+    struct QStringHash
+    {
+      size_t operator()(const QString& value) const { return qHash(value); }
+    };
+
+    void run()
+    {
+      while (true) {
+        QString path;
+        Pending pending;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _wake.wait(lock, [this](){ return _stop || !_order.empty(); });
+
+          if (_order.empty())
+            return;
+
+          // taken out of the map, a save arriving while this one is written waits its turn
+          path = _order.front();
+          _order.pop_front();
+          pending = std::move(_pending[path]);
+          _pending.erase(path);
+        }
+
+        QString error;
+        bool ok = write(path, pending.content, error);
+
+        if (pending.callbacks.empty() && !ok)
+          continue;
+
+        QMetaObject::invokeMethod(this, [this, path, callbacks = std::move(pending.callbacks), ok, error](){
+          if (ok)
+            emit saved(path);
+          for (const auto& callback : callbacks)
+            callback(ok, error);
+        }, Qt::QueuedConnection);
+      }
+    }
+
+    static bool write(const QString& path, const QByteArray& content, QString& error)
+    {
+      QFileInfo info(path);
+      if (!QDir().mkpath(info.absolutePath())) {
+        error = QObject::tr("Could not create %1").arg(info.absolutePath());
+        return false;
+      }
+
+      // QSaveFile writes aside, syncs the file to disk on commit and then renames it
+      QSaveFile file(path);
+      if (!file.open(QIODevice::WriteOnly)) {
+        error = file.errorString();
+        return false;
+      }
+
+      if (file.write(content) != content.size()) {
+        error = file.errorString();
+        file.cancelWriting();
+        return false;
+      }
+
+      if (!file.commit()) {
+        error = file.errorString();
+        return false;
+      }
+
+#ifdef Q_OS_UNIX
+      // the rename is only durable once the directory entry is on disk too
+      int directory = ::open(QFile::encodeName(info.absolutePath()).constData(), O_RDONLY);
+      if (directory >= 0) {
+        ::fsync(directory);
+        ::close(directory);
+      }
+#endif
+
+      return true;
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::deque<QString> _order;
+    std::unordered_map<QString, Pending, QStringHash> _pending;
+    bool _stop{false};
+    std::thread _thread;
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_SAVESERVICE_H
@@ -0,0 +1,636 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_SEARCHENGINE_H
+#define QWIDGET_LUA_EDITOR_SEARCHENGINE_H
+
+#include "ScintillaEdit.h"
+#include "MagiaTheme.h"
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace aic
+{
+
+  // Finds and replaces in the document shown by a view. Matches are counted and indexed
+  // by a scan that runs in short slices on the GUI thread between events, so typing stays
+  // responsive on huge buffers and the document is never read while it changes. Literal
+  // queries are scanned with Boyer-Moore-Horspool straight on the document buffer, regular
+  // expressions with SCI_SEARCHINTARGET one block of lines at a time. Finding, highlighting
+  // and counting share the scanner of their query kind, so they agree on what matches.
+  // Only the visible range is highlighted.
+  class SearchEngine : public QObject
+  {
+  Q_OBJECT
+
+  public:
+    struct Query
+    {
+      QByteArray text;
+      bool matchCase{false};
+      bool wholeWord{false};
+      bool regex{false};
+    };
+
+    struct Match
+    {
+      sptr_t start;
+      sptr_t end;
+    };
+
+    static constexpr int MatchIndicator = INDICATOR_CONTAINER;
+
+    // Matches past this one are counted but not indexed
+    static constexpr size_t MaxIndexedMatches = 1 << 20;
+
+    explicit SearchEngine(ScintillaEdit* view, QObject* parent = nullptr): QObject(parent), _view(view)
+    {
+      _view->send(SCI_INDICSETSTYLE, MatchIndicator, INDIC_ROUNDBOX);
+      _view->send(SCI_INDICSETFORE, MatchIndicator, mg::theme::ScintillaColors::BRACE_MATCH);
+      _view->send(SCI_INDICSETALPHA, MatchIndicator, 60);
+      _view->send(SCI_INDICSETUNDER, MatchIndicator, true);
+
+      _sliceTimer = new QTimer(this);
+      _sliceTimer->setSingleShot(true);
+      _sliceTimer->setInterval(0);
+      connect(_sliceTimer, &QTimer::timeout, this, &SearchEngine::scanSlice);
+
+      // typing restarts the count once, not on every key
+      _restartTimer = new QTimer(this);
+      _restartTimer->setSingleShot(true);
+      _restartTimer->setInterval(150);
+      connect(_restartTimer, &QTimer::timeout, this, &SearchEngine::restart);
+
+      connect(_view, &ScintillaEditBase::modified, this, [this](Scintilla::ModificationFlags type, Scintilla::Position position, Scintilla::Position length,
+                                                                Scintilla::Position, const QByteArray&, Scintilla::Position,
+                                                                Scintilla::FoldLevel, Scintilla::FoldLevel){
+        const int flags = static_cast<int>(type);
+        if (flags & SC_MOD_INSERTTEXT)
+          shiftHighlighted(position, length);
+        else if (flags & SC_MOD_DELETETEXT)
+          shiftHighlighted(position, -length);
+
+        if (!_query.text.isEmpty() && (flags & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))) {
+          _sliceTimer->stop();
+          _complete = false;
+          _restartTimer->start();
+        }
+      });
+
+      connect(_view, &ScintillaEditBase::updateUi, this, [this](Scintilla::Update updated){
+        // not on content updates, the indicators set here are one
+        if (static_cast<int>(updated) & (SC_UPDATE_V_SCROLL | SC_UPDATE_H_SCROLL))
+          highlightVisible();
+      });
+    }
+
+    const Query& query() const
+    {
+      return _query;
+    }
+
+    void setQuery(const Query& query)
+    {
+      _query = query;
+      restart();
+    }
+
+    qint64 count() const
+    {
+      return _count;
+    }
+
+    bool isComplete() const
+    {
+      return _complete;
+    }
+
+    // Throws the count away and scans the document shown again
+    void restart()
+    {
+      _sliceTimer->stop();
+      _restartTimer->stop();
+      _matches.clear();
+      _count = 0;
+      _position = 0;
+      _pendingJump = -1;
+      _complete = _query.text.isEmpty();
+      _document = _view->send(SCI_GETDOCPOINTER);
+
+      highlightVisible();
+      emit countChanged(_count, _complete);
+
+      if (!_complete)
+        _sliceTimer->start();
+    }
+
+    // Follows typing: selects the first match from the start of the selection. Until the
+    // index is complete only the visible range and TypeAheadBytes past it are read, a match
+    // further away is selected by the scan once it gets there.
+    bool findAsTyped()
+    {
+      if (_query.text.isEmpty())
+        return false;
+
+      if (indexIsExact())
+        return findNext(true, true);
+
+      sptr_t from = _view->send(SCI_GETSELECTIONSTART);
+      sptr_t windowEnd = std::min(_view->send(SCI_GETLENGTH), std::max(from, visibleEnd()) + TypeAheadBytes);
+
+      Match match = find(from, windowEnd);
+      if (match.start < 0) {
+        _pendingJump = from;
+        return false;
+      }
+
+      select(match);
+      return true;
+    }
+
+    // Selects the next match after the selection, or before it, wrapping around the
+    // document. fromStart searches from the start of the selection, to follow typing.
+    bool findNext(bool forward = true, bool fromStart = false)
+    {
+      if (_query.text.isEmpty())
+        return false;
+
+      // the user moved on, the scan no longer selects for the typing
+      _pendingJump = -1;
+
+      sptr_t length = _view->send(SCI_GETLENGTH);
+      sptr_t from = forward ? _view->send(fromStart ? SCI_GETSELECTIONSTART : SCI_GETSELECTIONEND)
+                            : _view->send(SCI_GETSELECTIONSTART);
+
+      Match match{-1, -1};
+      if (indexIsExact()) {
+        // binary search in the index instead of a scan of the text
+        if (_matches.empty())
+          return false;
+
+        if (forward) {
+          auto it = std::lower_bound(_matches.begin(), _matches.end(), from, [](const Match& m, sptr_t pos){ return m.start < pos; });
+          match = it != _matches.end() ? *it : _matches.front();
+        }
+        else {
+          auto it = std::lower_bound(_matches.begin(), _matches.end(), from, [](const Match& m, sptr_t pos){ return m.end <= pos; });
+          match = it != _matches.begin() ? *(it - 1) : _matches.back();
+        }
+      }
+      else {
+        match = forward ? find(from, length) : find(from, 0);
+        if (match.start < 0)
+          match = forward ? find(0, length) : find(length, 0);
+      }
+
+      if (match.start < 0)
+        return false;
+
+      select(match);
+      return true;
+    }
+
+    // Position of the selected match among all of them, -1 when unknown
+    qint64 currentMatch() const
+    {
+      sptr_t start = _view->send(SCI_GETSELECTIONSTART);
+      sptr_t end = _view->send(SCI_GETSELECTIONEND);
+      auto it = std::lower_bound(_matches.begin(), _matches.end(), start, [](const Match& m, sptr_t pos){ return m.start < pos; });
+      if (it == _matches.end() || it->start != start || it->end != end)
+        return -1;
+      return it - _matches.begin();
+    }
+
+    // Replaces the selection if it is a match, then selects the next one
+    bool replaceCurrent(const QByteArray& replacement)
+    {
+      sptr_t start = _view->send(SCI_GETSELECTIONSTART);
+      sptr_t end = _view->send(SCI_GETSELECTIONEND);
+
+      Match match = find(start, end);
+      if (match.start != start || match.end != end) {
+        findNext(true);
+        return false;
+      }
+
+      // the target and the tags of \1 to \9 are still those of the search above
+      if (_query.regex) {
+        _view->send(SCI_REPLACETARGETRE, replacement.size(), reinterpret_cast<sptr_t>(replacement.constData()));
+      }
+      else {
+        _view->send(SCI_SETTARGETRANGE, start, end);
+        _view->send(SCI_REPLACETARGET, replacement.size(), reinterpret_cast<sptr_t>(replacement.constData()));
+      }
+
+      _view->send(SCI_SETSEL, _view->send(SCI_GETTARGETEND), _view->send(SCI_GETTARGETEND));
+      findNext(true);
+      return true;
+    }
+
+    // Builds the replaced text in one pass and swaps it in with a single replacement, one
+    // undo action and one line index update instead of one per match. Returns the number
+    // of matches replaced.
+    qint64 replaceAll(const QByteArray& replacement)
+    {
+      if (_query.text.isEmpty() || _view->send(SCI_GETREADONLY))
+        return 0;
+
+      sptr_t length = _view->send(SCI_GETLENGTH);
+
+      // searching does not modify the document, the pointer stays valid for the whole pass
+      std::string_view text = range(0, length);
+      std::string replaced;
+      sptr_t first = -1;
+      sptr_t copied = 0;
+      qint64 count = 0;
+
+      auto append = [&](const Match& match, std::string_view with){
+        if (first < 0) {
+          first = match.start;
+          copied = match.start;
+        }
+
+        replaced.append(text.substr(static_cast<size_t>(copied), static_cast<size_t>(match.start - copied)));
+        replaced.append(with);
+        copied = match.end;
+        ++count;
+      };
+
+      if (_query.regex) {
+        std::string expanded;
+        for (sptr_t position = 0; position <= length;) {
+          Match match = search(position, length);
+          if (match.start < 0)
+            break;
+
+          expandReplacement(replacement, text.substr(static_cast<size_t>(match.start), static_cast<size_t>(match.end - match.start)), expanded);
+          append(match, expanded);
+          position = match.end > match.start ? match.end : match.start + 1;
+        }
+      }
+      else {
+        replaced.reserve(static_cast<size_t>(length));
+        forEachLiteral(text, 0, length, [&](const Match& match){
+          append(match, std::string_view(replacement.constData(), static_cast<size_t>(replacement.size())));
+          return true;
+        });
+      }
+
+      if (count == 0)
+        return 0;
+
+      _view->send(SCI_BEGINUNDOACTION);
+      _view->send(SCI_SETTARGETRANGE, first, copied);
+      _view->send(SCI_REPLACETARGET, static_cast<uptr_t>(replaced.size()), reinterpret_cast<sptr_t>(replaced.data()));
+      _view->send(SCI_ENDUNDOACTION);
+
+      restart();
+      return count;
+    }
+
+  signals:
+    // complete is false while the scan is still going
+    void countChanged(qint64 count, bool complete);
+
+  private:
+    static constexpr qint64 SliceMilliseconds = 8;
+    static constexpr sptr_t ChunkBytes = 4 * 1024 * 1024;
+    static constexpr sptr_t TypeAheadBytes = 4 * 1024 * 1024;
+
+    static bool isWordChar(unsigned char c)
+    {
+      return std::isalnum(c) || c == '_' || c >= 0x80;
+    }
+
+    // The index holds every match of the document shown
+    bool indexIsExact() const
+    {
+      return _complete && _count == static_cast<qint64>(_matches.size()) && _document == _view->send(SCI_GETDOCPOINTER);
+    }
+
+    void select(const Match& match)
+    {
+      _view->send(SCI_SETSEL, match.start, match.end);
+      _view->send(SCI_SCROLLRANGE, match.end, match.start);
+    }
+
+    // End of the last line on screen
+    sptr_t visibleEnd() const
+    {
+      sptr_t lastLine = _view->send(SCI_DOCLINEFROMVISIBLE, _view->send(SCI_GETFIRSTVISIBLELINE) + _view->send(SCI_LINESONSCREEN) + 1);
+      return _view->send(SCI_GETLINEENDPOSITION, lastLine);
+    }
+
+    // Selects the match findAsTyped left to the scan once the index holds it, the first
+    // one when the scan wrapped past the end
+    void resolvePendingJump()
+    {
+      if (_pendingJump < 0)
+        return;
+
+      auto it = std::lower_bound(_matches.begin(), _matches.end(), _pendingJump, [](const Match& m, sptr_t pos){ return m.start < pos; });
+      if (it != _matches.end()) {
+        _pendingJump = -1;
+        select(*it);
+      }
+      else if (_complete || _matches.size() >= MaxIndexedMatches) {
+        _pendingJump = -1;
+        if (_complete && !_matches.empty() && _count == static_cast<qint64>(_matches.size()))
+          select(_matches.front());
+      }
+    }
+
+    // Points into the document buffer, valid until the next modification
+    std::string_view range(sptr_t start, sptr_t end) const
+    {
+      if (end <= start)
+        return {};
+
+      auto* text = reinterpret_cast<const char*>(_view->send(SCI_GETRANGEPOINTER, start, end - start));
+      return {text, static_cast<size_t>(end - start)};
+    }
+
+    int searchFlags() const
+    {
+      int flags = 0;
+      if (_query.matchCase)
+        flags |= SCFIND_MATCHCASE;
+      if (_query.wholeWord)
+        flags |= SCFIND_WHOLEWORD;
+      if (_query.regex)
+        flags |= SCFIND_REGEX | SCFIND_CXX11REGEX;
+      return flags;
+    }
+
+    // One SCI_SEARCHINTARGET between from and to, backwards when to is before from
+    Match search(sptr_t from, sptr_t to)
+    {
+      _view->send(SCI_SETSEARCHFLAGS, searchFlags());
+      _view->send(SCI_SETTARGETRANGE, from, to);
+      sptr_t found = _view->send(SCI_SEARCHINTARGET, _query.text.size(), reinterpret_cast<sptr_t>(_query.text.constData()));
+      if (found < 0)
+        return {-1, -1};
+      return {found, _view->send(SCI_GETTARGETEND)};
+    }
+
+    // First match between from and to, the last one when to is before from. Literal queries
+    // go through the scanner of the count, Scintilla folds case beyond ASCII and would find
+    // matches the count does not know about.
+    Match find(sptr_t from, sptr_t to)
+    {
+      if (_query.regex)
+        return search(from, to);
+
+      Match found{-1, -1};
+      const bool forward = from <= to;
+      const sptr_t start = forward ? from : to;
+      const sptr_t end = forward ? to : from;
+      forEachLiteral(range(start, end), start, end, [&](const Match& match){
+        found = match;
+        return !forward;
+      });
+      return found;
+    }
+
+    // \0 to \9 are the groups of the last regex search, \\ a backslash, as in SCI_REPLACETARGETRE
+    void expandReplacement(const QByteArray& replacement, std::string_view matched, std::string& expanded)
+    {
+      expanded.clear();
+      for (int i = 0; i < replacement.size(); ++i) {
+        char c = replacement[i];
+        if (c != '\\' || i + 1 >= replacement.size()) {
+          expanded += c;
+          continue;
+        }
+
+        char next = replacement[++i];
+        if (next == '0') {
+          expanded.append(matched);
+        }
+        else if (next >= '1' && next <= '9') {
+          auto length = _view->send(SCI_GETTAG, next - '0', 0);
+          std::string tag(static_cast<size_t>(length), '\0');
+          _view->send(SCI_GETTAG, next - '0', reinterpret_cast<sptr_t>(tag.data()));
+          expanded += tag;
+        }
+        else if (next == '\\') {
+          expanded += '\\';
+        }
+        else {
+          expanded += '\\';
+          expanded += next;
+        }
+      }
+    }
+
+    // Calls onMatch for the non-overlapping matches starting in [offset, offset + text.size())
+    // that begin before limit, until it returns false. text starts at document position offset.
+    template<typename Callback>
+    void forEachLiteral(std::string_view text, sptr_t offset, sptr_t limit, Callback&& onMatch)
+    {
+      std::string_view pattern(_query.text.constData(), static_cast<size_t>(_query.text.size()));
+      sptr_t length = _view->send(SCI_GETLENGTH);
+
+      auto wholeWordAt = [&](sptr_t start, sptr_t end){
+        if (!_query.wholeWord)
+          return true;
+        bool before = start > 0 && isWordChar(static_cast<unsigned char>(_view->send(SCI_GETCHARAT, start - 1)));
+        bool after = end < length && isWordChar(static_cast<unsigned char>(_view->send(SCI_GETCHARAT, end)));
+        return !before && !after;
+      };
+
+      auto scan = [&](const auto& searcher){
+        auto it = text.begin();
+        while (true) {
+          auto found = std::search(it, text.end(), searcher);
+          if (found == text.end())
+            return;
+
+          sptr_t start = offset + (found - text.begin());
+          if (start >= limit)
+            return;
+
+          sptr_t end = start + static_cast<sptr_t>(pattern.size());
+          if (wholeWordAt(start, end)) {
+            if (!onMatch(Match{start, end}))
+              return;
+            it = found + static_cast<ptrdiff_t>(pattern.size());
+          }
+          else {
+            it = found + 1;
+          }
+        }
+      };
+
+      if (_query.matchCase) {
+        scan(std::boyer_moore_horspool_searcher(pattern.begin(), pattern.end()));
+        return;
+      }
+
+      // ASCII case folding, bytes of multibyte characters compare as they are
+      auto hash = [](char c){ return std::hash<int>()(std::tolower(static_cast<unsigned char>(c))); };
+      auto equal = [](char a, char b){ return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); };
+      scan(std::boyer_moore_horspool_searcher(pattern.begin(), pattern.end(), hash, equal));
+    }
+
+    void addMatch(const Match& match)
+    {
+      if (_matches.size() < MaxIndexedMatches)
+        _matches.push_back(match);
+      ++_count;
+    }
+
+    void scanSlice()
+    {
+      // the view moved to another document, its count means nothing here
+      if (_document != _view->send(SCI_GETDOCPOINTER)) {
+        restart();
+        return;
+      }
+
+      QElapsedTimer clock;
+      clock.start();
+
+      sptr_t length = _view->send(SCI_GETLENGTH);
+      while (_position < length && clock.elapsed() < SliceMilliseconds) {
+        if (_query.regex)
+          scanRegexChunk(length);
+        else
+          scanLiteralChunk(length);
+      }
+
+      _complete = _position >= length;
+      resolvePendingJump();
+      emit countChanged(_count, _complete);
+
+      if (!_complete)
+        _sliceTimer->start();
+    }
+
+    void scanLiteralChunk(sptr_t length)
+    {
+      sptr_t patternLength = _query.text.size();
+      sptr_t chunkEnd = std::min(length, _position + ChunkBytes);
+
+      // a match may start at the end of the chunk and cross into the next one
+      sptr_t windowEnd = std::min(length, chunkEnd + patternLength - 1);
+      sptr_t next = chunkEnd;
+
+      forEachLiteral(range(_position, windowEnd), _position, chunkEnd, [&](const Match& match){
+        addMatch(match);
+        next = std::max(next, match.end);
+        return true;
+      });
+
+      _position = next;
+    }
+
+    void scanRegexChunk(sptr_t length)
+    {
+      // Scintilla's regular expressions do not cross lines, chunks end on a line end
+      sptr_t chunkEnd = _view->send(SCI_GETLINEENDPOSITION, _view->send(SCI_LINEFROMPOSITION, std::min(length, _position + ChunkBytes)));
+      chunkEnd = std::max(chunkEnd, _position + 1);
+
+      while (_position < chunkEnd) {
+        Match match = search(_position, chunkEnd);
+        if (match.start < 0)
+          break;
+
+        addMatch(match);
+        _position = match.end > match.start ? match.end : match.start + 1;
+      }
+
+      _position = std::max(_position, chunkEnd);
+    }
+
+    // Keeps the highlighted range on the text it covers while the document is edited
+    void shiftHighlighted(sptr_t position, sptr_t delta)
+    {
+      auto shift = [&](sptr_t& at){
+        if (delta > 0 && at >= position)
+          at += delta;
+        else if (delta < 0 && at > position)
+          at = std::max(position, at + delta);
+      };
+
+      // an insertion at the end still shows indicators that were filled before it
+      if (delta > 0 && position == _highlighted.end)
+        _highlighted.end += delta;
+      else
+        shift(_highlighted.end);
+      shift(_highlighted.start);
+    }
+
+    void highlightVisible()
+    {
+      _view->send(SCI_SETINDICATORCURRENT, MatchIndicator);
+
+      // only what was highlighted last time is cleared, the document shown may have come
+      // back with indicators of its own though
+      sptr_t document = _view->send(SCI_GETDOCPOINTER);
+      if (document != _highlightedDocument)
+        _view->send(SCI_INDICATORCLEARRANGE, 0, _view->send(SCI_GETLENGTH));
+      else if (_highlighted.end > _highlighted.start)
+        _view->send(SCI_INDICATORCLEARRANGE, _highlighted.start, _highlighted.end - _highlighted.start);
+
+      _highlightedDocument = document;
+      _highlighted = {0, 0};
+
+      if (_query.text.isEmpty())
+        return;
+
+      sptr_t firstLine = _view->send(SCI_DOCLINEFROMVISIBLE, _view->send(SCI_GETFIRSTVISIBLELINE));
+      sptr_t start = _view->send(SCI_POSITIONFROMLINE, firstLine);
+      sptr_t end = visibleEnd();
+
+      // searching a screen of text is cheaper than keeping the index in sync with edits
+      sptr_t targetStart = _view->send(SCI_GETTARGETSTART);
+      sptr_t targetEnd = _view->send(SCI_GETTARGETEND);
+      auto fill = [this](const Match& match){
+        _view->send(SCI_INDICATORFILLRANGE, match.start, match.end - match.start);
+        if (_highlighted.end <= _highlighted.start)
+          _highlighted.start = match.start;
+        _highlighted.end = match.end;
+        return true;
+      };
+
+      if (_query.regex) {
+        for (sptr_t position = start; position < end;) {
+          Match match = search(position, end);
+          if (match.start < 0)
+            break;
+
+          fill(match);
+          position = match.end > match.start ? match.end : match.start + 1;
+        }
+      }
+      else {
+        forEachLiteral(range(start, end), start, end, fill);
+      }
+      _view->send(SCI_SETTARGETRANGE, targetStart, targetEnd);
+    }
+
+    ScintillaEdit* _view{nullptr};
+    QTimer* _sliceTimer{nullptr};
+    QTimer* _restartTimer{nullptr};
+    Query _query;
+    std::vector<Match> _matches;
+    qint64 _count{0};
+    sptr_t _position{0};
+    sptr_t _document{0};
+    sptr_t _pendingJump{-1};
+    bool _complete{true};
+    Match _highlighted{0, 0};
+    sptr_t _highlightedDocument{0};
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_SEARCHENGINE_H
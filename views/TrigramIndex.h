@@ -0,0 +1,1035 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_TRIGRAMINDEX_H
+#define QWIDGET_LUA_EDITOR_TRIGRAMINDEX_H
+
+#include "IgnoreRules.h"
+#include "WorkspaceSearch.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QMetaObject>
+#include <QObject>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace aic
+{
+
+  // Trigram inverted index of the text files of a workspace: for every 3 byte sequence
+  // (ASCII letters folded to lower case) the sorted ids of the files containing it. A query
+  // intersects the lists of its trigrams and only the files left are searched for real, so
+  // a search over a huge tree reads a handful of files instead of all of them.
+  //
+  // The index lives in the cache directory in one file that is memory mapped as is: a
+  // header, the file table sorted by path, the paths, the posting lists (delta encoded
+  // varints) and the trigram table sorted by trigram. Files changed since the index was
+  // written (saves, watched directories) are kept in a small overlay that takes precedence
+  // over the mapped file; a background refresh walks the tree, reuses the lists of every
+  // file whose size and modification time did not change, reads only the others and writes
+  // a new file that replaces the mapped one. The files read are inverted in bounded batches
+  // into sorted runs, merged with the old lists trigram by trigram as the file is written.
+  class TrigramIndex : public QObject
+  {
+  Q_OBJECT
+
+  public:
+    // Changes kept in memory before the index file is rewritten
+    static constexpr int MaxOverlayFiles = 2000;
+    static constexpr int MaxWatchedDirectories = 4096;
+
+    // Trees with more directories than can be watched are walked again this often
+    static constexpr int RescanMilliseconds = 2 * 60 * 1000;
+
+    // A refresh reads this many files, or this much text, at a time and sorts the pairs of
+    // a run once it holds RunPairs of them
+    static constexpr size_t BatchFiles = 4096;
+    static constexpr int64_t BatchBytes = 32 * 1024 * 1024;
+    static constexpr size_t RunPairs = 8 * 1024 * 1024;
+
+    explicit TrigramIndex(QObject* parent = nullptr): QObject(parent)
+    {
+      _watcher = new QFileSystemWatcher(this);
+      connect(_watcher, &QFileSystemWatcher::directoryChanged, this, &TrigramIndex::directoryChanged);
+
+      _rescanTimer = new QTimer(this);
+      _rescanTimer->setInterval(RescanMilliseconds);
+      connect(_rescanTimer, &QTimer::timeout, this, [this](){
+        if (!_refreshThread.joinable())
+          startRefresh();
+      });
+
+      _readerThread = std::thread([this](){ readChanges(); });
+    }
+
+    ~TrigramIndex() override
+    {
+      {
+        std::lock_guard<std::mutex> lock(_readMutex);
+        _stopReader = true;
+      }
+      _readWake.notify_one();
+      if (_readerThread.joinable())
+        _readerThread.join();
+
+      stopRefresh();
+    }
+
+    // Indexes root: the index written last time answers right away, a refresh brings it up
+    // to date in the background
+    void open(const QString& root)
+    {
+      stopRefresh();
+      _rescanTimer->stop();
+
+      _root = QDir(root).absolutePath();
+      _indexPath = indexPathFor(_root);
+      _overlay.clear();
+      _rules.clear();
+      _base = Base::open(_indexPath);
+      _stale.assign(_base ? _base->header->fileCount : 0, false);
+
+      if (_base)
+        emit ready(static_cast<int>(_base->header->fileCount));
+
+      startRefresh();
+    }
+
+    bool isReady() const
+    {
+      return _base != nullptr;
+    }
+
+    QString root() const
+    {
+      return _root;
+    }
+
+    // Absolute paths of the files under directory (the whole workspace when empty) that may
+    // contain text, ASCII case ignored: the text of a search folding Unicode case goes
+    // through WorkspaceSearch::prefilterLiteral first. Empty when the index cannot tell,
+    // text shorter than a trigram or no index yet: every file has to be searched.
+    // Directories past the watch limit are only seen by the periodic rescan, changes there
+    // show up at most RescanMilliseconds late.
+    std::optional<QStringList> candidates(const QByteArray& text, const QString& directory = {}) const
+    {
+      if (!_base || text.size() < 3)
+        return std::nullopt;
+
+      QString prefix;
+      if (!directory.isEmpty()) {
+        prefix = QDir(_root).relativeFilePath(QDir(directory).absolutePath());
+        if (prefix.startsWith(".."))
+          return std::nullopt;
+        prefix = prefix == "." ? QString() : prefix + "/";
+      }
+
+      const Trigrams wanted = trigramsOf(text.constData(), static_cast<size_t>(text.size()));
+      QStringList result;
+
+      for (uint32_t id : _base->intersect(wanted)) {
+        if (_stale[id])
+          continue;
+
+        QString path = QString::fromUtf8(_base->path(id).data(), static_cast<int>(_base->path(id).size()));
+        if (path.startsWith(prefix))
+          result.push_back(_root + "/" + path);
+      }
+
+      for (const auto& [path, change] : _overlay) {
+        if (change.removed || !path.startsWith(prefix))
+          continue;
+
+        bool all = std::all_of(wanted.begin(), wanted.end(), [&](uint32_t trigram){
+          return std::binary_search(change.trigrams.begin(), change.trigrams.end(), trigram);
+        });
+        if (all)
+          result.push_back(_root + "/" + path);
+      }
+
+      return result;
+    }
+
+    // Files containing the most words (3 characters or more) of query, with how many of
+    // them each one has, best first
+    std::vector<std::pair<QString, int>> rankFiles(const QString& query, int limit) const
+    {
+      QStringList words;
+      for (const auto& word : query.toLower().split(QRegularExpression("[^\\w]+"), Qt::SkipEmptyParts))
+        if (word.size() >= 3 && !words.contains(word))
+          words.push_back(word);
+
+      std::unordered_map<QString, int, QStringHash> hits;
+      for (const auto& word : words) {
+        auto files = candidates(word.toUtf8());
+        if (!files)
+          continue;
+        for (const auto& file : *files)
+          ++hits[file];
+      }
+
+      std::vector<std::pair<QString, int>> ranked(hits.begin(), hits.end());
+      std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b){
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+      });
+      if (static_cast<int>(ranked.size()) > limit)
+        ranked.resize(static_cast<size_t>(limit));
+
+      return ranked;
+    }
+
+    // path was written, created or removed. The file is read on the reader thread, the
+    // overlay gets it a moment later.
+    void fileChanged(const QString& filePath)
+    {
+      if (_root.isEmpty())
+        return;
+
+      const QFileInfo info(filePath);
+      if (info.isDir())
+        return;
+
+      // the rules loaded so far may not hold anymore
+      if (info.fileName() == ".gitignore")
+        _rules.clear();
+
+      const QString relative = QDir(_root).relativeFilePath(info.absoluteFilePath());
+      if (relative.startsWith("..") || ignored(info.absoluteFilePath()))
+        return;
+
+      {
+        std::lock_guard<std::mutex> lock(_readMutex);
+        auto it = std::find_if(_toRead.begin(), _toRead.end(), [&](const PendingRead& read){ return read.relative == relative; });
+        if (it != _toRead.end())
+          it->sequence = ++_sequence;
+        else
+          _toRead.push_back({_root, relative, ++_sequence});
+      }
+      _readWake.notify_one();
+    }
+
+    // Relative paths of the files the index knows, the mapped ones and the overlay
+    void forEachFile(const std::function<void(std::string_view path)>& visit) const
+    {
+      for (uint32_t id = 0; _base && id < _base->header->fileCount; ++id)
+        if (!_stale[id])
+          visit(_base->path(id));
+
+      for (const auto& [path, change] : _overlay) {
+        if (!change.removed) {
+          const std::string utf8 = path.toStdString();
+          visit(utf8);
+        }
+      }
+    }
+
+  signals:
+    // The index answers queries, fileCount files are in the mapped file
+    void ready(int fileCount);
+
+    // Every file under the root, relative and sorted, as found by the walk of a refresh
+    void filesListed(std::shared_ptr<const std::vector<std::string>> paths);
+
+    // A file was written, created or removed after the last walk
+    void fileUpdated(const QString& relativePath, bool removed);
+
+  private:
+    using Trigrams = std::vector<uint32_t>;   // sorted, no duplicates
+
+    // one bit per trigram, 2 MB
+    static constexpr size_t Bitmap = (1u << 24) / 64;
+
+    struct QStringHash
+    {
+      size_t operator()(const QString& value) const { return qHash(value); }
+    };
+
+    struct Header
+    {
+      char magic[4];
+      uint32_t version;
+      uint32_t fileCount;
+      uint32_t trigramCount;
+      uint64_t files;       // offsets from the start of the file
+      uint64_t paths;
+      uint64_t postings;
+      uint64_t trigrams;
+      uint64_t size;
+    };
+
+    struct FileEntry
+    {
+      uint64_t path;        // from the start of the paths
+      uint32_t length;
+      uint32_t reserved;
+      int64_t modified;     // msecs since epoch
+      int64_t size;
+    };
+
+    struct TrigramEntry
+    {
+      uint32_t trigram;
+      uint32_t count;
+      uint64_t postings;    // from the start of the postings
+    };
+
+    static_assert(sizeof(Header) % 8 == 0 && sizeof(FileEntry) == 32 && sizeof(TrigramEntry) == 16, "index layout");
+
+    static constexpr char Magic[4] = {'M', 'G', 'T', 'I'};
+    static constexpr uint32_t Version = 1;
+
+    // The mapped index file, never written: the refresh thread reads it while the GUI
+    // thread answers queries from it
+    struct Base
+    {
+      QFile file;
+      const uchar* data{nullptr};
+      const Header* header{nullptr};
+      const FileEntry* files{nullptr};
+      const TrigramEntry* trigrams{nullptr};
+
+      static std::shared_ptr<const Base> open(const QString& indexPath)
+      {
+        auto base = std::make_shared<Base>();
+        base->file.setFileName(indexPath);
+        if (!base->file.open(QIODevice::ReadOnly) || base->file.size() < static_cast<qint64>(sizeof(Header)))
+          return nullptr;
+
+        const auto size = static_cast<uint64_t>(base->file.size());
+        base->data = base->file.map(0, base->file.size());
+        if (!base->data)
+          return nullptr;
+
+        // anything off and the index is rebuilt rather than trusted
+        const auto* header = reinterpret_cast<const Header*>(base->data);
+        if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version || header->size != size ||
+            header->files + uint64_t(header->fileCount) * sizeof(FileEntry) > header->paths || header->paths > header->postings ||
+            header->postings > header->trigrams || header->trigrams % 8 != 0 ||
+            header->trigrams + uint64_t(header->trigramCount) * sizeof(TrigramEntry) != size)
+          return nullptr;
+
+        base->header = header;
+        base->files = reinterpret_cast<const FileEntry*>(base->data + header->files);
+        base->trigrams = reinterpret_cast<const TrigramEntry*>(base->data + header->trigrams);
+        return base;
+      }
+
+      std::string_view path(uint32_t id) const
+      {
+        const auto& entry = files[id];
+        return {reinterpret_cast<const char*>(data + header->paths + entry.path), entry.length};
+      }
+
+      // First file whose path is not less than relative
+      uint32_t lowerBound(std::string_view relative) const
+      {
+        uint32_t low = 0;
+        uint32_t high = header->fileCount;
+        while (low < high) {
+          uint32_t middle = low + (high - low) / 2;
+          if (path(middle) < relative)
+            low = middle + 1;
+          else
+            high = middle;
+        }
+        return low;
+      }
+
+      int find(std::string_view relative) const
+      {
+        uint32_t id = lowerBound(relative);
+        return id < header->fileCount && path(id) == relative ? static_cast<int>(id) : -1;
+      }
+
+      const TrigramEntry* lookup(uint32_t trigram) const
+      {
+        auto end = trigrams + header->trigramCount;
+        auto it = std::lower_bound(trigrams, end, trigram, [](const TrigramEntry& entry, uint32_t value){
+          return entry.trigram < value;
+        });
+        return it != end && it->trigram == trigram ? it : nullptr;
+      }
+
+      std::vector<uint32_t> postings(const TrigramEntry& entry) const
+      {
+        std::vector<uint32_t> ids;
+        ids.reserve(entry.count);
+
+        const uchar* p = data + header->postings + entry.postings;
+        uint32_t id = 0;
+        for (uint32_t i = 0; i < entry.count; ++i) {
+          uint32_t delta = 0;
+          for (int shift = 0;; shift += 7) {
+            delta |= uint32_t(*p & 0x7f) << shift;
+            if (!(*p++ & 0x80))
+              break;
+          }
+          id += delta;
+          ids.push_back(id);
+        }
+        return ids;
+      }
+
+      // Files holding every trigram, shortest lists first. Once few files are left a list
+      // much longer than them filters too little to pay for its decoding, the real search
+      // that follows drops the false positives anyway.
+      std::vector<uint32_t> intersect(const Trigrams& wanted) const
+      {
+        std::vector<const TrigramEntry*> lists;
+        for (uint32_t trigram : wanted) {
+          auto entry = lookup(trigram);
+          if (!entry)
+            return {};
+          lists.push_back(entry);
+        }
+
+        std::sort(lists.begin(), lists.end(), [](auto a, auto b){ return a->count < b->count; });
+
+        std::vector<uint32_t> ids = postings(*lists.front());
+        for (size_t i = 1; i < lists.size() && !ids.empty(); ++i) {
+          if (ids.size() < 64 && lists[i]->count > 16 * ids.size())
+            break;
+
+          auto other = postings(*lists[i]);
+          std::vector<uint32_t> both;
+          std::set_intersection(ids.begin(), ids.end(), other.begin(), other.end(), std::back_inserter(both));
+          ids.swap(both);
+        }
+        return ids;
+      }
+    };
+
+    // A file changed after the mapped index was written
+    struct Change
+    {
+      Trigrams trigrams;
+      bool removed{false};
+      uint64_t sequence{0};
+      int64_t modified{0};
+      int64_t size{0};
+    };
+
+    // A file fileChanged handed to the reader thread
+    struct PendingRead
+    {
+      QString root;
+      QString relative;
+      uint64_t sequence{0};
+    };
+
+    // A file found by the refresh walk
+    struct Entry
+    {
+      std::string path;     // relative, UTF-8
+      int64_t modified{0};
+      int64_t size{0};
+    };
+
+    // Sorted (trigram << 32 | id) pairs of consecutive batches of a refresh. The last run
+    // stays in memory, the others wait in a temporary file and are read back a block at a
+    // time while the index is written.
+    struct Run
+    {
+      static constexpr size_t BlockPairs = 64 * 1024;
+
+      std::vector<uint64_t> block;
+      size_t position{0};
+      std::unique_ptr<QTemporaryFile> file;   // null when the whole run is in block
+      bool failed{false};
+
+      bool spill(const std::vector<uint64_t>& pairs, const QString& directory)
+      {
+        file = std::make_unique<QTemporaryFile>(directory + "/run-XXXXXX");
+        const auto bytes = static_cast<qint64>(pairs.size() * sizeof(uint64_t));
+        return file->open() && file->write(reinterpret_cast<const char*>(pairs.data()), bytes) == bytes && file->seek(0);
+      }
+
+      // Reads the next block once the current one is used up
+      bool atEnd()
+      {
+        if (position < block.size())
+          return false;
+
+        block.clear();
+        position = 0;
+        if (!file)
+          return true;
+
+        block.resize(BlockPairs);
+        const qint64 read = file->read(reinterpret_cast<char*>(block.data()), static_cast<qint64>(BlockPairs * sizeof(uint64_t)));
+        failed = failed || read < 0 || read % static_cast<qint64>(sizeof(uint64_t)) != 0;
+        block.resize(read > 0 ? static_cast<size_t>(read) / sizeof(uint64_t) : 0);
+        return block.empty();
+      }
+
+      uint64_t head() const
+      {
+        return block[position];
+      }
+
+      void pop()
+      {
+        ++position;
+      }
+    };
+
+    static QString indexPathFor(const QString& root)
+    {
+      const QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/trigrams";
+      QDir().mkpath(directory);
+      return directory + "/" + QCryptographicHash::hash(root.toUtf8(), QCryptographicHash::Sha1).toHex() + ".idx";
+    }
+
+    static uint32_t fold(uchar c)
+    {
+      return c >= 'A' && c <= 'Z' ? c + 32u : c;
+    }
+
+    static Trigrams trigramsOf(const char* text, size_t size)
+    {
+      Trigrams trigrams;
+      uint32_t trigram = 0;
+      for (size_t i = 0; i < size; ++i) {
+        trigram = ((trigram << 8) | fold(static_cast<uchar>(text[i]))) & 0xffffff;
+        if (i >= 2)
+          trigrams.push_back(trigram);
+      }
+
+      std::sort(trigrams.begin(), trigrams.end());
+      trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+      return trigrams;
+    }
+
+    // Trigrams of a file through a bitmap, which dedups them without sorting millions of
+    // repeats. Binary files come out without trigrams, false only when it cannot be read.
+    static bool readTrigrams(const QString& path, Trigrams& trigrams, std::vector<uint64_t>& seen)
+    {
+      trigrams.clear();
+
+      QFile file(path);
+      if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+      const qint64 size = file.size();
+      if (size < 3 || size > WorkspaceSearch::MaxFileBytes)
+        return true;
+
+      auto* data = file.map(0, size);
+      if (!data)
+        return false;
+
+      if (std::memchr(data, 0, static_cast<size_t>(std::min<qint64>(size, 8192))))
+        return true;
+
+      uint32_t trigram = (fold(data[0]) << 8) | fold(data[1]);
+      for (qint64 i = 2; i < size; ++i) {
+        trigram = ((trigram << 8) | fold(data[i])) & 0xffffff;
+        uint64_t& word = seen[trigram >> 6];
+        const uint64_t bit = uint64_t(1) << (trigram & 63);
+        if (!(word & bit)) {
+          word |= bit;
+          trigrams.push_back(trigram);
+        }
+      }
+
+      // leaves the bitmap clean for the next file
+      for (uint32_t value : trigrams)
+        seen[value >> 6] = 0;
+
+      std::sort(trigrams.begin(), trigrams.end());
+      return true;
+    }
+
+    // Runs on the reader thread, one file at a time with the same bitmap
+    void readChanges()
+    {
+      std::vector<uint64_t> seen(Bitmap);
+      while (true) {
+        PendingRead read;
+        {
+          std::unique_lock<std::mutex> lock(_readMutex);
+          _readWake.wait(lock, [this](){ return _stopReader || !_toRead.empty(); });
+          if (_stopReader)
+            return;
+
+          read = std::move(_toRead.front());
+          _toRead.pop_front();
+        }
+
+        Change change;
+        change.sequence = read.sequence;
+        const QFileInfo info(read.root + "/" + read.relative);
+        if (!info.exists()) {
+          change.removed = true;
+        }
+        else {
+          change.modified = info.lastModified().toMSecsSinceEpoch();
+          change.size = info.size();
+          change.removed = !readTrigrams(info.absoluteFilePath(), change.trigrams, seen);
+        }
+
+        QMetaObject::invokeMethod(this, [this, read, change = std::move(change)]() mutable {
+          applyChange(read, std::move(change));
+        }, Qt::QueuedConnection);
+      }
+    }
+
+    void applyChange(const PendingRead& read, Change change)
+    {
+      // another workspace by now, the walk of the last refresh saw a later state, or the
+      // file changed again and its newer read got here first
+      if (read.root != _root || change.sequence <= _adoptedSequence)
+        return;
+      auto it = _overlay.find(read.relative);
+      if (it != _overlay.end() && it->second.sequence > change.sequence)
+        return;
+
+      if (_base) {
+        int id = _base->find(read.relative.toStdString());
+        if (id >= 0)
+          _stale[static_cast<size_t>(id)] = true;
+      }
+      const bool removed = change.removed;
+      _overlay[read.relative] = std::move(change);
+      emit fileUpdated(read.relative, removed);
+
+      if (static_cast<int>(_overlay.size()) > MaxOverlayFiles && !_refreshThread.joinable())
+        startRefresh();
+    }
+
+    // Rules of directory, loaded once and kept until a .gitignore changes
+    std::shared_ptr<const IgnoreRules> rulesOf(const QString& directory, const std::shared_ptr<const IgnoreRules>& parent) const
+    {
+      auto it = _rules.find(directory);
+      if (it == _rules.end())
+        it = _rules.emplace(directory, IgnoreRules::load(directory, parent)).first;
+      return it->second;
+    }
+
+    bool ignored(const QString& absolutePath) const
+    {
+      const QStringList parts = QDir(_root).relativeFilePath(absolutePath).split('/');
+      std::shared_ptr<const IgnoreRules> rules;
+      QString path = _root;
+      for (int i = 0; i < parts.size(); ++i) {
+        rules = rulesOf(path, rules);
+        path += "/" + parts[i];
+
+        const bool directory = i + 1 < parts.size();
+        if (IgnoreRules::ignoredByDefault(parts[i], directory) || (rules && rules->ignored(path, parts[i], directory)))
+          return true;
+      }
+      return false;
+    }
+
+    void directoryChanged(const QString& directory)
+    {
+      const QString relative = QDir(_root).relativeFilePath(directory);
+      const QString prefix = relative == "." ? QString() : relative + "/";
+      QStringList changed;
+
+      const auto entries = QDir(directory).entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::NoSymLinks);
+      QSet<QString> present;
+      for (const auto& entry : entries) {
+        present.insert(entry.fileName());
+        if (entry.isDir()) {
+          // a new directory is indexed file by file, as if each had changed
+          if (!_watcher->directories().contains(entry.absoluteFilePath()) && !ignored(entry.absoluteFilePath())) {
+            if (_watcher->directories().size() < MaxWatchedDirectories)
+              _watcher->addPath(entry.absoluteFilePath());
+            directoryChanged(entry.absoluteFilePath());
+          }
+          continue;
+        }
+
+        const QString path = prefix + entry.fileName();
+        const int64_t modified = entry.lastModified().toMSecsSinceEpoch();
+        auto it = _overlay.find(path);
+        if (it != _overlay.end()) {
+          if (it->second.removed || it->second.modified != modified || it->second.size != entry.size())
+            changed.push_back(entry.absoluteFilePath());
+          continue;
+        }
+
+        int id = _base ? _base->find(path.toStdString()) : -1;
+        if (id < 0 || _base->files[id].modified != modified || _base->files[id].size != entry.size())
+          changed.push_back(entry.absoluteFilePath());
+      }
+
+      // files the index knows and the disk does not anymore, directly in the directory or
+      // in a subdirectory that went away
+      auto firstPart = [&](QString path){ return path.mid(prefix.size()).section('/', 0, 0); };
+      if (_base) {
+        const std::string start = prefix.toStdString();
+        for (uint32_t i = _base->lowerBound(start); i < _base->header->fileCount; ++i) {
+          std::string_view path = _base->path(i);
+          if (path.substr(0, start.size()) != start)
+            break;
+
+          const QString file = QString::fromUtf8(path.data(), static_cast<int>(path.size()));
+          if (!_stale[i] && !present.contains(firstPart(file)))
+            changed.push_back(_root + "/" + file);
+        }
+      }
+      for (const auto& [path, change] : _overlay) {
+        if (!change.removed && path.startsWith(prefix) && !present.contains(firstPart(path)))
+          changed.push_back(_root + "/" + path);
+      }
+
+      for (const auto& path : changed)
+        fileChanged(path);
+    }
+
+    void startRefresh()
+    {
+      stopRefresh();
+
+      // the refresh stopped here may still have its results queued
+      ++_generation;
+      _refreshThread = std::thread([this, base = _base, root = _root, indexPath = _indexPath, sequence = _sequence,
+                                    generation = _generation](){
+        QStringList directories;
+        bool unwatched = false;
+        bool written = refresh(base, root, indexPath, generation, directories, unwatched);
+
+        QMetaObject::invokeMethod(this, [this, written, sequence, generation, directories, unwatched](){
+          if (generation == _generation)
+            adopt(written, sequence, directories, unwatched);
+        }, Qt::QueuedConnection);
+      });
+    }
+
+    void stopRefresh()
+    {
+      _stopRefresh = true;
+      if (_refreshThread.joinable())
+        _refreshThread.join();
+      _stopRefresh = false;
+    }
+
+    // Maps the file the refresh wrote, the overlay keeps what changed after the walk began.
+    // unwatched is true when the walk found directories the watcher could not take.
+    void adopt(bool written, uint64_t sequence, const QStringList& directories, bool unwatched)
+    {
+      if (_refreshThread.joinable())
+        _refreshThread.join();
+
+      if (unwatched)
+        _rescanTimer->start();
+      else
+        _rescanTimer->stop();
+
+      if (!written)
+        return;
+
+      auto base = Base::open(_indexPath);
+      if (!base)
+        return;
+
+      _base = base;
+      _adoptedSequence = sequence;
+      _stale.assign(_base->header->fileCount, false);
+      for (auto it = _overlay.begin(); it != _overlay.end();) {
+        if (it->second.sequence <= sequence) {
+          it = _overlay.erase(it);
+          continue;
+        }
+
+        int id = _base->find(it->first.toStdString());
+        if (id >= 0)
+          _stale[static_cast<size_t>(id)] = true;
+        ++it;
+      }
+
+      if (!_watcher->directories().isEmpty())
+        _watcher->removePaths(_watcher->directories());
+      if (!directories.isEmpty())
+        _watcher->addPaths(directories);
+
+      emit ready(static_cast<int>(_base->header->fileCount));
+    }
+
+    // Runs on the refresh thread, base is only read. Writes the index of root to indexPath,
+    // unless nothing changed since base was written.
+    bool refresh(const std::shared_ptr<const Base>& base, const QString& root, const QString& indexPath, uint64_t generation,
+                 QStringList& directories, bool& unwatched)
+    {
+      // the walk, in the same order the file table is sorted in
+      std::vector<Entry> entries;
+      std::vector<std::pair<QString, std::shared_ptr<const IgnoreRules>>> pending{{root, nullptr}};
+      while (!pending.empty()) {
+        if (_stopRefresh)
+          return false;
+
+        auto [directory, parentRules] = std::move(pending.back());
+        pending.pop_back();
+        if (directories.size() < MaxWatchedDirectories)
+          directories.push_back(directory);
+        else
+          unwatched = true;
+
+        auto rules = IgnoreRules::load(directory, parentRules);
+        const auto list = QDir(directory).entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::NoSymLinks,
+                                                        QDir::NoSort);
+        for (const auto& info : list) {
+          const bool isDirectory = info.isDir();
+          const QString name = info.fileName();
+          const QString path = info.absoluteFilePath();
+          if (IgnoreRules::ignoredByDefault(name, isDirectory) || (rules && rules->ignored(path, name, isDirectory)))
+            continue;
+
+          if (isDirectory)
+            pending.emplace_back(path, rules);
+          else
+            entries.push_back({path.mid(root.size() + 1).toStdString(), info.lastModified().toMSecsSinceEpoch(), info.size()});
+        }
+      }
+
+      std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){ return a.path < b.path; });
+
+      // the file list is known long before the trigrams are
+      auto listing = std::make_shared<std::vector<std::string>>();
+      listing->reserve(entries.size());
+      for (const auto& entry : entries)
+        listing->push_back(entry.path);
+      QMetaObject::invokeMethod(this, [this, generation, listing = std::shared_ptr<const std::vector<std::string>>(listing)](){
+        if (generation == _generation)
+          emit filesListed(listing);
+      }, Qt::QueuedConnection);
+
+      // unchanged files keep their lists from the current index, the others are read
+      const uint32_t baseCount = base ? base->header->fileCount : 0;
+      std::vector<uint32_t> fromBase(baseCount, UINT32_MAX);
+      std::vector<uint32_t> toRead;
+      for (uint32_t id = 0; id < entries.size(); ++id) {
+        int old = base ? base->find(entries[id].path) : -1;
+        if (old >= 0 && base->files[old].modified == entries[id].modified && base->files[old].size == entries[id].size)
+          fromBase[static_cast<size_t>(old)] = id;
+        else
+          toRead.push_back(id);
+      }
+
+      // the files read are inverted a batch at a time into runs of (trigram, id) pairs, so
+      // memory stays bounded however many files changed. toRead is in id order, every run
+      // holds ids above those of the runs before it.
+      std::vector<char> unreadable(entries.size(), 0);
+      std::vector<Run> runs;
+      std::vector<uint64_t> pairs;
+      const QString runDirectory = QFileInfo(indexPath).absolutePath();
+      const unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+      std::vector<std::vector<uint64_t>> seen(threads, std::vector<uint64_t>(Bitmap));
+
+      for (size_t first = 0; first < toRead.size();) {
+        size_t last = first;
+        int64_t bytes = 0;
+        while (last < toRead.size() && last - first < BatchFiles && (last == first || bytes + entries[toRead[last]].size <= BatchBytes))
+          bytes += entries[toRead[last++]].size;
+
+        std::vector<Trigrams> read(last - first);
+        std::atomic<size_t> next{first};
+        std::vector<std::thread> readers;
+        for (unsigned t = 0; t < threads; ++t) {
+          readers.emplace_back([&, t](){
+            for (size_t i = next++; i < last && !_stopRefresh; i = next++) {
+              uint32_t id = toRead[i];
+              if (!readTrigrams(root + "/" + QString::fromStdString(entries[id].path), read[i - first], seen[t]))
+                unreadable[id] = 1;
+            }
+          });
+        }
+        for (auto& reader : readers)
+          reader.join();
+
+        if (_stopRefresh)
+          return false;
+
+        for (size_t i = first; i < last; ++i)
+          for (uint32_t trigram : read[i - first])
+            pairs.push_back((uint64_t(trigram) << 32) | toRead[i]);
+        first = last;
+
+        if (pairs.empty() || (pairs.size() < RunPairs && first < toRead.size()))
+          continue;
+
+        std::sort(pairs.begin(), pairs.end());
+        runs.emplace_back();
+        if (first < toRead.size()) {
+          if (!runs.back().spill(pairs, runDirectory))
+            return false;
+          pairs.clear();
+        }
+        else {
+          runs.back().block.swap(pairs);
+        }
+      }
+
+      // a rescan that found every file of base unchanged and nothing readable besides them
+      // keeps the mapped file
+      const bool unchanged = base && std::find(fromBase.begin(), fromBase.end(), UINT32_MAX) == fromBase.end() &&
+                             std::all_of(toRead.begin(), toRead.end(), [&](uint32_t id){ return unreadable[id] != 0; });
+      if (unchanged)
+        return false;
+
+      return write(indexPath, entries, unreadable, base, fromBase, runs);
+    }
+
+    // Writes the index of entries. The list of a trigram is the one of base, ids renumbered
+    // through fromBase, merged with the pairs of the same trigram in the runs.
+    static bool write(const QString& indexPath, const std::vector<Entry>& entries, const std::vector<char>& unreadable,
+                      const std::shared_ptr<const Base>& base, const std::vector<uint32_t>& fromBase, std::vector<Run>& runs)
+    {
+      QSaveFile out(indexPath);
+      if (!out.open(QIODevice::WriteOnly))
+        return false;
+
+      Header header{};
+      std::memcpy(header.magic, Magic, sizeof(Magic));
+      header.version = Version;
+      header.files = sizeof(Header);
+
+      // unreadable files are left out, ids are renumbered around them
+      std::vector<uint32_t> ids(entries.size(), UINT32_MAX);
+      std::vector<FileEntry> files;
+      QByteArray paths;
+      for (size_t i = 0; i < entries.size(); ++i) {
+        if (unreadable[i])
+          continue;
+
+        ids[i] = static_cast<uint32_t>(files.size());
+        files.push_back({static_cast<uint64_t>(paths.size()), static_cast<uint32_t>(entries[i].path.size()), 0,
+                         entries[i].modified, entries[i].size});
+        paths.append(entries[i].path.data(), static_cast<qsizetype>(entries[i].path.size()));
+      }
+
+      header.fileCount = static_cast<uint32_t>(files.size());
+      header.paths = header.files + files.size() * sizeof(FileEntry);
+      header.postings = header.paths + static_cast<uint64_t>(paths.size());
+
+      // the header is rewritten once the offsets are known
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char*>(files.data()), static_cast<qint64>(files.size() * sizeof(FileEntry)));
+      out.write(paths);
+
+      std::vector<TrigramEntry> table;
+      uint64_t offset = 0;
+      QByteArray buffer;
+      std::vector<uint32_t> list;
+      const uint32_t baseTrigrams = base ? base->header->trigramCount : 0;
+      uint32_t b = 0;
+      while (true) {
+        bool more = b < baseTrigrams;
+        uint32_t trigram = more ? base->trigrams[b].trigram : UINT32_MAX;
+        for (auto& run : runs) {
+          if (!run.atEnd()) {
+            trigram = std::min(trigram, static_cast<uint32_t>(run.head() >> 32));
+            more = true;
+          }
+        }
+        if (!more)
+          break;
+
+        // both tables are sorted by path, renumbered base ids stay sorted. The runs cover
+        // increasing ids, taken in order their pairs of the trigram come out sorted too.
+        list.clear();
+        if (b < baseTrigrams && base->trigrams[b].trigram == trigram) {
+          for (uint32_t old : base->postings(base->trigrams[b]))
+            if (fromBase[old] != UINT32_MAX)
+              list.push_back(fromBase[old]);
+          ++b;
+        }
+        const auto middle = static_cast<std::ptrdiff_t>(list.size());
+        for (auto& run : runs) {
+          for (; !run.atEnd() && (run.head() >> 32) == trigram; run.pop())
+            list.push_back(static_cast<uint32_t>(run.head()));
+        }
+        std::inplace_merge(list.begin(), list.begin() + middle, list.end());
+
+        uint32_t count = 0;
+        uint32_t previous = 0;
+        const uint64_t start = offset;
+        for (uint32_t id : list) {
+          if (ids[id] == UINT32_MAX)
+            continue;
+
+          uint32_t delta = ids[id] - previous;
+          previous = ids[id];
+          do {
+            buffer.append(static_cast<char>((delta & 0x7f) | (delta > 0x7f ? 0x80 : 0)));
+            delta >>= 7;
+            ++offset;
+          } while (delta);
+          ++count;
+        }
+
+        if (count > 0)
+          table.push_back({trigram, count, start});
+
+        if (buffer.size() > (1 << 20)) {
+          out.write(buffer);
+          buffer.clear();
+        }
+      }
+      out.write(buffer);
+
+      // a run that could not be read back would leave holes in the lists
+      if (std::any_of(runs.begin(), runs.end(), [](const Run& run){ return run.failed; }))
+        return false;
+
+      const uint64_t padding = (8 - (header.postings + offset) % 8) % 8;
+      out.write(QByteArray(static_cast<int>(padding), '\0'));
+
+      header.trigramCount = static_cast<uint32_t>(table.size());
+      header.trigrams = header.postings + offset + padding;
+      header.size = header.trigrams + table.size() * sizeof(TrigramEntry);
+      out.write(reinterpret_cast<const char*>(table.data()), static_cast<qint64>(table.size() * sizeof(TrigramEntry)));
+
+      out.seek(0);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      return out.commit();
+    }
+
+    QString _root;
+    QString _indexPath;
+    std::shared_ptr<const Base> _base;
+    std::vector<bool> _stale;                 // base files the overlay replaces
+    std::unordered_map<QString, Change, QStringHash> _overlay;
+    uint64_t _sequence{0};
+    uint64_t _adoptedSequence{0};             // changes up to this one are in the mapped file
+    uint64_t _generation{0};                  // bumped by every refresh started, results of older ones are dropped
+    QFileSystemWatcher* _watcher{nullptr};
+    QTimer* _rescanTimer{nullptr};
+    std::thread _refreshThread;
+    std::atomic<bool> _stopRefresh{false};
+    mutable std::unordered_map<QString, std::shared_ptr<const IgnoreRules>, QStringHash> _rules;
+    std::thread _readerThread;
+    std::mutex _readMutex;
+    std::condition_variable _readWake;
+    std::deque<PendingRead> _toRead;
+    bool _stopReader{false};
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_TRIGRAMINDEX_H
@@ -0,0 +1,565 @@
+//
+// Created by Arthur Motelevicz on 17/10/26.
+//
+
+#ifndef QWIDGET_LUA_EDITOR_WORKSPACESEARCH_H
+#define QWIDGET_LUA_EDITOR_WORKSPACESEARCH_H
+
+#include "IgnoreRules.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QObject>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aic
+{
+
+  struct SearchMatch
+  {
+    QString path;
+    int line{0};      // 1 based
+    int column{0};    // 0 based
+    QString text;     // the line, cut at MaxLineChars
+  };
+
+  // Searches every text file under a root (a directory or a single file) on a pool of
+  // work-stealing threads: each thread lists directories and searches files from its own
+  // deque and steals from the others when it runs dry. Files are memory mapped, binary
+  // files and what .gitignore excludes are skipped. A literal part of the query is located
+  // with memchr, which libc vectorizes, before a line goes to the regular expression.
+  // Matches are posted to the GUI thread in batches while the search runs.
+  class WorkspaceSearch : public QObject
+  {
+  Q_OBJECT
+
+  public:
+    static constexpr int MaxMatches = 5000;
+
+    struct Query
+    {
+      QString text;
+      bool regex{false};
+      bool matchCase{false};
+      int maxMatches{MaxMatches};   // the search stops past this many, reported truncated
+    };
+
+    static constexpr qint64 MaxFileBytes = 64 * 1024 * 1024;
+    static constexpr int MaxLineChars = 300;
+
+    explicit WorkspaceSearch(QObject* parent = nullptr): QObject(parent){}
+
+    ~WorkspaceSearch() override
+    {
+      cancel();
+    }
+
+    // Cancels the search running, if any. Returns false when the regular expression is invalid.
+    bool start(const QString& root, const Query& query)
+    {
+      auto job = prepare(query);
+      if (!job)
+        return false;
+
+      QFileInfo info(root);
+      push(*job, 0, Task{info.absoluteFilePath(), nullptr, info.isDir()});
+      launch(job);
+      return true;
+    }
+
+    // Searches only files, absolute paths of candidates an index already picked
+    bool start(const QStringList& files, const Query& query)
+    {
+      auto job = prepare(query);
+      if (!job)
+        return false;
+
+      const int count = static_cast<int>(job->workers.size());
+      for (int i = 0; i < files.size(); ++i)
+        push(*job, i % count, Task{files[i], nullptr, false});
+
+      launch(job);
+      if (files.isEmpty())
+        QMetaObject::invokeMethod(this, [this, job](){ finish(job); }, Qt::QueuedConnection);
+      return true;
+    }
+
+    void cancel()
+    {
+      if (_job) {
+        _job->cancelled = true;
+        _job->wake.notify_all();
+      }
+      _job.reset();
+
+      for (auto& thread : _threads)
+        if (thread.joinable())
+          thread.join();
+      _threads.clear();
+    }
+
+    bool isRunning() const
+    {
+      return _job != nullptr;
+    }
+
+    // What the memchr prefilter and the trigram index look for, empty when the query has
+    // nothing to narrow the search with. A literal query ignoring case is matched with
+    // ASCII folding, like the find bar, and is its own literal. A regular expression ignoring
+    // case folds the Unicode way, only what ASCII folding cannot miss is kept of its literal.
+    static std::string prefilterLiteral(const Query& query)
+    {
+      if (!query.regex)
+        return query.text.toStdString();
+
+      std::string literal = requiredLiteral(query.text);
+      return query.matchCase ? literal : caselessLiteral(literal);
+    }
+
+    // The longest run of literal made of ASCII bytes other than k and s, which also match
+    // the Kelvin sign and the long s. Bytes of multibyte characters compare as they are in
+    // an ASCII folding search, É would miss é.
+    static std::string caselessLiteral(const std::string& literal)
+    {
+      std::string best;
+      size_t start = 0;
+      for (size_t i = 0; i <= literal.size(); ++i) {
+        const bool breaks = i == literal.size() || static_cast<unsigned char>(literal[i]) >= 0x80 ||
+                            std::strchr("kKsS", literal[i]);
+        if (!breaks)
+          continue;
+
+        if (i - start > best.size())
+          best = literal.substr(start, i - start);
+        start = i + 1;
+      }
+      return best;
+    }
+
+    // The literal every match of pattern must contain, empty when there is none that is
+    // easy to prove (alternations, inline options). Groups may be optional, their content
+    // is never taken.
+    static std::string requiredLiteral(const QString& pattern)
+    {
+      const std::string text = pattern.toStdString();
+      if (text.find('|') != std::string::npos || text.find("(?") != std::string::npos)
+        return {};
+
+      int depth = 0;
+      std::string best;
+      std::string current;
+      auto flush = [&](){
+        if (current.size() > best.size())
+          best = current;
+        current.clear();
+      };
+
+      for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '\\') {
+          // escaped punctuation is itself, \d \w \s and friends are classes
+          if (i + 1 < text.size() && std::ispunct(static_cast<unsigned char>(text[i + 1]))) {
+            ++i;
+            if (depth == 0)
+              current += text[i];
+            continue;
+          }
+          // \x41, \p{L}, back references... too many forms to follow
+          if (i + 1 < text.size() && std::strchr("xpPuNkgcoE0123456789", text[i + 1]))
+            return {};
+          ++i;
+          flush();
+        }
+        else if (c == '[') {
+          flush();
+          while (i < text.size() && text[i] != ']')
+            i += text[i] == '\\' ? 2 : 1;
+        }
+        else if (c == '?' || c == '*' || c == '{') {
+          // the previous character is optional or repeated, it is not required as is
+          if (!current.empty())
+            current.pop_back();
+          flush();
+          if (c == '{')
+            while (i < text.size() && text[i] != '}')
+              ++i;
+        }
+        else if (c == '(' || c == ')') {
+          depth += c == '(' ? 1 : -1;
+          flush();
+        }
+        else if (c == '+' || c == '.' || c == '^' || c == '$') {
+          flush();
+        }
+        else if (depth == 0) {
+          current += c;
+        }
+      }
+
+      flush();
+      return best;
+    }
+
+  signals:
+    void matchesFound(const QVector<aic::SearchMatch>& matches);
+
+    // truncated is true when the search stopped at the maxMatches of its query
+    void finished(int filesSearched, int matchCount, bool truncated);
+
+  private:
+    struct Task
+    {
+      QString path;
+      std::shared_ptr<const IgnoreRules> rules;
+      bool directory{false};
+    };
+
+    struct Worker
+    {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+    // Byte of the literal memchr looks for, and where it sits in the literal. Ignoring case
+    // a letter is looked for in both cases, other is the byte itself for anything else.
+    struct Needle
+    {
+      int offset{-1};
+      unsigned char byte{0};
+      unsigned char other{0};
+    };
+
+    struct Job
+    {
+      Query query;
+      QRegularExpression regex;
+      std::string literal;
+      Needle pick;
+      std::vector<std::unique_ptr<Worker>> workers;
+      std::atomic<int> pending{0};
+      std::atomic<bool> cancelled{false};
+      std::atomic<bool> full{false};      // maxMatches reached, the remaining tasks are dropped
+      std::atomic<int> matches{0};
+      std::atomic<int> files{0};
+      std::mutex idleMutex;
+      std::condition_variable wake;
+    };
+
+    static void push(Job& job, int worker, Task task)
+    {
+      ++job.pending;
+      {
+        std::lock_guard<std::mutex> lock(job.workers[worker]->mutex);
+        job.workers[worker]->tasks.push_back(std::move(task));
+      }
+      job.wake.notify_one();
+    }
+
+    // The owner takes the newest task (depth first, warm caches), thieves the oldest one
+    static bool takeTask(Job& job, int self, Task& task)
+    {
+      {
+        auto& own = *job.workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+          task = std::move(own.tasks.back());
+          own.tasks.pop_back();
+          return true;
+        }
+      }
+
+      const int count = static_cast<int>(job.workers.size());
+      for (int i = 1; i < count; ++i) {
+        auto& victim = *job.workers[(self + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+          task = std::move(victim.tasks.front());
+          victim.tasks.pop_front();
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    void run(std::shared_ptr<Job> job, int self)
+    {
+      QRegularExpression regex = job->regex;
+      std::vector<SearchMatch> found;
+
+      while (!job->cancelled) {
+        Task task;
+        if (!takeTask(*job, self, task)) {
+          if (job->pending == 0)
+            break;
+
+          // another thread is still listing a directory, its tasks may come any moment
+          std::unique_lock<std::mutex> lock(job->idleMutex);
+          job->wake.wait_for(lock, std::chrono::milliseconds(2));
+          continue;
+        }
+
+        // past maxMatches the tasks left are only counted down
+        if (!job->full) {
+          if (task.directory)
+            listDirectory(*job, self, task);
+          else
+            searchFile(*job, task.path, regex, found);
+        }
+
+        if (!found.empty()) {
+          QVector<SearchMatch> batch(found.begin(), found.end());
+          found.clear();
+          QMetaObject::invokeMethod(this, [this, job, batch](){
+            if (job == _job)
+              emit matchesFound(batch);
+          }, Qt::QueuedConnection);
+        }
+
+        // the last task done ends the search, for every thread
+        if (--job->pending == 0) {
+          job->wake.notify_all();
+          QMetaObject::invokeMethod(this, [this, job](){ finish(job); }, Qt::QueuedConnection);
+        }
+      }
+    }
+
+    void finish(const std::shared_ptr<Job>& job)
+    {
+      if (job != _job)
+        return;
+
+      _job.reset();
+      for (auto& thread : _threads)
+        if (thread.joinable())
+          thread.join();
+      _threads.clear();
+
+      emit finished(job->files, std::min(job->matches.load(), job->query.maxMatches), job->full);
+    }
+
+    std::shared_ptr<Job> prepare(const Query& query)
+    {
+      cancel();
+
+      auto job = std::make_shared<Job>();
+      job->query = query;
+
+      if (query.regex) {
+        job->regex.setPattern(query.text);
+        job->regex.setPatternOptions(query.matchCase ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
+        if (!job->regex.isValid())
+          return nullptr;
+
+        // compiled here, the workers only read it
+        job->regex.optimize();
+      }
+
+      job->literal = prefilterLiteral(query);
+      if (job->literal.empty() && !query.regex)
+        return nullptr;
+
+      job->pick = pickNeedle(job->literal, query.matchCase);
+
+      int threads = std::max(2u, std::thread::hardware_concurrency());
+      for (int i = 0; i < threads; ++i)
+        job->workers.push_back(std::make_unique<Worker>());
+
+      return job;
+    }
+
+    void launch(const std::shared_ptr<Job>& job)
+    {
+      _job = job;
+      for (int i = 0; i < static_cast<int>(job->workers.size()); ++i)
+        _threads.emplace_back([this, job, i](){ run(job, i); });
+    }
+
+    void listDirectory(Job& job, int self, const Task& task)
+    {
+      auto rules = IgnoreRules::load(task.path, task.rules);
+
+      const auto entries = QDir(task.path).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::NoSymLinks,
+                                                         QDir::NoSort);
+      for (const auto& entry : entries) {
+        const bool directory = entry.isDir();
+        const QString name = entry.fileName();
+        const QString path = entry.absoluteFilePath();
+
+        if (IgnoreRules::ignoredByDefault(name, directory) || (rules && rules->ignored(path, name, directory)))
+          continue;
+
+        push(job, self, Task{path, rules, directory});
+      }
+    }
+
+    static int rarity(unsigned char c)
+    {
+      if (c >= 0x80)
+        return 4;
+      if (c == ' ' || std::strchr("etaoinsrhl", c))
+        return 0;
+      if (std::islower(c))
+        return 1;
+      if (std::isupper(c) || std::isdigit(c))
+        return 2;
+      return 3;
+    }
+
+    // The rarest byte of the literal, memchr skips most of the text looking for it. Ignoring
+    // case a letter is looked for twice, a byte that is not one is preferred when as rare.
+    static Needle pickNeedle(const std::string& literal, bool matchCase)
+    {
+      Needle needle;
+      int best = -1;
+      for (size_t i = 0; i < literal.size(); ++i) {
+        auto c = static_cast<unsigned char>(literal[i]);
+        const bool folded = !matchCase && std::isalpha(c);
+        const int score = folded ? rarity(static_cast<unsigned char>(std::tolower(c))) * 2 : rarity(c) * 2 + 1;
+        if (score > best) {
+          best = score;
+          needle.offset = static_cast<int>(i);
+          needle.byte = folded ? static_cast<unsigned char>(std::tolower(c)) : c;
+          needle.other = folded ? static_cast<unsigned char>(std::toupper(c)) : c;
+        }
+      }
+      return needle;
+    }
+
+    static bool equalsAt(const char* text, const std::string& literal, bool matchCase)
+    {
+      if (matchCase)
+        return std::memcmp(text, literal.data(), literal.size()) == 0;
+
+      for (size_t i = 0; i < literal.size(); ++i)
+        if (std::tolower(static_cast<unsigned char>(text[i])) != std::tolower(static_cast<unsigned char>(literal[i])))
+          return false;
+      return true;
+    }
+
+    // Next occurrence of the literal at or after from, end when there is none
+    static const char* findLiteral(const Job& job, const char* from, const char* end)
+    {
+      const std::string& literal = job.literal;
+      const auto size = static_cast<std::ptrdiff_t>(literal.size());
+      if (end - from < size)
+        return end;
+
+      const char* p = from + job.pick.offset;
+      const char* last = end - size + job.pick.offset;
+
+      // last + 1 when the byte is not there
+      auto next = [last](const char* at, unsigned char byte){
+        if (at > last)
+          return last + 1;
+        auto* hit = static_cast<const char*>(std::memchr(at, byte, static_cast<size_t>(last - at + 1)));
+        return hit ? hit : last + 1;
+      };
+
+      // a letter ignoring case: the nearer of its two cases, each one searched again once passed
+      const char* lower = next(p, job.pick.byte);
+      const char* upper = job.pick.other != job.pick.byte ? next(p, job.pick.other) : last + 1;
+      while (true) {
+        const char* hit = std::min(lower, upper);
+        if (hit > last)
+          return end;
+
+        const char* start = hit - job.pick.offset;
+        if (equalsAt(start, literal, job.query.matchCase))
+          return start;
+
+        if (lower == hit)
+          lower = next(hit + 1, job.pick.byte);
+        if (upper == hit)
+          upper = next(hit + 1, job.pick.other);
+      }
+    }
+
+    void searchFile(Job& job, const QString& path, const QRegularExpression& regex, std::vector<SearchMatch>& found)
+    {
+      QFile file(path);
+      if (!file.open(QIODevice::ReadOnly))
+        return;
+
+      const qint64 size = file.size();
+      if (size <= 0 || size > MaxFileBytes)
+        return;
+
+      auto* data = reinterpret_cast<const char*>(file.map(0, size));
+      if (!data)
+        return;
+
+      // a NUL byte early on means a binary file
+      if (std::memchr(data, 0, static_cast<size_t>(std::min<qint64>(size, 8192))))
+        return;
+
+      ++job.files;
+
+      const char* end = data + size;
+      const char* counted = data;
+      int lineNumber = 1;
+
+      for (const char* p = data; p < end && !job.cancelled && !job.full;) {
+        const char* candidate = job.literal.empty() ? p : findLiteral(job, p, end);
+        if (candidate >= end)
+          break;
+
+        const char* lineStart = candidate;
+        while (lineStart > p && lineStart[-1] != '\n')
+          --lineStart;
+        auto* newline = static_cast<const char*>(std::memchr(candidate, '\n', static_cast<size_t>(end - candidate)));
+        const char* lineEnd = newline ? newline : end;
+
+        lineNumber += static_cast<int>(std::count(counted, lineStart, '\n'));
+        counted = lineStart;
+
+        QString line = QString::fromUtf8(lineStart, static_cast<int>(lineEnd - lineStart));
+        int column = 0;
+        bool matched = true;
+        if (job.query.regex) {
+          auto match = regex.match(line);
+          matched = match.hasMatch();
+          column = static_cast<int>(match.capturedStart());
+        }
+        else {
+          column = QString::fromUtf8(lineStart, static_cast<int>(candidate - lineStart)).size();
+        }
+
+        if (matched) {
+          if (++job.matches > job.query.maxMatches) {
+            job.full = true;
+            break;
+          }
+
+          if (line.size() > MaxLineChars)
+            line.truncate(MaxLineChars);
+
+          found.push_back({path, lineNumber, column, line.trimmed()});
+        }
+
+        // one match per line, as grep reports them
+        p = lineEnd + 1;
+      }
+    }
+
+    std::shared_ptr<Job> _job;
+    std::vector<std::thread> _threads;
+  };
+}
+#endif //QWIDGET_LUA_EDITOR_WORKSPACESEARCH_H